@@ -1,125 +1,662 @@
 /***********************************************************************
 	Jenny Hoac
 	October 2, 2013
-	
-	The program records a series of user input button presses. 
+
+	The program records a series of user input button presses.
 	The button press sequence is "played back" to the user in the form of
 	LED blinks. This happens if the user is inactive for a set amount of time
 	or if record memory is filled up.
 	User can then record a new sequence after playback completion.
 
+	Each press and each pause is kept as its length in Timer A0 ticks (8us),
+	7 bits to a byte, low bits first, with bit 7 set in every byte but the
+	last of a length: two bytes up to 131ms, three up to 16.7s. That is
+	more than the 2 bytes of a length in WDT intervals used to take, so a
+	bank is 160 bytes to keep 50-65 lengths, where the old 80 byte int
+	recordMemory[40] kept 35 (see tools/ledbench).
+
+	The button interrupts on each edge, which is stamped with the time of
+	Timer A0 extended to 32 bits by counting its overflows. The green LED
+	is played back by Timer A0 CCR0 compares and a recording times out on
+	CCR2. The CPU only wakes up for those, the end of a DEBOUNCE and the
+	overflows while recording or playing back, and not at all while
+	waiting for a press.
+
+	There are two banks of recordMemory, one played back and one recorded
+	into, so a recording keeps playing (PLAY_LOOPS times, or over and over)
+	while the next one is recorded, the red LED showing its presses. Playing
+	back only reads its bank, with its own cursor. A lone tap shorter than
+	TAP plays the recording again from the beginning instead of replacing
+	it, and two of them play it from the beginning at the next speed:
+	1x, 2x, 4x, 0.25x, 0.5x and 1x again.
+
+	Recordings are kept through a reset in SLOTS slots in main flash. A new
+	recording replaces the one of the current slot, a lone press longer
+	than SLOT_HOLD moves on to the next slot and plays what it holds. After
+	a reset the slot saved last plays. Each save goes into a flash segment
+	of its own, see save_step, and main writes it between playback edges.
+
  ***********************************************************************/
 
-#include <msp430.h> 
+#include <msp430.h>
 
 #define RED	0x01			// mask to turn red LED on
 #define GREEN 0x40			// mask to turn green LED on
-#define BUTTON 0x08			// mask for push button
-int currentMode;			// changes between record mode (0) and playback mode (1)
+#define BUTTON 0x08			// mask for push button (P1.3, which has no Timer A capture input)
+#define TICKS_PER_MS 125	// Timer A0 counts SMCLK (the calibrated 1MHz DCO) / 8
+#define RECORD_BYTES 160	// size of each bank of recordMemory, both take 320 of the 512 bytes of RAM
+#define OTHER_RAM 64		// bytes of the other globals
+#define STACK_BYTES 128		// for main's save_step -> flash_write with the port and timer handlers on top (link with --stack_size=128)
+#if 2 * RECORD_BYTES + OTHER_RAM + STACK_BYTES > 512
+#error "recordMemory leaves too little of the 512 bytes of RAM for the stack"
+#endif
+#define MAX_LENGTH 5		// bytes of the longest length (an unsigned long)
+#define TIMEOUT (2200UL * TICKS_PER_MS)	// time without a press that ends a recording, also its last pause
+#define DEBOUNCE (5 * TICKS_PER_MS)		// the button is left alone this long after an edge
+#define TAP (300UL * TICKS_PER_MS)		// a lone press shorter than this plays the recording again
+#define SPEED_MIN -2		// playShift of 0.25x
+#define SPEED_MAX 2			// and of 4x
+#define SLOT_HOLD (1000UL * TICKS_PER_MS)	// a lone press longer than this plays the next slot
+#ifndef PLAY_LOOPS
+#define PLAY_LOOPS 0		// times a recording is played back, 0 for over and over
+#endif
+int currentMode;			// changes between record mode (0) and not recording (1)
 int lastButtonState;		// flag for transition between pressing button and letting go
 int playLight;				// flag for if light is on or off in playback mode
-int recordCounter;			// iterator for array and determining when to stop recording
-int recordMemory[40] = {0};	// array that keeps track of button press sequence
+int recordCounter;			// next byte of recordMemory[playBank] to play back, -1 while nothing plays
+int recordLength;			// bytes of the recording being made
+int playBank;				// the bank of recordMemory played back, the other one is recorded into
+int playLength;				// bytes of recordMemory[playBank]
+int playLoops;				// times left to play it back, with PLAY_LOOPS
+int playShift;				// playback speed is 2^playShift, SPEED_MIN to SPEED_MAX
+unsigned int playFrac;		// Q8.8 ticks the compares are behind the scaled lengths, under 1 tick
+unsigned int overflows;		// Timer A0 overflows, the high word of its time
+unsigned long lastEdge;		// time the button last changed, while recording
+unsigned long deadline;		// time the CCR0 compare is for, the end of the length playing
+unsigned long timeout;		// time the CCR2 compare is for, the end of a recording
+unsigned char recordMemory[2][RECORD_BYTES];	// button press sequences, a length per press and per pause
+
+#define SAVE_SEGS 4			// main flash segments 0xF600-0xFDFF keep the slots, see SAVE_AREA
+#define SAVE_SEG_SIZE 512
+#define SLOTS (SAVE_SEGS - 1)	// one segment is always free for the next save
+#ifndef SAVE_FLASH				// a host build points it at its model of the flash
+// the slots' segments, placed by the linker so a program grown into them
+// fails to link instead of erasing itself, and left alone by the loader
+#pragma LOCATION(SAVE_AREA, 0xF600)
+#pragma NOINIT(SAVE_AREA)
+unsigned char SAVE_AREA[SAVE_SEGS * SAVE_SEG_SIZE];
+#define SAVE_FLASH	SAVE_AREA
+#endif
+#define SAVE_SEGMENT(i)	(SAVE_FLASH + (i) * SAVE_SEG_SIZE)
+#define SAVE_HEAD 6			// bytes before the recording in a segment, see save_step
+#define SAVE_CHUNK 16		// bytes of a recording programmed at a time
+#define SAVE_ERASE (20 * TICKS_PER_MS)	// a segment erase holds the CPU up to ~15ms (4819 flash clocks)
+#define SAVE_WRITE (2 * TICKS_PER_MS)	// and SAVE_CHUNK bytes ~1.5ms (30 flash clocks each)
+#define NO_SEG 0xFF
+
+#if RECORD_BYTES > 0xFF || SAVE_HEAD + RECORD_BYTES > SAVE_SEG_SIZE
+#error "a recording has to fit in a segment, its length in a byte"
+#endif
+
+int currentSlot;			// slot a new recording is saved in
+int saveSlot;				// the recording to save next, set by record_stop
+int saveBank;
+int saveLength;
+int savingSlot;				// the one main is writing
+int savingBank;
+int savingLength;
+unsigned char saveWanted;	// +1 for each recording to save, by the handlers
+unsigned char saveDone;		// saveWanted as of the last save main finished
+unsigned char saveStarted;	// saveWanted as of the save main is writing
+int saveAt;					// bytes of it programmed, -1 before the segment is erased
+unsigned char saveTo;		// segment it goes into
+unsigned char saveHeadSeg;	// segment of the newest save
+unsigned int saveSeq;		// its sequence number
+unsigned char saveLive[SLOTS];	// segment of the newest save of each slot, NO_SEG for none
+
+int record_size(unsigned long ticks);
+int record_append(unsigned long ticks);
+unsigned long record_next(const unsigned char *bank, int *at);
+unsigned long time_now(void);
+void compare_at(unsigned long t);
+void timeout_at(unsigned long t);
+void button_watch(void);
+void record_start(unsigned long t);
+void record_edge(unsigned long t);
+void record_stop(unsigned long t);
+int record_clicks(unsigned long *longest);
+void time_start(void);
+void play_start(unsigned long t);
+void play_next(void);
+unsigned long play_scale(unsigned long ticks);
+void play_stop(void);
+void record_init(void);
+void flash_erase(unsigned char *segment);
+void flash_write(unsigned char *dst, const unsigned char *src, unsigned char len);
+unsigned int crc16(unsigned int crc, unsigned char c);
+int save_newer(unsigned int seq, unsigned int than);
+int save_valid(const unsigned char *segment);
+void save_init(void);
+int save_quiet(void);
+unsigned char save_free(void);
+void save_step(void);
+int slot_play(int slot, unsigned long t);
 
 int main(void) {
-    WDTCTL = (WDTPW + WDTTMSEL + WDTCNTCL + 0 + 1);
-    IE1 |= WDTIE;	// enable the WDT interrupt
+    WDTCTL = WDTPW + WDTHOLD;	// stop the watchdog timer, Timer A0 keeps the time now
+    BCSCTL1 = CALBC1_1MHZ;		// 1MHz calibration for clock
+    DCOCTL = CALDCO_1MHZ;
+    record_init();
+
+    // the handlers wake main up while a recording is waiting to be saved,
+    // it writes it whenever flash can hold the CPU between LED edges
+    for(;;){
+        _disable_interrupts();
+        if((saveWanted != saveDone) && save_quiet()){
+            _enable_interrupts();
+            save_step();
+        }
+        else
+            _bis_SR_register(GIE+LPM0_bits);	// the CPU is off until a handler wakes it
+    }
+}
 
+// the rest of the start up, where a host build starts the firmware
+void record_init(){
     // initialize the I/O ports
     P1DIR |= (RED+GREEN);
     P1REN = BUTTON;
     P1OUT = BUTTON;
 
-    currentMode = 1;					// start in playback mode
-    recordCounter = 0;					// initially in wait mode (waiting to record)
+    TA0CTL = TASSEL_2 + ID_3 + MC_2 + TACLR;	// clock source = SMCLK / 8, continuous mode, overflow interrupt off
+
+    currentMode = 1;					// not recording
+    recordCounter = -1;					// nor playing back (waiting to record)
+    recordLength = 0;
+    playBank = 0;
+    playLength = 0;						// with nothing recorded
+    playShift = 0;						// at 1x
     lastButtonState = 0;				// button is initially not pressed
     P1OUT &= ~(RED+GREEN);				// LEDs initially off
-	playLight = 1;						// sets flag so that first number in recordMemory turns the LED on
-
-    _bis_SR_register(GIE+LPM0_bits);	// after this instruction, the CPU is off!
-}
-
-interrupt void WDT_interval_handler(){
-
-	if(P1IN&BUTTON){								// when button is not pressed
-   		if(currentMode == 0){							// in recording mode
-   			P1OUT = (P1OUT & (~GREEN)) | RED;				// only red LED is on (to show that device is recording)
-   			if(lastButtonState == 1){						// if button was pressed at last interrupt check
-   				lastButtonState = 0;							// note that button is no longer being pressed
-   			   	recordCounter++;								// begin fresh counter for how long button isn't pressed
-   			}
-   			recordMemory[recordCounter]++;					// increase the count on how long the button hasn't been pressed / LED off
-   			if(recordMemory[recordCounter] >= 300){			// if button hasn't been pressed for a few seconds
-   				P1OUT &= ~(RED+GREEN);							// turn off LEDS
-   				currentMode = 1;								// move into playback mode
-   				recordCounter = 0;								// move back to beginning of sequence for playback
-   			}
-   		}
-   		else if((currentMode == 1)&&(recordCounter != -1)){	// in playback mode
-   			if(recordMemory[recordCounter] == 0){				// if current cell is empty
-   				recordCounter++;									// moves onto next array element
-   				playLight ^= 1;										// toggles to LED on or LED off mode (depending on previous mode)
-   			}
-   			else{
-				if(playLight == 1){								// if in LED on mode
-					P1OUT = (P1OUT & (~RED)) | GREEN;				// turn green LED on
-					recordMemory[recordCounter]--;					// decrease counter on how long LED has to be on
-				}
-				else if(playLight == 0){						// if in LED off mode
-					P1OUT &= ~(RED+GREEN);							// both lights off
-					recordMemory[recordCounter]--;								// decrease count on how long LED has to stay off (a pause)
-				}
-   			}
-   		}
-	}
-   	else{										// when button is pressed
-   		if(currentMode == 0){						// in recording mode
-   			P1OUT |= (RED+GREEN);						// both green LED and red LED are on
-   	   		if(lastButtonState == 0){					// if button wasn't pressed at last interrupt check
-   	   			lastButtonState = 1;						// note that button is being pressed
-   	   			recordCounter++;							// begin fresh counter in next array cell for how long button stays pressed
-   	   		}
-   			recordMemory[recordCounter]++;					// increase the count on how long the button has been pressed / LED on
-   		}
-   		else if(currentMode == 1){					// in playback mode
-   			if(recordCounter == -1){					// if waiting to go into record mode
-   				currentMode = 0;							// goes into record mode
-   				lastButtonState = 1;						// note that button is pressed
-   				recordCounter = 0;							// leaves wait mode
-   				recordMemory[recordCounter] = 1;				// records initial button press as first value in sequence
-   			}
-   			else{										// otherwise act as if button isn't pressed
-   				if(recordMemory[recordCounter] == 0){		// if current cell is empty
-   					recordCounter++;							// moves onto next array element
-   					playLight ^= 1;								// toggles to LED on or LED off mode (depending on previous mode)
-   				}
-   				else{										// if sequence is being played back, ignores button presses and proceeds as if no button has been pressed
-   					if(playLight == 1){							// if in LED on mode
-   						P1OUT = (P1OUT & (~RED)) | GREEN;			// turn green LED on
-   						recordMemory[recordCounter]--;				// decrease counter on how long LED has to be on
-   					}
-   					else if(playLight == 0){					// if in LED off mode
-   						P1OUT &= ~(RED+GREEN);						// both lights off
-   						recordMemory[recordCounter]--;				// decrease count on how long LED has to stay off (a pause)
-   					}
-   				}
-   			}
+    button_watch();						// wait for the press that starts recording
+
+    save_init();
+    currentSlot = 0;
+    if(saveHeadSeg != NO_SEG){			// play the slot saved last
+        currentSlot = SAVE_SEGMENT(saveHeadSeg)[2];
+        time_start();
+        slot_play(currentSlot, time_now());
+    }
+}
+
+// bytes a length takes in recordMemory
+int record_size(unsigned long ticks){
+	int n = 1;
+
+	while(ticks >= 0x80){
+		ticks >>= 7;
+		n++;
+	}
+	return n;
+}
+
+// add the length of a press or pause to the end of the recording being made,
+// returns 0 (and adds nothing) when it doesn't fit
+int record_append(unsigned long ticks){
+	unsigned char *bank = recordMemory[playBank ^ 1];
+	int at = recordLength;
+
+	if(record_size(ticks) > RECORD_BYTES - at)
+		return 0;
+	do{
+		bank[at++] = (ticks & 0x7F) | ((ticks >= 0x80) ? 0x80 : 0);
+		ticks >>= 7;
+	}while(ticks != 0);
+	recordLength = at;
+	return 1;
+}
+
+// the length of the press or pause at bank[*at], moving *at on to the next one
+unsigned long record_next(const unsigned char *bank, int *at){
+	unsigned long ticks = 0;
+	unsigned char shift = 0, c;
+
+	do{
+		c = bank[(*at)++];
+		ticks |= (unsigned long)(c & 0x7F) << shift;
+		shift += 7;
+	}while(c & 0x80);
+	return ticks;
+}
+
+// Timer A0 as 32 bits, in a handler: an overflow whose interrupt hasn't
+// run yet already counts once TA0R has wrapped
+unsigned long time_now(){
+	unsigned int low = TA0R;
+	unsigned int high = overflows;
+
+	if((TA0CTL & TAIFG) && (low < 0x8000))
+		high++;
+	return ((unsigned long)high << 16) | low;
+}
+
+// have CCR0 interrupt at time t, it also interrupts at every TA0R wrap before
+void compare_at(unsigned long t){
+	deadline = t;
+	TA0CCR0 = (unsigned int)t;
+	TA0CCTL0 = CCIE;
+}
+
+// the same with CCR2, for the end of a recording
+void timeout_at(unsigned long t){
+	timeout = t;
+	TA0CCR2 = (unsigned int)t;
+	TA0CCTL2 = CCIE;
+}
+
+// interrupt on the next edge of the button, away from lastButtonState
+void button_watch(){
+	if(lastButtonState)
+		P1IES &= ~BUTTON;		// pressed, wait for 0->1
+	else
+		P1IES |= BUTTON;		// let go, wait for 1->0
+	P1IFG &= ~BUTTON;			// changing P1IES can set P1IFG
+	P1IE |= BUTTON;
+	if((!(P1IN & BUTTON)) != lastButtonState)
+		P1IFG |= BUTTON;		// it already moved, raise the interrupt by hand
+}
+
+// the press at time t starts a new recording, into the bank not playing
+void record_start(unsigned long t){
+	currentMode = 0;					// goes into record mode
+	recordLength = 0;					// start over at the beginning of the bank
+	lastButtonState = 1;				// note that button is pressed
+	lastEdge = t;
+	P1OUT |= RED;						// red LED shows the presses being recorded
+}
+
+// the button changed at time t, keep how long it was the other way
+void record_edge(unsigned long t){
+	record_append(t - lastEdge);
+	lastEdge = t;
+	lastButtonState ^= 1;
+	if(lastButtonState){
+		P1OUT |= RED;
+		TA0CCTL2 = 0;					// no timeout while it is pressed
+	}
+	else{
+		P1OUT &= ~RED;
+		// no room left for a pause, a press and the last pause
+		if(RECORD_BYTES - recordLength < record_size(TIMEOUT) + MAX_LENGTH + record_size(TIMEOUT))
+			record_stop(t);
+		else
+			timeout_at(t + TIMEOUT);	// if button isn't pressed for a few seconds
+	}
+}
+
+// end the recording at time t, after a release, and play it back from the
+// beginning. One or two clicks don't replace the recording: a tap plays it
+// again, a double-click at the next speed, and a long press plays the next
+// slot, unless a save is still due
+void record_stop(unsigned long t){
+	unsigned long longest;
+	int clicks;
+
+	record_append(TIMEOUT);			// the pause before it plays again
+	TA0CCTL2 = 0;
+	P1OUT &= ~RED;
+	currentMode = 1;				// not recording any more
+	clicks = record_clicks(&longest);
+	if((clicks != 0) && (longest < TAP) && (playLength != 0)){
+		if(clicks == 2)
+			playShift = (playShift == SPEED_MAX) ? SPEED_MIN : playShift + 1;
+		play_start(t);
+	}
+	else if((clicks == 1) && (longest >= SLOT_HOLD) && (saveWanted == saveDone)){
+		currentSlot = (currentSlot + 1) % SLOTS;
+		if(!slot_play(currentSlot, t))
+			play_stop();				// nothing saved in it yet
+	}
+	else{
+		playBank ^= 1;				// the new recording plays, the old one is recorded over next
+		playLength = recordLength;
+		saveSlot = currentSlot;		// and main saves it
+		saveBank = playBank;
+		saveLength = recordLength;
+		saveWanted++;
+		play_start(t);
+	}
+}
+
+// the presses of the recording being made if it is one or two, else 0,
+// and the longest of them and the pause between
+int record_clicks(unsigned long *longest){
+	const unsigned char *bank = recordMemory[playBank ^ 1];
+	int at = 0, n;
+	unsigned long ticks;
+
+	*longest = 0;
+	for(n = 0; n < 4; n++){				// press, pause, press, TIMEOUT at most
+		ticks = record_next(bank, &at);
+		if(at == recordLength)
+			return (n + 1) / 2;				// that was the last pause
+		if(ticks > *longest)
+			*longest = ticks;
+	}
+	return 0;
+}
+
+// keep the 32 bit time from now on, from 0 when it was stopped
+void time_start(){
+	if(!(TA0CTL & TAIE)){
+		TA0CTL &= ~TAIFG;
+		overflows = 0;
+		TA0CTL |= TAIE;
+	}
+}
+
+// play recordMemory[playBank] back from the beginning, starting at time t
+void play_start(unsigned long t){
+	recordCounter = 0;
+	playLight = 0;					// so that the first length turns the LED on
+	playLoops = PLAY_LOOPS;
+	playFrac = 0;
+	deadline = t;
+	play_next();
+}
+
+// the press or pause being played back is over, show the next one until its end
+void play_next(){
+	if(recordCounter >= playLength){	// no more values to play back
+		if((PLAY_LOOPS != 0) && (--playLoops == 0)){
+			play_stop();					// nothing plays until the next recording
+			return;
 		}
-   	}
+		recordCounter = 0;					// play it again, its last pause was the gap
+		playLight = 0;
+	}
+	playLight ^= 1;						// toggles to LED on or LED off mode (depending on previous mode)
+	if(playLight == 1)					// if in LED on mode
+		P1OUT |= GREEN;						// turn green LED on
+	else								// if in LED off mode
+		P1OUT &= ~GREEN;					// light off (a pause)
+	compare_at(deadline + play_scale(record_next(recordMemory[playBank], &recordCounter)));	// from the last deadline, so they don't drift
+}
+
+// a length in ticks at playShift. Faster it loses its low bits, which go
+// into playFrac as 1/256 ticks and come back out once they make a whole
+// tick, so the playback is never more than a tick off
+unsigned long play_scale(unsigned long ticks){
+	if(playShift <= 0)
+		return ticks << -playShift;		// slower (or 1x), exact
+	playFrac += (unsigned int)(ticks & ((1 << playShift) - 1)) << (8 - playShift);
+	ticks = (ticks >> playShift) + (playFrac >> 8);
+	playFrac &= 0xFF;
+	return ticks;
+}
+
+// stop playing back, the LED off
+void play_stop(){
+	recordCounter = -1;
+	P1OUT &= ~GREEN;
+	TA0CCTL0 = 0;
+	if(currentMode == 1)
+		TA0CTL &= ~TAIE;				// no time to keep until a press
+}
+
+//-----Slots in Flash-----
+// Each save takes a main flash segment of its own, laid out as
+//	0-1 sequence number (low byte first, +1 each save, never 0xFFFF),
+//	2 slot, 3 bytes of the recording, 4-5 CRC-16 (CCITT, from 0xFFFF, high
+//	byte first) of bytes 0-3 and the recording, 6- the recording.
+// The newest valid save of each slot is its recording. A save goes into
+// the next segment after the newest one that holds no slot's recording,
+// so the segments are erased in turn, and the slot's last recording stays
+// until the new one is whole. The header, with the CRC last, is written
+// after the recording, a save cut short by a reset doesn't check out and
+// is left for the next one to erase.
+
+#ifndef HOST_FLASH					// a host build brings its own model of these
+void flash_erase(unsigned char *segment){
+	_disable_interrupts();
+	FCTL3 = FWKEY;				// unlock
+	FCTL1 = FWKEY + ERASE;
+	*segment = 0;				// dummy write starts the erase, the CPU waits for it
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+	_enable_interrupts();
+}
+
+void flash_write(unsigned char *dst, const unsigned char *src, unsigned char len){
+	_disable_interrupts();
+	FCTL3 = FWKEY;
+	FCTL1 = FWKEY + WRT;
+	while(len-- != 0)
+		*dst++ = *src++;
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+	_enable_interrupts();
+}
+#endif
+
+unsigned int crc16(unsigned int crc, unsigned char c){
+	unsigned char i;
+
+	crc ^= (unsigned int)c << 8;
+	for(i = 0; i < 8; i++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc & 0xFFFF;
+}
+
+// 1 if sequence number seq came after than
+int save_newer(unsigned int seq, unsigned int than){
+	return (seq != than) && !((seq - than) & 0x8000);
+}
+
+// 1 if the segment holds a whole save
+int save_valid(const unsigned char *segment){
+	unsigned int crc = 0xFFFF, i;
 
-	if(recordCounter >= 35){		// when array limit reached
-		if(currentMode == 0){			// in record mode, no more memory left for recording
-			currentMode = 1;				// go into playback mode
-			recordCounter = 0;				// and reset counter (move to beginning of sequence)
+	if(((segment[0] & segment[1]) == 0xFF) || (segment[2] >= SLOTS)
+	|| (segment[3] < 2) || (segment[3] > RECORD_BYTES))
+		return 0;
+	for(i = 0; i < 4; i++)
+		crc = crc16(crc, segment[i]);
+	for(i = 0; i < segment[3]; i++)
+		crc = crc16(crc, segment[SAVE_HEAD + i]);
+	return (segment[4] == (crc >> 8)) && (segment[5] == (crc & 0xFF));
+}
+
+// find the newest save of each slot
+void save_init(){
+	unsigned char i, slot;
+	unsigned int seq;
+	const unsigned char *segment;
+
+	FCTL2 = FWKEY + FSSEL_1 + 2;	// flash timing generator = MCLK / 3 = 333kHz (257-476kHz)
+
+	for(slot = 0; slot < SLOTS; slot++)
+		saveLive[slot] = NO_SEG;
+	saveHeadSeg = NO_SEG;
+	saveSeq = 0;
+	for(i = 0; i < SAVE_SEGS; i++){
+		segment = SAVE_SEGMENT(i);
+		if(!save_valid(segment))
+			continue;
+		seq = segment[0] | (segment[1] << 8);
+		slot = segment[2];
+		if((saveLive[slot] == NO_SEG) || save_newer(seq, SAVE_SEGMENT(saveLive[slot])[0] | (SAVE_SEGMENT(saveLive[slot])[1] << 8)))
+			saveLive[slot] = i;
+		if((saveHeadSeg == NO_SEG) || save_newer(seq, saveSeq)){
+			saveHeadSeg = i;
+			saveSeq = seq;
 		}
-		else if(currentMode == 1){		// in playback mode, no more values to play back
-			recordCounter = -1;				// set flag to go idle until a button is pressed to signal record mode
-			P1OUT &= ~(RED+GREEN);			// LEDs left off
-			playLight = 1;					// resets flag so that first number in recordMemory turns the LED on
+	}
+	saveWanted = 0;
+	saveDone = 0;
+	saveAt = -1;
+}
+
+// 1 if flash can hold the CPU now without moving an LED edge, called with
+// interrupts off. No erase while recording, the button's edges would be
+// stamped late.
+int save_quiet(){
+	if(saveAt < 0){
+		if(currentMode == 0)
+			return 0;
+		if(recordCounter == -1)
+			return 1;
+		return (long)(deadline - time_now()) > (long)SAVE_ERASE;
+	}
+	if(recordCounter == -1)
+		return 1;
+	return (long)(deadline - time_now()) > (long)SAVE_WRITE;
+}
+
+// the segment the next save goes into
+unsigned char save_free(){
+	unsigned char i, seg, slot;
+
+	seg = (saveHeadSeg == NO_SEG) ? SAVE_SEGS - 1 : saveHeadSeg;
+	for(i = 0; i < SAVE_SEGS; i++){
+		seg = (seg + 1) % SAVE_SEGS;
+		for(slot = 0; (slot < SLOTS) && (saveLive[slot] != seg); slot++);
+		if(slot == SLOTS)
+			break;
+	}
+	return seg;
+}
+
+// the next part of saving the recording: erase its segment, program a
+// SAVE_CHUNK of it, or the header once it is all there. A newer recording
+// to save starts it over.
+void save_step(){
+	unsigned char *segment;
+	unsigned char head[SAVE_HEAD], n;
+	unsigned int crc = 0xFFFF, seq;
+	int i;
+
+	if(saveAt < 0){
+		_disable_interrupts();
+		saveStarted = saveWanted;
+		savingSlot = saveSlot;
+		savingBank = saveBank;
+		savingLength = saveLength;
+		_enable_interrupts();
+		saveTo = save_free();
+		flash_erase(SAVE_SEGMENT(saveTo));
+		saveAt = 0;
+	}
+	else if(saveAt < savingLength){
+		n = (savingLength - saveAt < SAVE_CHUNK) ? savingLength - saveAt : SAVE_CHUNK;
+		flash_write(SAVE_SEGMENT(saveTo) + SAVE_HEAD + saveAt, recordMemory[savingBank] + saveAt, n);
+		saveAt += n;
+	}
+	else{
+		segment = SAVE_SEGMENT(saveTo);
+		seq = (saveSeq == 0xFFFE) ? 0 : saveSeq + 1;
+		head[0] = seq & 0xFF;
+		head[1] = seq >> 8;
+		head[2] = savingSlot;
+		head[3] = savingLength;
+		for(i = 0; i < 4; i++)
+			crc = crc16(crc, head[i]);
+		for(i = 0; i < savingLength; i++)		// as it was programmed
+			crc = crc16(crc, segment[SAVE_HEAD + i]);
+		head[4] = crc >> 8;
+		head[5] = crc & 0xFF;
+		flash_write(segment, head, SAVE_HEAD);
+		saveAt = -1;
+		if(save_valid(segment)){
+			saveLive[savingSlot] = saveTo;
+			saveHeadSeg = saveTo;
+			saveSeq = seq;
 		}
+		saveDone = saveStarted;
+		return;
 	}
+	if(saveStarted != saveWanted)				// recorded over, save the newer one instead
+		saveAt = -1;
+}
 
+// play the recording saved in slot from time t, returns 0 if there is none
+int slot_play(int slot, unsigned long t){
+	const unsigned char *segment;
+	int i;
 
+	if(saveLive[slot] == NO_SEG)
+		return 0;
+	segment = SAVE_SEGMENT(saveLive[slot]);
+	for(i = 0; i < segment[3]; i++)
+		recordMemory[playBank ^ 1][i] = segment[SAVE_HEAD + i];
+	playBank ^= 1;
+	playLength = segment[3];
+	play_start(t);
+	return 1;
 }
 
-ISR_VECTOR(WDT_interval_handler,".int10")
+// ===== Port 1 Interrupt Handler =====
+// This event handler is called on an edge of the button, whether or not
+//    something is playing back.
+
+interrupt void button_handler(){
+	unsigned long t;
+
+	P1IFG &= ~BUTTON;
+	if((!(P1IN & BUTTON)) == lastButtonState){
+		button_watch();					// it bounced back already
+		return;
+	}
+	P1IE &= ~BUTTON;					// left alone until the end of the DEBOUNCE
+	if(currentMode == 1){				// a press, go into record mode
+		time_start();
+		t = time_now();
+		record_start(t);
+	}
+	else{
+		t = time_now();
+		record_edge(t);
+	}
+	TA0CCR1 = (unsigned int)t + DEBOUNCE;
+	TA0CCTL1 = CCIE;
+	if(saveWanted != saveDone)
+		_bic_SR_register_on_exit(LPM0_bits);	// main has a recording to save
+}
+ISR_VECTOR(button_handler, ".int02")
+
+// ===== Timer A0 CCR1, CCR2 and Overflow Interrupt Handler =====
+// This event handler is called at the end of a DEBOUNCE, when the pause
+//    being recorded may have reached TIMEOUT and on each overflow of
+//    Timer A0 while recording or playing back.
+
+interrupt void timer_handler(){
+	switch(TA0IV){					// read highest priority interrupt and clear flag
+		case TA0IV_TACCR1:			// the DEBOUNCE is over, watch the button again
+			TA0CCTL1 = 0;
+			button_watch();
+			break;
+		case TA0IV_TACCR2:			// the button hasn't been pressed for a few seconds
+			if((long)(time_now() - timeout) >= 0)	// not a TA0R wrap before it
+				record_stop(timeout);
+			break;
+		case TA0IV_TAIFG:			// interrupt called for overflow
+			++overflows;
+			break;
+	}
+	if(saveWanted != saveDone)
+		_bic_SR_register_on_exit(LPM0_bits);
+}
+ISR_VECTOR(timer_handler, ".int08")
+
+// ===== Timer A0 CCR0 Interrupt Handler =====
+// This event handler is called when the press or pause being played back
+//    is over.
+
+interrupt void compare_handler(){
+	if((long)(time_now() - deadline) < 0)
+		return;							// a TA0R wrap before the deadline
+	play_next();
+	if(saveWanted != saveDone)
+		_bic_SR_register_on_exit(LPM0_bits);
+}
+ISR_VECTOR(compare_handler, ".int09")
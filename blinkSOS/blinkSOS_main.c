@@ -1,24 +1,62 @@
 /***********************************************************************
 	Jenny Hoac
 	September 11, 2013
-	
+
 	First program into the MSP430G2553.
 	Blinking an LED into the sequence of SOS in Morse Code.
 	Objective is to use as few wasteful for loops as possible.
-	
+
+	The message is turned into Morse code once, at start up: every Morse
+	time unit (the length of a dot) becomes one bit of MORSE_stream, 1 for
+	LED on and 0 for off. The loop then only has to copy the next bit to
+	the LED and wait one unit, the same little work for every unit of any
+	message. Build with -DMESSAGE='"CQ CQ"' or -DWPM=20 to change them.
+
  ***********************************************************************/
- 
-#include  <msp430g2553.h>
 
-unsigned int i = 0;           // Initialize variables. This will keep count of how many cycles between LED toggles
+#include  <msp430g2553.h>
 
+#ifndef MESSAGE
+#define MESSAGE "SOS"				// letters, digits and spaces, repeated forever
+#endif
+#ifndef WPM
+#define WPM 12						// words per minute, of the standard word PARIS (50 units)
+#endif
+#define CPU_HZ 1000000				// MCLK, the calibrated 1MHz DCO
+#define UNIT_MS (1200 / WPM)		// milliseconds of one Morse time unit
+#define MORSE_BITS 256				// units MORSE_stream can hold, a multiple of 8
+
+// Morse code of '0'-'9' and 'A'-'Z', one byte each:
+// number of dots and dashes << 5 | the dots (0) and dashes (1), first one in bit 0
+#define M(n, code) ((n) << 5 | (code))
+const unsigned char MORSE[36] = {
+	M(5, 0x1F), M(5, 0x1E), M(5, 0x1C), M(5, 0x18), M(5, 0x10),	// 0-4
+	M(5, 0x00), M(5, 0x01), M(5, 0x03), M(5, 0x07), M(5, 0x0F),	// 5-9
+	M(2, 0x02), M(4, 0x01), M(4, 0x05), M(3, 0x01), M(1, 0x00),	// A-E
+	M(4, 0x04), M(3, 0x03), M(4, 0x00), M(2, 0x00), M(4, 0x0E),	// F-J
+	M(3, 0x05), M(4, 0x02), M(2, 0x03), M(2, 0x01), M(3, 0x07),	// K-O
+	M(4, 0x06), M(4, 0x0B), M(3, 0x02), M(3, 0x00), M(1, 0x01),	// P-T
+	M(3, 0x04), M(4, 0x08), M(3, 0x06), M(4, 0x09), M(4, 0x0D),	// U-Y
+	M(4, 0x03)													// Z
+};
+
+unsigned char MORSE_stream[MORSE_BITS / 8];	// bit k (of byte k/8) is the LED during unit k
+unsigned int morse_len;						// units of MORSE_stream in use
+unsigned int morse_at;						// unit the LED shows next
+
+void morse_put(unsigned char on, unsigned char units);
+unsigned int morse_encode(const char *msg);
+void morse_tick(void);
 
 void main(void)
 {
-	unsigned long int j;
+	unsigned int ms;
 	WDTCTL = WDTPW + WDTHOLD;    // Stop watchdog timer. This line of code is needed at the beginning of most MSP430 projects.
                                // This line of code turns off the watchdog timer, which can reset the device after a certain period of time.
 
+	BCSCTL1 = CALBC1_1MHZ;       // 1MHz calibration for clock, so a Morse unit lasts UNIT_MS
+	DCOCTL = CALDCO_1MHZ;
+
 	P1DIR |= 0x01;               // P1DIR is a register that configures the direction (DIR) of a port pin as an output or an input.
 
 
@@ -35,29 +73,74 @@ void main(void)
                                // P1DIR = 0000 0001
                                // P1DIR = 0x01     <-- this is the hexadecimal conversion of 0000 0001
 
+	morse_encode(MESSAGE);
 
 
   for (;;)                     // This empty for-loop will cause the lines of code within to loop infinitely
   {
+	  morse_tick();              // show the next unit of the message on the LED
 
-	  for(j = 0; j < 100000; j++)
-	  {
-		  	if(j == 0 || j == 4000 || j == 8000 || j == 15000 || j == 30000 || j == 45000 || j == 60000 || j == 64000 || j == 68000)
-		  	{
-		  		P1OUT = 0x01;
-		  	}
-		  	else if(j == 2000 || j == 6000 || j == 10000 || j == 25000 || j == 40000 || j == 55000 || j == 62000 || j == 66000 || j == 70000)
-		  	{
-		  		P1OUT = 0x00;
-		  	}
-                               // P1OUT is another register which holds the status of the LED. 
-                               // '1' specifies that it's ON or HIGH, while '0' specifies that it's OFF or LOW
-                               // Since our LED is tied to P1.0, we will toggle the 0 bit of the P1OUT register
-
+	  for(ms = 0; ms < UNIT_MS; ms++)
+		  __delay_cycles(CPU_HZ / 1000);	// wait out the unit, 1ms at a time
+  }
+}
 
+// append units of LED on (1) or off (0) to MORSE_stream
+void morse_put(unsigned char on, unsigned char units)
+{
+	for(; units > 0; units--){
+		if(on)
+			MORSE_stream[morse_len >> 3] |= 1 << (morse_len & 7);
+		else
+			MORSE_stream[morse_len >> 3] &= ~(1 << (morse_len & 7));
+		morse_len++;
+	}
+}
 
-    for(i=0; i< 20000; i++);   // Delay between LED toggles. This for-loop will run until the condition is met.
-                               //In this case, it will loop until the variable i increments to 20000.
-  }
+// Turn msg into MORSE_stream: a dot is 1 unit on, a dash 3 units on, with
+// 1 unit off after each, 3 after a letter and 7 after a word. A word gap
+// ends the message, so it is kept apart from its next repeat. Letters that
+// don't fit in MORSE_stream are left out, unknown characters count as spaces.
+// Returns the number of units.
+unsigned int morse_encode(const char *msg)
+{
+	unsigned char code, n;
+	char c;
+
+	morse_len = 0;
+	morse_at = 0;
+	for(; *msg != 0; msg++){
+		c = *msg;
+		if((c >= 'a') && (c <= 'z'))
+			c -= 'a' - 'A';
+		if((c >= '0') && (c <= '9'))
+			code = MORSE[c - '0'];
+		else if((c >= 'A') && (c <= 'Z'))
+			code = MORSE[c - 'A' + 10];
+		else{
+			if((morse_len > 0) && (morse_len + 4 + 4 <= MORSE_BITS))
+				morse_put(0, 4);			// 3 after the letter + 4 = a word gap
+			continue;
+		}
+		if(morse_len + 5 * 4 + 2 + 4 > MORSE_BITS)
+			break;						// the longest letter and the end gap might not fit
+		for(n = code >> 5; n > 0; n--, code >>= 1){
+			morse_put(1, (code & 1) ? 3 : 1);
+			morse_put(0, 1);
+		}
+		morse_put(0, 2);				// 1 after the last dot or dash + 2 = a letter gap
+	}
+	morse_put(0, 4);
+	return morse_len;
 }
 
+// Show the next unit of MORSE_stream on P1.0, the same few steps for every unit
+void morse_tick(void)
+{
+	P1OUT = (MORSE_stream[morse_at >> 3] >> (morse_at & 7)) & 1;
+                               // P1OUT is another register which holds the status of the LED.
+                               // '1' specifies that it's ON or HIGH, while '0' specifies that it's OFF or LOW
+                               // Since our LED is tied to P1.0, we will toggle the 0 bit of the P1OUT register
+	if(++morse_at == morse_len)
+		morse_at = 0;
+}
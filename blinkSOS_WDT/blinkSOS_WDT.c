@@ -1,54 +1,115 @@
 /***********************************************************************
 	Jenny Hoac
 	September 18, 2013
-	
+
 	The watchdog timer is used instead of empty for loops
 	to blink an LED to the pattern of SOS.
-	
+
+	Now Timer A0 blinks it instead: CCR1 toggles its output pin in
+	hardware (OUTMOD_4) when TA0R reaches TA0CCR1, and the CPU only wakes
+	up then, to set the next compare from a[]. In between it sleeps in LPM3
+	with just ACLK (the VLO) running, instead of taking a WDT interrupt
+	every 7.4ms in LPM0. The Timer A0 CCR1 output is P1.6, the green LED of
+	the LaunchPad, the red one on P1.0 has no timer output.
+
+	a[] is made by the compiler from MESSAGE, the letters written as the
+	M_ macros below. Build with -DMESSAGE='M_C(LETTER) M_Q(WORD)' or
+	-DUNIT_MS=200 to change them.
+
  ***********************************************************************/
 
 #include <msp430g2553.h>
 
-volatile unsigned int blink_interval;  // number of WDT interrupts per blink of LED
-volatile unsigned int blink_counter;   // down counter for interrupt handler
-unsigned int a[] = {50, 50, 50, 50, 50, 150, 150, 50, 150, 50, 150, 150, 50, 50, 50, 50, 50, 250};
-unsigned int *p = &a[0];
+#define LED 0x40		// P1.6 = TA0.1, the Timer A0 CCR1 output
+#define VLO_HZ 12000	// typical VLO, ACLK
+#ifndef UNIT_MS
+#define UNIT_MS 370		// length of a dot, the old 50 WDT intervals (8K/1.1MHz ~= 7.4ms each)
+#endif
+#define UNIT ((unsigned int)(UNIT_MS * (unsigned long)VLO_HZ / 1000))	// ACLK ticks of a dot, in long math (int is 16 bits)
+
+#if UNIT_MS * VLO_HZ / 1000 * 7 > 0xFFFF
+#error "UNIT_MS is too long, a word gap (7 * UNIT, unsigned int) has to fit in one TA0R wrap"
+#endif
+
+// Morse letters as run lengths in units, LED on then off: a dot is on for 1
+// unit, a dash for 3, each off for 1 after it, the last one off for gap
+#define LETTER 3		// gap after a letter
+#define WORD 7			// gap after a word, the last letter of the message has it too
+#define DIT 1, 1,
+#define DAH 3, 1,
+#define DIT_(gap) 1, gap,
+#define DAH_(gap) 3, gap,
+#define M_A(gap) DIT DAH_(gap)
+#define M_B(gap) DAH DIT DIT DIT_(gap)
+#define M_C(gap) DAH DIT DAH DIT_(gap)
+#define M_D(gap) DAH DIT DIT_(gap)
+#define M_E(gap) DIT_(gap)
+#define M_F(gap) DIT DIT DAH DIT_(gap)
+#define M_G(gap) DAH DAH DIT_(gap)
+#define M_H(gap) DIT DIT DIT DIT_(gap)
+#define M_I(gap) DIT DIT_(gap)
+#define M_J(gap) DIT DAH DAH DAH_(gap)
+#define M_K(gap) DAH DIT DAH_(gap)
+#define M_L(gap) DIT DAH DIT DIT_(gap)
+#define M_M(gap) DAH DAH_(gap)
+#define M_N(gap) DAH DIT_(gap)
+#define M_O(gap) DAH DAH DAH_(gap)
+#define M_P(gap) DIT DAH DAH DIT_(gap)
+#define M_Q(gap) DAH DAH DIT DAH_(gap)
+#define M_R(gap) DIT DAH DIT_(gap)
+#define M_S(gap) DIT DIT DIT_(gap)
+#define M_T(gap) DAH_(gap)
+#define M_U(gap) DIT DIT DAH_(gap)
+#define M_V(gap) DIT DIT DIT DAH_(gap)
+#define M_W(gap) DIT DAH DAH_(gap)
+#define M_X(gap) DAH DIT DIT DAH_(gap)
+#define M_Y(gap) DAH DIT DAH DAH_(gap)
+#define M_Z(gap) DAH DAH DIT DIT_(gap)
+#define M_0(gap) DAH DAH DAH DAH DAH_(gap)
+#define M_1(gap) DIT DAH DAH DAH DAH_(gap)
+#define M_2(gap) DIT DIT DAH DAH DAH_(gap)
+#define M_3(gap) DIT DIT DIT DAH DAH_(gap)
+#define M_4(gap) DIT DIT DIT DIT DAH_(gap)
+#define M_5(gap) DIT DIT DIT DIT DIT_(gap)
+#define M_6(gap) DAH DIT DIT DIT DIT_(gap)
+#define M_7(gap) DAH DAH DIT DIT DIT_(gap)
+#define M_8(gap) DAH DAH DAH DIT DIT_(gap)
+#define M_9(gap) DAH DAH DAH DAH DIT_(gap)
+
+#ifndef MESSAGE
+#define MESSAGE M_S(LETTER) M_O(LETTER) M_S(WORD)
+#endif
+
+const unsigned char a[] = {MESSAGE};	// units between toggles, in flash: on, off, on, off ...
+const unsigned char *p = &a[0];
 
 int main(void) {
-	  // setup the watchdog timer as an interval timer
-	  WDTCTL =(WDTPW + // (bits 15-8) password
-	                   // bit 7=0 => watchdog timer on
-	                   // bit 6=0 => NMI on rising edge (not used here)
-	                   // bit 5=0 => RST/NMI pin does a reset (not used here)
-	           WDTTMSEL + // (bit 4) select interval timer mode
-	           WDTCNTCL +  // (bit 3) clear watchdog timer counter
-	  		          0 //  bit 2=0 => SMCLK is the source
-	  		          +1 // bits 1-0 = 01 => source/8K
-	  		   );
-	  IE1 |= WDTIE;		// enable the WDT interrupt (in the system interrupt register IE1)
-
-	  P1DIR |= 0x01;					// Set P1.0 to output direction
-
-	  // initialize the state variables
-	  blink_interval=*(p++);                // the number of WDT interrupts per toggle of P1.0
-	  blink_counter=blink_interval;     // initialize the counter
-
-	  _bis_SR_register(GIE+LPM0_bits);  // enable interrupts and also turn the CPU off!
+	  WDTCTL = WDTPW + WDTHOLD;	// stop the watchdog timer, Timer A0 keeps the time now
+	  BCSCTL3 |= LFXT1S_2;		// ACLK = VLO, there is no crystal
+
+	  P1DIR |= LED;				// Set P1.6 to output direction
+	  P1SEL |= LED;				// and connect it to the Timer A0 CCR1 output
+
+	  // setup Timer A0 to count ACLK continuously, CCR1 toggling P1.6 on each compare
+	  TA0CTL = TASSEL_1 + MC_2 + TACLR;	// clock source = ACLK, continuous mode
+	  TA0CCR1 = *(p++) * UNIT;			// the first toggle (unsigned, UNIT is)
+	  TA0CCTL1 = OUT;					// LED on for the first run
+	  TA0CCTL1 = OUTMOD_4 + CCIE;		// toggle mode (from on), interrupt on compare
+
+	  _bis_SR_register(GIE+LPM3_bits);  // enable interrupts and turn everything off but ACLK!
 }
 
-// ===== Watchdog Timer Interrupt Handler =====
-// This event handler is called to handle the watchdog timer interrupt,
-//    which is occurring regularly at intervals of about 8K/1.1MHz ~= 7.4ms.
+// ===== Timer A0 CCR1 Interrupt Handler =====
+// This event handler is called when CCR1 has just toggled P1.6, once per
+//    symbol boundary, to set the compare for the next one.
 
-interrupt void WDT_interval_handler(){
-  if (--blink_counter==0){          // decrement the counter and act only if it has reached 0
-	  P1OUT ^= 1;                   // toggle LED on P1.0
-	if(p == &a[18])
+interrupt void blink_handler(){
+  if(TA0IV == TA0IV_TACCR1){		// reading TA0IV clears the interrupt
+	if(p == &a[sizeof a])
 		p = &a[0];
-	blink_counter=*(p++); // reset the down counter
-
+	TA0CCR1 += *(p++) * UNIT;		// the next toggle, unsigned, TA0R wraps around with it
   }
 }
-// DECLARE function WDT_interval_handler as handler for interrupt 10
+// DECLARE function blink_handler as handler for interrupt 8 (TIMER0_A1)
 // using a macro defined in the msp430g2553.h include file
-ISR_VECTOR(WDT_interval_handler, ".int10")
+ISR_VECTOR(blink_handler, ".int08")
@@ -5,7 +5,7 @@
 	This project mimics a capture the flag / seize and secure type of laser game.
 	
 	Rough Game Logic:
-	The game consists of two teams with the goal of seizing a flag and securing it.
+	The game consists of two (up to four) teams with the goal of seizing a flag and securing it.
 	A team seizes the flag when the corresponding target is "shot at" by a laser
 	gun for a period of time. A counter is displayed on the LCD during this time.
 	A separate timer keeps track of how long the flag is in possession of a team
@@ -16,125 +16,531 @@
 	
  ***********************************************************************/
 
- #include <msp430.h>
-
 #include "msp430g2553.h"
 #define	LCDDATA	0x0F	// P2.3-P2.0 correspond directly to D7-D4 on LCD, a nibble's worth of data (O)
 #define	LCDRS	0x10	// P1.4, Register Select, used to establish whether it is an instruction or data being sent (O)
-#define	LCDRW	0x20	// P1.5, Read/~Write Select (O)
+#define	LCDRW	0x20	// P1.5, Read/~Write Select, high only while reading the busy flag (O)
 #define	LCDE	0x40	// P1.6, Enable/Enter, normal high and negative edge triggers ADC data collection (O)
 
+// game rules, each can be set from the build (e.g. -DNUM_TEAMS=3) instead of here
+#ifndef NUM_TEAMS
+#define NUM_TEAMS 2	// 2-4, BLU and YEL need the 28 pin package for their flag LEDs on P3
+#endif
+#ifndef STARTUP_SECS
+#define STARTUP_SECS 6	// length of the start up signal
+#endif
+#ifndef CAPTURE_SECS
+#define CAPTURE_SECS 5	// a target held this long takes the flag
+#endif
+#ifndef SCORE_SECS
+#define SCORE_SECS 10	// the owner scores a point this often
+#endif
+#ifndef OWNWIN_SECS
+#define OWNWIN_SECS 120	// owning the flag this long wins the game
+#endif
+#define MINUTES_MAX 15	// longest game setup_up offers
+
+#if (NUM_TEAMS < 2) || (NUM_TEAMS > 4)
+#error "NUM_TEAMS must be 2-4"
+#endif
+#if STARTUP_SECS < 1
+#error "STARTUP_SECS must be at least 1, a timer armed for 0 jiffies first runs a whole turn of JIFFIES (2.3 hours) later"
+#endif
+#if SCORE_SECS < 1
+#error "SCORE_SECS must be at least 1, T_SCORE armed for 0 jiffies would not run in the game, its period of 0 only once"
+#endif
+#if (SCORE_SECS >= 1) && (MINUTES_MAX * 60 / SCORE_SECS > 99)
+#error "SCORE_SECS must leave a MINUTES_MAX game at most 99 points, SCORE holds two BCD digits"
+#endif
+#if (CAPTURE_SECS < 1) || (CAPTURE_SECS > 9)
+#error "CAPTURE_SECS must be 1-9, it fits the progress bar and a single telemetry digit"
+#endif
+#if (OWNWIN_SECS < SCORE_SECS) || (OWNWIN_SECS > 120)
+#error "OWNWIN_SECS must be SCORE_SECS-120, the flag time on the LCD has one minute digit"
+#endif
+
 #define	REDTAKE	0x01	// P1.0, goes high when red team is taking flag (IR phototransistor is activated) (I)
 #define	GRNTAKE	0x02	// P1.1, goes high when green team is taking flag (IR phototransistor is activated) (I)
-#define	ENTER	0x04	// P1.2, goes high when user wants to set currently displayed gametime and start game (I)
-#define	UP		0x08	// P1.3, goes high when user wants to increment gametime, varying from 2 to 20 (I)
-#define	REDFLAG	0x10	// P2.4, turns the red "flag" LEDs on (O)
-#define GRNFLAG	0x20	// P2.5, turns the green "flag" LEDs on (O)
-#define ONE_SEC 250		// number of WDT cycles until 1 second is reached
-#define INIT_CNT 67		// number of WDT cycles for LCD initialization
+#define	BLUTAKE	0x08	// P1.3, same for the blue team (I)
+#define	YELTAKE	0x80	// P1.7, same for the yellow team (I)
+#define	TXD		0x04	// P1.2, UCA0TXD, telemetry frames out at 115200 baud (O)
+#define	RXD		0x02	// P1.1, UCA0RXD in a replay (GRNTAKE otherwise), the stream in at 115200 baud (I)
+#define	UP		0x40	// P2.6 (XIN), goes high when user wants to increment gametime, varying from 2 to 20 (I)
+#define	ENTER	0x80	// P2.7 (XOUT), goes high when user wants to set currently displayed gametime and start game (I)
+// flag LEDs are P2 bits in the low byte and P3 bits in the high byte, see flag_on
+#define	REDFLAG	0x0010	// P2.4, turns the red "flag" LEDs on (O)
+#define GRNFLAG	0x0020	// P2.5, turns the green "flag" LEDs on (O)
+#define BLUFLAG	0x0100	// P3.0, turns the blue "flag" LEDs on (O)
+#define YELFLAG	0x0200	// P3.1, turns the yellow "flag" LEDs on (O)
+#if NUM_TEAMS == 2
+#define TAKES	(REDTAKE + GRNTAKE)
+#define FLAGS	(REDFLAG + GRNFLAG)
+#elif NUM_TEAMS == 3
+#define TAKES	(REDTAKE + GRNTAKE + BLUTAKE)
+#define FLAGS	(REDFLAG + GRNFLAG + BLUFLAG)
+#else
+#define TAKES	(REDTAKE + GRNTAKE + BLUTAKE + YELTAKE)
+#define FLAGS	(REDFLAG + GRNFLAG + BLUFLAG + YELFLAG)
+#endif
+#if defined(PROBE_PIN) && (PROBE_PIN & (TAKES | TXD | LCDRS | LCDRW | LCDE))
+#error "PROBE_PIN must be a free P1 pin"
+#endif
+#define JIFFY_DIV 8		// jiffies in 1 second, the resolution of the game timers
+#define SEC(s)	((s) * JIFFY_DIV)	// seconds to jiffies
+#define WHEEL_SLOTS 16	// slots of the timer wheel, a power of 2
+#define WHEEL_AHEAD 8	// most jiffies slept at once, keeps TA0CCR0 < 32768 ticks ahead at 20kHz
+#define TIME_MIN 2		// ACLK ticks, a TA0CCR0 deadline closer than this could be missed
+#define BAR_LEVELS 8	// progress bar glyphs in CGRAM, see LCD_INIT_SCRIPT
+#define BAR(level)	(0x08 + (level))	// character code of a bar glyph (0x08-0x0F mirror CGRAM 0-7)
+#define CAPTURE_STEP (SEC(CAPTURE_SECS) / BAR_LEVELS)	// jiffies per bar level, 5
+#define DEB_RATE 500	// samples per second of a target being debounced
+#define DEB_MAX	12		// integrator limit, a target is settled once its count sits at 0 or DEB_MAX
+#define DEB_HOLD 8		// count a released target has to climb to before it is hit
+#define DEB_RELEASE 2	// count a hit target has to fall to before it is let go
+#define LOG_SIZE 32		// bytes of records waiting in RAM for log_flush
+#define LOG_SEGS 3		// info flash segments D, C, B hold the log
+#define LOG_SEG_SIZE 64
+#ifndef INFO_FLASH
+#define INFO_FLASH	((unsigned char *)0x1000)	// info memory, a host build points it at RAM
+#endif
+#define LOG_SEGMENT(i)	(INFO_FLASH + (i) * LOG_SEG_SIZE)
+#define LOG_TYPE	0xE0	// record header fields, see log_event
+#define LOG_TEAM	0x18
+#define LOG_DELTA	0x07
+#define LOG_START	0x00	// game started, data byte = game minutes
+#define LOG_TAKE	0x20	// team started taking the flag
+#define LOG_ABORT	0x40	// team let go before taking it
+#define LOG_OWNED	0x60	// team took the flag, the owner changed
+#define LOG_SCORE	0x80	// owner scored a point
+#define LOG_OVER	0xA0	// game over, team = winner
+#define LOG_TIE		0xC0	// game over, no single winner
+#define LOG_TEAMOF(t)	((t) << 3)
+#define TX_SIZE 64		// bytes of TX_ring, a power of 2
+#define TLM_SYNC 0xA5	// first byte of every telemetry frame
+#define TLM_LEN 13		// bytes of a telemetry frame, see tlm_frame
+#define TLM_NOTEAM 0x0F	// team nibble of a frame when there is no owner/attacker
+// ISR probes, built in with -DPROBE (and -DPROBE_PIN=0x80 for a scope pin with up to 3 teams), see probe_record
+#define P_PORT		0	// target_handler and button_handler
+#define P_TIMER		1	// timer_handler
+#define P_DEBOUNCE	2	// debounce_handler
+#define P_TX		3	// tx_handler
+#define P_LCD		4	// LCD_handler
+#define P_LCD_LATE	5	// LCD_handler's start after its TA1CCR0 compare
+#define N_PROBES	6
+#define PROBE_BUCKETS 8	// histogram buckets of a probe, 0-3us, 4-7us, 8-15us ... >= 256us
+#define PROBE_SYNC 0xA6	// first byte of a probe frame
+#define PROBE_LEN (2 + 2 * PROBE_BUCKETS + 2 + 1)	// bytes of a probe frame, see probe_dump
+// input recording and replay, built in with -DRECORD, see rec_event
+#ifdef RECORD
+#define TIME_TICKS		// keep TIME_ticks, the ACLK time since start up
+#endif
+#if defined(PROBE) && defined(RECORD)
+#error "PROBE and RECORD together leave ~14 of the 512 bytes of RAM for the stack, build one at a time"
+#endif
+#define REC_SIZE 32		// bytes of REC_buf, a power of 2
+#define REC_SYNC 0xA7	// first byte of a recording frame
+#define REC_DATA 12		// stream bytes a recording frame carries
+#define REC_LEN (3 + REC_DATA + 1)	// bytes of a recording frame, see rec_dump
+#define REC_START 0x80	// frame flag: the stream starts over with this frame (reset)
+#define REC_LOST 0x40	// frame flag: records were dropped since the last frame
+#define REC_ACK 0x20	// frame flag: a replay's ack, data byte 0 counts the stream bytes it took
+#define REC_SAMPLE 0	// record of the TAKES levels a debounce sample read
+#define REC_EDGE 1		// record of the TAKES levels after an edge interrupt
+#define REC_BUTTONS 2	// record of the buttons pressed (P2IFG bits)
+#define REC_KIND 3		// record kind bits
+#define REC_MAX 6		// bytes of the longest record
+#define REPLAY_WAIT 0xFF	// REPLAY_kind while REC_buf doesn't hold all of the next record
+#define REPLAY_ACK 8	// stream bytes a replay takes between acks
+#define LCD_QSIZE 32	// number of LCD_queue entries, a power of 2
+#define LCD_T_EXEC 40	// TA1 counts (us) to wait after a single nibble, when there is no busy flag yet
+#define LCD_T_POLL 10	// TA1 counts (us) between busy flag reads
+#define LCD_POLL_MAX 160	// busy flag reads (> clear display time) before giving up on it
+#define LCD_BUSY 0x80	// busy flag bit of LCD_status(), the rest is the address counter
+#define LCD_Q_NIB	0x0000	// LCD_queue entry kinds (high byte), the low byte is the value:
+#define LCD_Q_CMD	0x0100	//	a single command nibble, a command byte, a data byte,
+#define LCD_Q_DATA	0x0200	//	or a number of ms to leave the LCD alone
+#define LCD_Q_WAIT	0x0300
+#if NUM_TEAMS == 2				// where the clocks are on the LCD, see LCD_START_SCREEN
+#define LCD_TIME_ROW 1			// game time MM:SS
+#define LCD_TIME_COL 7
+#define LCD_FLAG_ROW 2			// flag time M:SS
+#define LCD_FLAG_COL 8
+#else
+#define LCD_TIME_ROW 2
+#define LCD_TIME_COL 6
+#define LCD_FLAG_ROW 2
+#define LCD_FLAG_COL 13
+#endif
+
+// game FSM states
+#define ST_LCD		0	// LCD is being (re)initialized
+#define ST_SETUP	1	// game time is set with UP, ENTER starts the game
+#define ST_START	2	// start up signal, all LEDs flash
+#define ST_WAIT		3	// nobody owns the flag
+#define ST_TAKE		4	// attacker is taking the un-owned flag
+#define ST_OWNED	5	// owner has the flag and scores
+#define ST_OVER		6	// game over, show the winner
+#define ST_STEAL	7	// attacker is taking the flag from its owner
+#define N_STATES	8
+// game timers
+#define T_POLL		0	// checks on the LCD or the end of the game, every jiffy
+#define T_SECOND	1	// refreshes the clocks on the LCD, every second
+#define T_BLINK		2	// flashes the flag LEDs, every second
+#define T_STARTUP	3	// end of the start up signal
+#define T_CAPTURE	4	// attacker held its target for CAPTURE_SECS
+#define T_SCORE		5	// owner scores, every SCORE_SECS
+#define T_OWNWIN	6	// owner held the flag for OWNWIN_SECS
+#define T_GAMEOVER	7	// game time is up
+#define T_PROGRESS	8	// attacker's progress bar grows, every CAPTURE_STEP
+#define N_TIMERS	9	// at most 16, TIMER_armed/TIMER_due are words
+#define T_NONE		0xFF
+// game FSM events
+#define EV_UP		0	// UP button pressed
+#define EV_ENTER	1	// ENTER button pressed
+#define EV_HIT		2	// a team's target started being shot at
+#define EV_LETGO	3	// a team's target stopped being shot at
+#define EV_TIMER	4	// EV_TIMER + t: timer t expired
+#define EV_POLL		(EV_TIMER + T_POLL)
+#define EV_SECOND	(EV_TIMER + T_SECOND)
+#define EV_BLINK	(EV_TIMER + T_BLINK)
+#define EV_STARTUP	(EV_TIMER + T_STARTUP)
+#define EV_CAPTURE	(EV_TIMER + T_CAPTURE)
+#define EV_SCORE	(EV_TIMER + T_SCORE)
+#define EV_OWNWIN	(EV_TIMER + T_OWNWIN)
+#define EV_GAMEOVER	(EV_TIMER + T_GAMEOVER)
+#define EV_PROGRESS	(EV_TIMER + T_PROGRESS)
+#define N_EVENTS	(EV_TIMER + N_TIMERS)
+// teams, index TEAM[] and SCORE[]
+#define RED			0
+#define GRN			1
+#define BLU			2
+#define YEL			3
+#define NO_TEAM		0xFF
 
 void init_gpio(void);
-void LCD_init(char);
-void LCD_LUT(char);
+void init_timer(void);
+void init_uart(void);
+void init_vlo(void);
+void flag_off(unsigned int);
+unsigned char bcd(unsigned char);
+void score_clear(void);
+void log_init(void);
+char log_quiet(void);
+void log_flush(void);
+char handler_done(void);
+void fsm_run(unsigned char, unsigned char);
+void probe_record(unsigned char, unsigned int);
+void probe_dump(void);
+void rec_init(void);
+void rec_event(unsigned int, unsigned char, unsigned char);
+void rec_dump(void);
+void replay_init(void);
+void replay_sample(unsigned int);
+void replay_due(unsigned int);
+void replay_port(void);
+void replay_ack(void);
+void replay_feed(unsigned char);
+void debounce_start(unsigned char);
+void init_game(void);
+unsigned int time_now(void);
+unsigned int time_jiffy(void);
+void time_schedule(void);
+void timer_arm(unsigned char, unsigned int, unsigned int);
+void LCD_script(const unsigned char *);
+void LCD_screen(const char [2][17]);
+void LCD_putc(char, char, char);
+void LCD_put2(char, char, char);
+void LCD_puts(char, char, const char *);
+void LCD_fill(void);
+char LCD_update(void);
 void cmdtoLCD(char, char);
 void chartoLCD(char, char);
-void gotoLCDpos(char, char, char);
+unsigned char LCD_status(void);
+extern const unsigned char LCD_INIT_SCRIPT[];
+extern const char LCD_START_SCREEN[2][17];
 
 //for using LCD
-volatile unsigned char whichcase = 0;	// use in multi-cycle LCD setup/operations, counted by WDT interrupt handler
-volatile unsigned char letternibble = 1;	// use to vary between 1st and 2nd nibble
-volatile unsigned char letter = 0;	// int used to store 8-bit ASCII code for letter to be sent to LCD
-volatile unsigned char highnibble = 0x30;
-volatile unsigned char lownibble = 0;	// two global variables that the
-volatile unsigned char LCDlocation = 0; // hex number from 0x00 to 0x67 indicating which of 80 positions (where 00-0A and 40-4A are on the LCD)
-char begin_update;
-char singles_digit;
-char tens_digit;
+unsigned int LCD_queue[LCD_QSIZE];	// LCD work waiting for Timer A1, see LCD_Q_*
+unsigned char LCD_head;		// next LCD_queue entry to send
+unsigned char LCD_tail;		// next free LCD_queue entry
+unsigned char LCD_polls;	// busy flag reads done for the entry at LCD_head
+char LCD_shadow[2][16];		// what the game wants on the screen, written by LCD_putc
+unsigned int LCD_dirty[2];	// bit (col - 1) of a row is set while that cell differs from the LCD
+unsigned char LCD_cursor;	// DDRAM address command the LCD will write to after the queued work, 0 if unknown
 
 //FSM
-char last_state;
-char state;
-char begin_countdown;
-//main timer
+struct team {
+	unsigned char take;		// P1 bit of the team's target
+	unsigned int flag;		// P2/P3 bit of the team's flag LEDs
+	char take_col;			// LCD column (row 2) of the team's take time
+	char score_col;			// LCD column (row 1) of the team's score
+};
+const struct team TEAM[NUM_TEAMS] = {
+#if NUM_TEAMS == 2
+	{REDTAKE, REDFLAG, 15, 15},
+	{GRNTAKE, GRNFLAG, 3, 3}
+#else
+	{REDTAKE, REDFLAG, 1, 2},
+	{GRNTAKE, GRNFLAG, 2, 6},
+	{BLUTAKE, BLUFLAG, 3, 10},
+#if NUM_TEAMS == 4
+	{YELTAKE, YELFLAG, 4, 14}
+#endif
+#endif
+};
+// team of each P1 pin, only looked up for the pins in TAKES
+const unsigned char PIN_TEAM[8] = {RED, GRN, NO_TEAM, BLU, NO_TEAM, NO_TEAM, NO_TEAM, YEL};
+unsigned char state;
+unsigned char attacker;	// team taking the flag in ST_TAKE/ST_STEAL
+unsigned char owner;	// team owning the flag in ST_OWNED/ST_STEAL
+unsigned char CAPTURE_bar;	// bar level shown in the attacker's take cell
+//game time, set up with UP
 char MINUTES;
-char SECONDS;
-int wdt_ctr_timer;
-//for WDT counting
-int wdt_ctr;			// counts number of WDT cycles
-char second_ctr;			// counts number of seconds
+unsigned int GAME_clock;	// game time left as packed BCD MMSS, counted down by game_second
+//time keeping
+unsigned int ONE_SEC;		// number of ACLK ticks in 1 second, measured by init_vlo
+unsigned int JIFFIES;		// jiffies since start up, the time of the timer wheel
+unsigned int TIME_next;		// TA0R at the start of the next jiffy
+unsigned char JIFFY_frac;	// ONE_SEC % JIFFY_DIV remainders not yet added to a jiffy
+#ifdef TIME_TICKS
+unsigned long TIME_ticks;	// ACLK ticks from start up to TIME_next, TA0R is its low word
+#endif
+struct timer {
+	unsigned int expires;	// jiffy the timer runs at
+	unsigned int period;	// jiffies it is re-armed with, 0 for a one-shot
+	unsigned char next;		// next timer in the same slot, T_NONE ends the slot
+};
+struct timer TIMERS[N_TIMERS];
+unsigned char WHEEL[WHEEL_SLOTS];	// first timer of each slot
+unsigned int TIMER_armed;	// bit t is set while timer t is on the wheel
+unsigned int TIMER_due;		// expired timers whose event hasn't run yet
+//target debounce
+unsigned int DEB_period;	// ACLK ticks between debounce samples
+unsigned char DEB_count[NUM_TEAMS];	// integrator of each team's target, up while shot at, down while not
+unsigned char DEB_held;		// TAKE bits of the targets that are hit, after debouncing
+unsigned char DEB_sampling;	// TAKE bits of the targets being debounced, their edge interrupts are off
+//event log
+unsigned char LOG_buf[LOG_SIZE];	// records waiting for log_flush
+unsigned char LOG_len;		// bytes in LOG_buf
+unsigned int LOG_jiffies;	// JIFFIES of the last record, less its fraction of a second
+unsigned char LOG_seg;		// segment being written, 0-2
+unsigned char LOG_seq;		// its sequence byte
+unsigned char LOG_pos;		// offset of the next record in it
+//telemetry
+unsigned char TX_ring[TX_SIZE];	// bytes waiting for tx_handler
+unsigned char TX_head;		// next byte to send
+unsigned char TX_tail;		// next free byte
+unsigned char TLM_dirty;	// an FSM event ran since the last tlm_update
+unsigned char TLM_seq;		// sequence number of the next frame, skipped ones show up as gaps
+unsigned char TLM_last[TLM_LEN];	// the last frame built, a frame only goes out when it differs
+#ifdef PROBE
+//ISR probes
+unsigned int PROBE_start;	// TA1R when the running handler started
+unsigned int PROBE_hist[N_PROBES][PROBE_BUCKETS];	// durations (us) seen by each probe, saturating
+unsigned int PROBE_max[N_PROBES];	// longest duration seen by each probe
+unsigned int PROBE_jiffies;	// JIFFIES of the last probe_dump frame
+unsigned char PROBE_next;	// probe sent by the next probe_dump
+#ifdef PROBE_PIN
+#define PROBE_ENTER()	(P1OUT |= PROBE_PIN, PROBE_start = TA1R)
+#define PROBE_EXIT(p)	(probe_record(p, TA1R - PROBE_start), P1OUT &= ~PROBE_PIN)
+#else
+#define PROBE_ENTER()	(PROBE_start = TA1R)
+#define PROBE_EXIT(p)	probe_record(p, TA1R - PROBE_start)
+#endif
+#else
+#define PROBE_ENTER()
+#define PROBE_EXIT(p)
+#endif
+#ifdef RECORD
+//input recording, and replay with the same buffer
+unsigned char REC_buf[REC_SIZE];	// stream bytes waiting for rec_dump, or for the replay
+unsigned char REC_head;		// next byte to send (take)
+unsigned char REC_tail;		// next free byte
+unsigned char REC_seq;		// sequence number of the next frame
+unsigned char REC_flags;	// REC_START/REC_LOST of the next frame
+unsigned char REC_takes;	// levels of the TAKES pins as last recorded
+unsigned long REC_ticks;	// time of the last record
+unsigned long REC_sample;	// time of the last debounce sample
+unsigned char REC_quiet;	// that sample read nothing new, so it left no record
+unsigned int REC_jiffies;	// JIFFIES of the last frame
+unsigned char REPLAY_on;	// ENTER was held at power up: play the stream coming in instead
+unsigned long REPLAY_tick;	// time the next record is due
+unsigned char REPLAY_kind;	// its kind, REC_SAMPLE/REC_EDGE/REC_BUTTONS, or REPLAY_WAIT
+unsigned char REPLAY_takes;	// levels of the TAKES pins replayed so far, read instead of P1IN
+unsigned char REPLAY_ifg;	// target edges replayed, latched as P1IFG would latch them
+unsigned char REPLAY_taken;	// stream bytes taken from REC_buf, the acks count them
+unsigned char REPLAY_acked;	// REPLAY_taken as of the last ack
+#define TAKES_IN	(REPLAY_on ? REPLAY_takes : P1IN)
+#else
+#define REPLAY_on	0
+#define TAKES_IN	P1IN
+#endif
 //score keeping
-char RED_SCORE;
-char GRN_SCORE;
-char WINNER;
-//when flag is owned
-int wdt_ctr_flg;			// counts number of WDT cycles
-char second_ctr_flg;			// counts number of seconds
-char OWN_SECONDS;
-char OWN_MINUTES;
-//to check if target just hit or just let go
-char REDPRESS;
-char GRNPRESS;
+unsigned char SCORE[NUM_TEAMS];	// packed BCD, 00-99
 
 int main(void) {
-	  // setup the watchdog timer as an interval timer
-	WDTCTL =(WDTPW +	// (bits 15-8) password
-						// bit 7=0 => watchdog timer on
-						// bit 6=0 => NMI on rising edge (not used here)
-						// bit 5=0 => RST/NMI pin does a reset (not used here)
-				WDTTMSEL +   // (bit 4) select interval timer mode
-				WDTCNTCL); 	// (bit 3) clear watchdog timer counter
-							// bit 2=0 => SMCLK is the source
-				            // bits 1-0 = 10 => source/32K.
-
-
-	IE1 |= WDTIE;		// enable the WDT interrupt (in the system interrupt register IE1)
+	WDTCTL = WDTPW + WDTHOLD;	// stop the watchdog timer, Timer A0 on ACLK keeps the time
 
 	BCSCTL1 = CALBC1_8MHZ;
 	DCOCTL = CALDCO_8MHZ;	//8MHz calibration for clock
+	init_vlo();				//ACLK = VLO, measured against the DCO
+	init_game();
+
+	// the handlers run the game, they wake main up when the LCD or the UART
+	// starts or stops being busy and when there are log records to write
+	for(;;){
+		_disable_interrupts();
+		if((LOG_len != 0) && log_quiet()){
+			_enable_interrupts();
+			log_flush();
+		}
+		else if((TA1CCTL0 & CCIE) || (UC0IE & UCA0TXIE))
+			_bis_SR_register(GIE+LPM0_bits);	// Timer A1 and the UART need SMCLK while busy
+		else if(UCA0STAT & UCBUSY)
+			_enable_interrupts();				// last byte still shifting out, don't stop SMCLK under it
+		else
+			_bis_SR_register(GIE+LPM3_bits);	// LPM3 leaves only ACLK running
+	}
+}
 
-	begin_update = 0;
-
-	last_state = 0;
-	state = 'i';
-	begin_countdown = 0;
+// everything but the clocks, a host build of the firmware starts here
+void init_game(){
+	state = ST_LCD;
 
 	MINUTES = 2;
-	SECONDS = 0;
-	wdt_ctr_timer = 0;
-
-	wdt_ctr = 0;
-	second_ctr = 0;
 
-	RED_SCORE = 0;
-	GRN_SCORE = 0;
-
-	OWN_SECONDS = 0;
-	OWN_MINUTES = 0;
-
-	REDPRESS = 0;
-	GRNPRESS = 0;
+	score_clear();
 
 	init_gpio();
-
-	_bis_SR_register(GIE+LPM0_bits);
+	init_uart();
+#ifdef RECORD
+	REPLAY_on = !(P2IN & ENTER);	// its pull-up had init_uart's time to settle
+	if(REPLAY_on)
+		replay_init();			// waits for the stream's header, takes ONE_SEC and the pin levels from it
+#endif
+	init_timer();
+#ifdef RECORD
+	if(!REPLAY_on)
+		rec_init();
+#endif
+	log_init();
+	LCD_script(LCD_INIT_SCRIPT);
+	LCD_screen(LCD_START_SCREEN);
+	timer_arm(T_POLL, 1, 1);
+#ifdef RECORD
+	if(REPLAY_on)
+		replay_due(time_now());	// sets CCR2 for the first input
+#endif
+	time_schedule();
+	LCD_update();
 }
 
 void init_gpio(){
 	P1DIR |= (LCDRS + LCDRW + LCDE);
 	P2DIR |= (LCDDATA);
-	P2DIR |= (REDFLAG + GRNFLAG);
+	P2DIR |= (FLAGS & 0xFF);
+#if NUM_TEAMS > 2
+	P3DIR |= (FLAGS >> 8);
+#endif
 
-	P2OUT &= ~REDFLAG;
-	P2OUT &= ~GRNFLAG;
+	flag_off(FLAGS);
 	P2OUT &= ~LCDDATA;
 
 	// for GPIO interrupt
-	P1OUT |= (ENTER + UP + REDTAKE + GRNTAKE); // pullup
-	P1REN |= (ENTER + UP + REDTAKE + GRNTAKE); // enable resistor
-	P1IES |= (ENTER + UP + REDTAKE + GRNTAKE); // set for 1->0 transition
-	P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);// clear interrupt flag
-	P1IE  |= (ENTER + UP + REDTAKE + GRNTAKE); // enable interrupt
+	P1OUT |= TAKES;	// pullup
+	P1REN |= TAKES;	// enable resistor
+	P1IES |= TAKES;	// set for 1->0 transition
+	P1IFG &= ~TAKES;// clear interrupt flag
+	P1IE  |= TAKES;	// enable interrupt
+#if defined(PROBE) && defined(PROBE_PIN)
+	P1DIR |= PROBE_PIN;
+	P1OUT &= ~PROBE_PIN;
+#endif
+
+	P2SEL &= ~(ENTER + UP);		// XIN/XOUT are GPIO, ACLK comes from the VLO
+	P2OUT |= (ENTER + UP);		// pullup
+	P2REN |= (ENTER + UP);		// enable resistor
+	P2IES |= (ENTER + UP);		// set for 1->0 transition
+	P2IFG &= ~(ENTER + UP);		// clear interrupt flag
+	P2IE  |= (ENTER + UP);		// enable interrupt
+}
 
+// turn the flag LEDs in flags on (P2 bits in the low byte, P3 bits in the high byte)
+void flag_on(unsigned int flags){
+	P2OUT |= flags & 0xFF;
+#if NUM_TEAMS > 2
+	P3OUT |= flags >> 8;
+#endif
+}
+
+void flag_off(unsigned int flags){
+	P2OUT &= ~(flags & 0xFF);
+#if NUM_TEAMS > 2
+	P3OUT &= ~(flags >> 8);
+#endif
+}
+
+void flag_toggle(unsigned int flags){
+	P2OUT ^= flags & 0xFF;
+#if NUM_TEAMS > 2
+	P3OUT ^= flags >> 8;
+#endif
+}
+
+void init_timer(){
+	unsigned char i;
+
+	TA0CTL = TASSEL_1 + MC_2 + TACLR;	// clock source = ACLK, continuous mode
+										// timer_handler runs off CCR0, see time_schedule
+	TA0CCTL0 = 0;
+	JIFFIES = 0;
+	JIFFY_frac = 0;
+	TIME_next = time_jiffy();
+#ifdef TIME_TICKS
+	TIME_ticks = TIME_next;
+#endif
+	for(i = 0; i < WHEEL_SLOTS; i++)
+		WHEEL[i] = T_NONE;
+	DEB_period = ONE_SEC / DEB_RATE;	// TA0CCR1 paces debounce_handler
+	TA0CCTL1 = 0;
+
+	TA1CTL = TASSEL_2 + ID_3 + MC_2;	// clock source = SMCLK, divider = 8 (1us counts)
+										// continuous mode, LCD_handler runs off CCR0
+	TA1CCTL0 = 0;						// no interrupt until there is LCD work
+}
+
+// USCI_A0 as a transmit only UART: 115200 baud, 8N1 from SMCLK (8MHz)
+void init_uart(){
+	UCA0CTL1 |= UCSWRST;
+	UCA0CTL1 = UCSSEL_2 + UCSWRST;
+	UCA0BR0 = 69;						// 8MHz / 115200 = 69.44
+	UCA0BR1 = 0;
+	UCA0MCTL = UCBRS_4;					// 0.44 * 8 ~= 4
+	P1SEL |= TXD;
+	P1SEL2 |= TXD;
+	UCA0CTL1 &= ~UCSWRST;
+	TX_head = 0;
+	TX_tail = 0;
+	TLM_dirty = 1;						// send the start up state
+}
+
+// select the VLO (~12kHz, 4-20kHz over parts and temperature) for ACLK and
+// measure ONE_SEC with it: Timer A0 counts SMCLK and captures CCI0B (ACLK/8),
+// so two captures are 8 VLO periods of the 8MHz DCO apart
+void init_vlo(){
+	unsigned int start;
+
+	BCSCTL3 |= LFXT1S_2;				// ACLK = VLO, there is no crystal
+	BCSCTL1 |= DIVA_3;					// ACLK/8 while measuring
+	TA0CTL = TASSEL_2 + MC_2 + TACLR;
+	TA0CCTL0 = CM_1 + CCIS_1 + SCS + CAP;	// capture rising edges of ACLK
+	while(!(TA0CCTL0 & CCIFG));
+	TA0CCTL0 &= ~CCIFG;
+	start = TA0CCR0;
+	while(!(TA0CCTL0 & CCIFG));
+	ONE_SEC = 64000000UL / (unsigned int)(TA0CCR0 - start);	// 8 * 8MHz / SMCLK cycles
+	TA0CCTL0 = 0;
+	BCSCTL1 &= ~DIVA_3;
 }
 
 
@@ -167,1265 +573,1507 @@ void chartoLCD(char whichnibble, char nibble){
 	}
 
 	// send the nibble to the LCD and reset Enable
-	P1OUT |= (LCDRS + LCDE);	// because it's data
+	P1OUT |= LCDRS;		// because it's data, set up before Enable rises (tAS)
+	P1OUT |= LCDE;
 	P2OUT &= ~LCDDATA;
 	P2OUT |= nibble;
 	P1OUT &= ~LCDE;
 }
 
-// send whichnibble (1 or 2), and an address in row (1 or 2) and col (1-16) and moves the cursor there by calling cmdtoLCD, two iterations
-void gotoLCDpos(char whichnibble, char row, char col){
-	// turn into a DDRAM address (hex)
-	LCDlocation = 0x80;
-	if (row == 0x02){
-		LCDlocation += 0x40;
-	}
-	LCDlocation += (col - 0x01);
+// read the busy flag and address counter (RS/RW = 0/1), high nibble first
+// the LCD drives D7-D4 while Enable is high, so P2.3-P2.0 are inputs meanwhile
+unsigned char LCD_status(){
+	unsigned char status;
 
-	// execute the command
-	cmdtoLCD(whichnibble, LCDlocation);
+	P2DIR &= ~LCDDATA;
+	P1OUT &= ~LCDRS;
+	P1OUT |= LCDRW;
+	P1OUT |= LCDE;
+	_no_operation();			// data is valid 360ns after Enable goes high
+	status = (P2IN & LCDDATA) << 4;
+	P1OUT &= ~LCDE;
+	P1OUT |= LCDE;
+	_no_operation();
+	status |= P2IN & LCDDATA;
+	P1OUT &= ~LCDE;
+	P1OUT &= ~LCDRW;
+	P2DIR |= LCDDATA;
+
+	return status;
 }
 
-void LCD_LUT(char num2print){
-	switch(num2print){
-		case 0:{
-			lownibble = 0x00;
-			break;
-		}
-		case 1:{
-			lownibble = 0x01;
-			break;
-		}
-		case 2:{
-			lownibble = 0x02;
-			break;
-		}
-		case 3:{
-			lownibble = 0x03;
-			break;
-		}
-		case 4:{
-			lownibble = 0x04;
-			break;
-		}
-		case 5:{
-			lownibble = 0x05;
-			break;
-		}
-		case 6:{
-			lownibble = 0x06;
-			break;
-		}
-		case 7:{
-			lownibble = 0x07;
-			break;
-		}
-		case 8:{
-			lownibble = 0x08;
-			break;
-		}
-		case 9:{
-			lownibble = 0x09;
-			break;
+// LCD script opcodes, turned into LCD_queue entries by LCD_fill()
+// any byte that is not an opcode is sent whole (two nibbles):
+//		0x20-0x7F: an ASCII character written to DDRAM
+//		0x80-0xFF: a "set DDRAM address" command, see LCD_ADDR
+#define LCD_NIB		0x00	// 0x00-0x0F: a single command nibble (before 4 bit mode is on)
+#define LCD_CMD		0x10	// next byte is a command, sent as two nibbles
+#define LCD_WAIT	0x11	// next byte is the number of ms to leave the LCD alone
+#define LCD_GOTO	0x12	// next byte is a signed jump, relative to the byte after it
+#define LCD_END		0x13	// end of script
+#define LCD_DATA	0x14	// next byte is written to the LCD's RAM whole (CGRAM rows are < 0x20)
+#define LCD_ADDR(row, col)	(0x80 + ((row) - 1) * 0x40 + ((col) - 1))
+
+// progress bar glyph of a level: its bottom level + 1 pixel rows lit (5x8 font)
+#define BAR_ROW(level, row)	LCD_DATA, ((row) >= 7 - (level) ? 0x1F : 0x00)
+#define BAR_GLYPH(level)	BAR_ROW(level, 0), BAR_ROW(level, 1), BAR_ROW(level, 2), BAR_ROW(level, 3), \
+							BAR_ROW(level, 4), BAR_ROW(level, 5), BAR_ROW(level, 6), BAR_ROW(level, 7)
+
+// initialization of the LCD module, waits are the HD44780 datasheet minimums
+const unsigned char LCD_INIT_SCRIPT[] = {
+	//-----Wait for LCD Startup-----
+	LCD_WAIT, 40,
+
+	//-----Setup Data Transfer (00110000 3 times) and Put LCD in 4 Bit Mode-----
+	LCD_NIB + 0x03, LCD_WAIT, 5,
+	LCD_NIB + 0x03, LCD_WAIT, 1,
+	LCD_NIB + 0x03,
+	LCD_NIB + 0x02,
+
+	//-----Clear the Display, Hide the Cursor, Turn 2 Lines On-----
+	LCD_CMD, 0x01,
+	LCD_CMD, 0x0C,
+	LCD_CMD, 0x28,
+
+	//-----Turn off Scrolling-----
+	LCD_CMD, 0x10,
+
+	//-----Load the Progress Bar Glyphs into CGRAM 0-7-----
+	LCD_CMD, 0x40,
+	BAR_GLYPH(0), BAR_GLYPH(1), BAR_GLYPH(2), BAR_GLYPH(3),
+	BAR_GLYPH(4), BAR_GLYPH(5), BAR_GLYPH(6), BAR_GLYPH(7),
+	LCD_END
+};
+
+// drawn by LCD_fill once the init script has cleared the display
+#if NUM_TEAMS == 2
+const char LCD_START_SCREEN[2][17] = {
+	"G 00 T02:00 R 00",		// Green Score, GameTime, Red Score
+	"  \x08   F0:00   \x08 "	// Green TakeBar, FlagTime, Red TakeBar
+};
+#elif NUM_TEAMS == 3
+const char LCD_START_SCREEN[2][17] = {
+	"R00 G00 B00     ",		// Red, Green, Blue Score
+	"\x08\x08\x08  02:00 F0:00"	// Red, Green, Blue TakeBar, GameTime, FlagTime
+};
+#else
+const char LCD_START_SCREEN[2][17] = {
+	"R00 G00 B00 Y00 ",		// Red, Green, Blue, Yellow Score
+	"\x08\x08\x08\x08 02:00 F0:00"	// Red, Green, Blue, Yellow TakeBar, GameTime, FlagTime
+};
+#endif
+
+const unsigned char *LCD_pc;	// next script byte to queue
+
+// point the script engine at a script and put the LCD pins in their idle state
+// (Enable normal high, RS/RW to instruction (0/0))
+void LCD_script(const unsigned char *script){
+	LCD_pc = script;
+	LCD_cursor = 0;
+	LCD_head = LCD_tail;
+	LCD_polls = 0;
+
+	P1OUT &= ~(LCDRW + LCDRS);	// before Enable rises, a restart may find RS high
+	P1OUT |= LCDE;
+	P2OUT &= ~LCDDATA;
+}
+
+// load a whole screen into the shadow buffer, the LCD is assumed to have just been cleared
+void LCD_screen(const char screen[2][17]){
+	unsigned char row, col;
+
+	for(row = 0; row < 2; row++){
+		LCD_dirty[row] = 0;
+		for(col = 0; col < 16; col++){
+			LCD_shadow[row][col] = screen[row][col];
+			if(screen[row][col] != ' ')
+				LCD_dirty[row] |= (unsigned int)1 << col;
 		}
 	}
 }
 
-// initialization of the LCD module, called __ times by the WDT interrupt handler
-void LCD_init(char whichcase){
-	switch(whichcase){
-		//-----Wait for LCD Startup-----
-		case 0: {	// set Enable to normal high, RS/RW to instruction (0/0)
-			P1OUT |= LCDE;
-			P1OUT &= ~(LCDRW + LCDRS);
-			P2OUT &= ~LCDDATA;
-			break;
-		}
-		case 1: {
-			break;
-		}
-		case 2: {
-			break;
-		}
-		case 3: {	// wait 4 WDT cycles for LCD to catch up
-			break;
-		}
+// write character c at row (1 or 2), col (1-16), it is queued by LCD_fill only if it changed
+void LCD_putc(char row, char col, char c){
+	if(LCD_shadow[row - 1][col - 1] != c){
+		LCD_shadow[row - 1][col - 1] = c;
+		LCD_dirty[row - 1] |= (unsigned int)1 << (col - 1);
+	}
+}
 
-		//-----Setup Data Transfer and Put LCD in 4 Bit Mode-----
-		case 4: {
-		}
-		case 5: {
-		}
-		case 6: {	// Write 00110000 to LCD 3 times (hence the break-less cases above), to set up data transfer
-			cmdtoLCD(0x02, 0x03);
-			break;
-		}
-		case 7: {	// write 00100000 to enable 4 bit mode
-			cmdtoLCD(0x02, 0x02);
-			break;
-		}
+// write a two digit packed BCD number starting at row (1 or 2), col (1-15)
+// (the G2553 has no divider, numbers are kept in BCD so showing them takes no / 10 or % 10)
+void LCD_put2(char row, char col, char value){
+	LCD_putc(row, col, '0' + ((unsigned char)value >> 4));
+	LCD_putc(row, col + 1, '0' + (value & 0x0F));
+}
 
-		//-----Clear the Display and Reset the Cursor-----
-		case 8: {	// write 0000...
-			cmdtoLCD(0x02, 0x00);
-			break;
-		}
-		case 9: {	// ...then 0001 to clear the display
-			cmdtoLCD(0x02, 0x01);
-			break;
-		}
-		case 10: {	// write 0000...
-			cmdtoLCD(0x02, 0x00);
-			break;
-		}
-		case 11: {	// ...then 1100 to move cursor to right place, but turn off visible cursor and blink
-			cmdtoLCD(0x02, 0x0C);
-			break;
-		}
+// write a string starting at row (1 or 2), col (1-16), it must fit on the row
+void LCD_puts(char row, char col, const char *str){
+	while(*str != 0)
+		LCD_putc(row, col++, *str++);
+}
 
-		//-----Turn 2 Lines On-----
-		case 12: {	// write 0010...
-			cmdtoLCD(0x02, 0x02);
-			break;
-		}
-		case 13: {	// ...then 1000 to turn both lines on
-			cmdtoLCD(0x02, 0x08);
-			break;
-		}
+// number of free LCD_queue entries
+unsigned char LCD_room(){
+	return (LCD_head - LCD_tail - 1) & (LCD_QSIZE - 1);
+}
 
-		//-----Write "G 00 " for Green Score-----
-		case 14: {	// write 0100...
-			chartoLCD(0x02, 0x04);
-			break;
-		}
-		case 15: {	// ...then 0111 to write G
-			chartoLCD(0x02, 0x07);
-			break;
-		}
-		case 16: {	// write 0010...
-			chartoLCD(0x02, 0x02);
-			break;
-		}
-		case 17: {	// ...then 0000 to write _
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 18: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 19: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 20: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 21: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 22: {	// write 0010...
-			chartoLCD(0x02, 0x02);
-			break;
-		}
-		case 23: {	// ...then 0000 to write _
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 24: {	// write 0101...
-			chartoLCD(0x02, 0x05);
-			break;
-		}
+void LCD_push(unsigned int entry){
+	LCD_queue[LCD_tail] = entry;
+	LCD_tail = (LCD_tail + 1) & (LCD_QSIZE - 1);
+}
 
-		//-----Write "T00:00 " for GameTime-----
-		case 25: {	// ...then 0100 to write T
-			chartoLCD(0x02, 0x04);
-			break;
-		}
-		case 26: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 27: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 28: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 29: {	// ...then 0010 to write 2
-			chartoLCD(0x02, 0x02);
-			break;
-		}
-		case 30: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 31: {	// ...then 1010 to write :
-			chartoLCD(0x02, 0x0A);
-			break;
-		}
-		case 32: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 33: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 34: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 35: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 36: {	// write 0010...
-			chartoLCD(0x02, 0x02);
-			break;
-		}
-		case 37: {	// ...then 0000 to write _
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 38: {	// write 0101...
-			chartoLCD(0x02, 0x05);
-			break;
-		}
+// queue as much pending LCD work as fits: first the rest of the script, then
+// every cell that differs from the LCD. A cell right at the LCD's address
+// counter is written straight away (auto-increment), anything else needs a
+// "set DDRAM address" command first.
+void LCD_fill(){
+	unsigned char op, row, col;
+	unsigned int bit;
+
+	while((*LCD_pc != LCD_END) && (LCD_room() != 0)){
+		op = *LCD_pc++;
+		if(op >= 0x80)					// DDRAM address
+			LCD_push(LCD_Q_CMD + op);
+		else if(op >= 0x20)				// character
+			LCD_push(LCD_Q_DATA + op);
+		else if(op < LCD_CMD)			// single command nibble
+			LCD_push(LCD_Q_NIB + op);
+		else if(op == LCD_CMD)
+			LCD_push(LCD_Q_CMD + *LCD_pc++);
+		else if(op == LCD_WAIT)
+			LCD_push(LCD_Q_WAIT + *LCD_pc++);
+		else if(op == LCD_DATA)
+			LCD_push(LCD_Q_DATA + *LCD_pc++);
+		else							// LCD_GOTO
+			LCD_pc += (signed char)*LCD_pc + 1;
+	}
+	if(*LCD_pc != LCD_END)				// the screen waits until the LCD is set up
+		return;
 
-		//-----Write "R 00" for Red Score-----
-		case 39: {	// ...then 0010 to write R
-			chartoLCD(0x02, 0x02);
-			break;
-		}
-		case 40: {	// write 0010...
-			chartoLCD(0x02, 0x02);
-			break;
+	while(LCD_room() >= 2){
+		row = (LCD_cursor & 0x40) >> 6;
+		col = LCD_cursor & 0x3F;
+		if((LCD_cursor != 0) && (col < 16) && (LCD_dirty[row] & ((unsigned int)1 << col))){
+			LCD_push(LCD_Q_DATA + (unsigned char)LCD_shadow[row][col]);
+			LCD_dirty[row] &= ~((unsigned int)1 << col);
+			LCD_cursor++;
 		}
-		case 41: {	// ...then 0000 to write _
-			chartoLCD(0x02, 0x00);
-			break;
+		else if(LCD_dirty[0] != 0 || LCD_dirty[1] != 0){
+			row = (LCD_dirty[0] == 0);
+			for(col = 0, bit = 1; (LCD_dirty[row] & bit) == 0; col++, bit <<= 1);
+			LCD_cursor = LCD_ADDR(row + 1, col + 1);
+			LCD_push(LCD_Q_CMD + LCD_cursor);
 		}
-		case 42: {	// write 0011...
-			chartoLCD(0x02, 0x03);
+		else
 			break;
-		}
-		case 43: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 44: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 45: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
+	}
+}
 
-		//-----Go To Second Line, Write 0 for Green TakeTime-----
-		case 46: {	// go to 2nd row, 3rd column
-			gotoLCDpos(letternibble, 0x02, 0x03);
-			letternibble++;
-			break;
-		}
-		case 47: {
-			gotoLCDpos(letternibble, 0x02, 0x03);
-			letternibble--;
-			break;
-		}
-		case 48: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 49: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
+// queue whatever the game changed and start Timer A1 draining it if it is idle,
+// called at the end of every handler that writes to the LCD
+// returns 1 while Timer A1 runs, the handler must then leave SMCLK on (LPM0)
+char LCD_update(){
+	LCD_fill();
+	if((LCD_head != LCD_tail) && !(TA1CCTL0 & CCIE)){
+		TA1CCR0 = TA1R + LCD_T_POLL;
+		TA1CCTL0 = CCIE;
+	}
+	return (TA1CCTL0 & CCIE) != 0;
+}
 
-		//-----Write "F0:00" for FlagTime-----
-		case 50: {	// go to 2nd line, 7th column
-			gotoLCDpos(letternibble, 0x02, 0x07);
-			letternibble++;
-			break;
-		}
-		case 51: {
-			gotoLCDpos(letternibble, 0x02, 0x07);
-			letternibble--;
-			break;
-		}
-		case 52: {	// write 0100...
-			chartoLCD(0x02, 0x04);
-			break;
-		}
-		case 53: {	// ...then 0110 to write F
-			chartoLCD(0x02, 0x06);
-			break;
-		}
-		case 54: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 55: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 56: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 57: {	// ...then 1010 to write :
-			chartoLCD(0x02, 0x0A);
-			break;
-		}
-		case 58: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 59: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
-		case 60: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
-		}
-		case 61: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
-			break;
-		}
+//-----Time Keeping-----
+// Time is counted in jiffies (1/JIFFY_DIV of a second) on a hashed timer wheel:
+// a timer armed to expire at jiffy j is linked into slot j % WHEEL_SLOTS, so a
+// passing jiffy only looks at the timers of its own slot. There is no periodic
+// tick: Timer A0 counts ACLK through LPM3 and its CCR0 is only set for the
+// first jiffy ahead whose slot holds a timer. Every handler first lets the
+// wheel catch up with time_sync and ends by rescheduling with time_schedule.
+// An expiring timer runs FSM event EV_TIMER + its number.
+
+// TA0R counts ACLK, which is asynchronous to MCLK: read it until two reads agree
+unsigned int time_now(){
+	unsigned int now;
+
+	do
+		now = TA0R;
+	while(now != TA0R);
+	return now;
+}
 
-		//-----Write "0" for Red TakeTime-----
-		case 62: {	// go to 2nd line, 15th column
-			gotoLCDpos(letternibble, 0x02, 0x0F);
-			letternibble++;
-			break;
-		}
-		case 63: {
-			gotoLCDpos(letternibble, 0x02, 0x0F);
-			letternibble--;
-			break;
-		}
-		case 64: {	// write 0011...
-			chartoLCD(0x02, 0x03);
-			break;
+// ACLK ticks in the next jiffy, spreading the remainder of ONE_SEC / JIFFY_DIV
+// over the second so the jiffies add up to exactly ONE_SEC
+unsigned int time_jiffy(){
+	JIFFY_frac += ONE_SEC % JIFFY_DIV;
+	if(JIFFY_frac >= JIFFY_DIV){
+		JIFFY_frac -= JIFFY_DIV;
+		return ONE_SEC / JIFFY_DIV + 1;
+	}
+	return ONE_SEC / JIFFY_DIV;
+}
+
+void timer_link(unsigned char t, unsigned int expires){
+	unsigned char slot = expires & (WHEEL_SLOTS - 1);
+
+	TIMERS[t].expires = expires;
+	TIMERS[t].next = WHEEL[slot];
+	WHEEL[slot] = t;
+	TIMER_armed |= 1 << t;
+}
+
+// take timer t off the wheel, its event won't run any more
+void timer_stop(unsigned char t){
+	unsigned char *link;
+
+	TIMER_due &= ~(1 << t);
+	if(!(TIMER_armed & (1 << t)))
+		return;
+	TIMER_armed &= ~(1 << t);
+	link = &WHEEL[TIMERS[t].expires & (WHEEL_SLOTS - 1)];
+	while(*link != t)
+		link = &TIMERS[*link].next;
+	*link = TIMERS[t].next;
+}
+
+// (re)arm timer t to run jiffies from the current jiffy, then every period jiffies (0: once)
+void timer_arm(unsigned char t, unsigned int jiffies, unsigned int period){
+	timer_stop(t);
+	TIMERS[t].period = period;
+	timer_link(t, JIFFIES + jiffies);
+}
+
+// jiffies until timer t runs
+unsigned int timer_left(unsigned char t){
+	return TIMERS[t].expires - JIFFIES;
+}
+
+// run the timers of the jiffy that just started. They are all taken off the
+// wheel (periodic ones straight back on) before any event runs, so the events
+// can arm and stop timers freely.
+void timer_expire(){
+	unsigned char t;
+	unsigned char *link = &WHEEL[JIFFIES & (WHEEL_SLOTS - 1)];
+
+	while(*link != T_NONE){
+		t = *link;
+		if(TIMERS[t].expires != JIFFIES){	// due in a later turn of the wheel
+			link = &TIMERS[t].next;
+			continue;
+		}
+		*link = TIMERS[t].next;
+		TIMER_armed &= ~(1 << t);
+		TIMER_due |= 1 << t;
+		if(TIMERS[t].period != 0)
+			timer_link(t, JIFFIES + TIMERS[t].period);
+	}
+	for(t = 0; TIMER_due != 0; t++){
+		if(TIMER_due & (1 << t)){
+			TIMER_due &= ~(1 << t);
+			fsm_run(EV_TIMER + t, 0);
 		}
-		case 65: {	// ...then 0000 to write 0
-			chartoLCD(0x02, 0x00);
+	}
+}
+
+// run every jiffy boundary TA0R has passed
+void time_sync(){
+	unsigned int now = time_now();
+	unsigned int jiffy;
+
+	while((int)(now - TIME_next) >= 0){
+		jiffy = time_jiffy();
+		TIME_next += jiffy;
+#ifdef TIME_TICKS
+		TIME_ticks += jiffy;
+#endif
+		JIFFIES++;
+		timer_expire();
+	}
+}
+
+#ifdef TIME_TICKS
+// ACLK ticks from start up to TA0R = now. now has to be within half a TA0R wrap
+// of TIME_next, which holds in any handler: time_schedule wakes one up at least
+// every WHEEL_AHEAD jiffies to sync
+unsigned long time_ticks(unsigned int now){
+	return TIME_ticks + (int)(now - TIME_next);
+}
+#endif
+
+// set Timer A0 CCR0 for the first jiffy ahead whose slot holds a timer,
+// or WHEEL_AHEAD jiffies ahead when none does
+void time_schedule(){
+	unsigned char i;
+	unsigned int next, late;
+
+	for(i = 1; i < WHEEL_AHEAD; i++)
+		if(WHEEL[(JIFFIES + i) & (WHEEL_SLOTS - 1)] != T_NONE)
 			break;
+	next = TIME_next + (i - 1) * (ONE_SEC / JIFFY_DIV + 1);	// start of jiffy JIFFIES + i, or a bit later
+
+	late = time_now() + TIME_MIN;		// never set a compare TA0R has already passed
+	if((int)(next - late) < 0)
+		next = late;
+	TA0CCR0 = next;
+	TA0CCTL0 = CCIE;
+}
+
+//-----Event Log-----
+// Every game leaves its events in info flash segments D, C and B (A holds the
+// DCO calibration and is never touched), oldest segment overwritten first.
+// Each segment starts with a sequence byte (0-0xFE, +1 per segment written)
+// followed by records, the first 0xFF after it ends the segment.
+// A record is a header byte, type (bits 7-5) | team (bits 4-3) | delta (bits 2-0),
+// where delta is the whole seconds since the previous record. Delta 7 means
+// more bytes follow: each holds 0-253 more seconds and ends the delta, or 254
+// and another byte follows. LOG_START is followed by the game time in minutes.
+// No record byte but the header of an erased record is ever 0xFF.
+// Handlers only queue records in LOG_buf, main writes them to flash with
+// log_flush while nothing time critical is due (flash programming holds the CPU).
+// A flush either erases the next segment or programs all the queued records
+// that fit in the open one at once, at most LOG_SIZE bytes in ~2.4ms.
+
+// log the time of a record since the previous one, as whole seconds
+unsigned int log_delta(){
+	unsigned int seconds = (JIFFIES - LOG_jiffies) / JIFFY_DIV;
+
+	LOG_jiffies += SEC(seconds);	// keep the fraction for the next record
+	return seconds;
+}
+
+// queue a record, dropping it if LOG_buf is full
+void log_event(unsigned char type, unsigned char team, unsigned char data){
+	unsigned int delta;
+	unsigned char len = LOG_len;
+
+	if(REPLAY_on)
+		return;					// a replayed game is none of this station's
+	delta = log_delta();
+	if(delta < 7)
+		LOG_buf[len++] = type | team | delta;
+	else{
+		LOG_buf[len++] = type | team | 7;
+		delta -= 7;
+		while((delta >= 254) && (len < LOG_SIZE)){
+			LOG_buf[len++] = 254;
+			delta -= 254;
+		}
+		if(len < LOG_SIZE)
+			LOG_buf[len++] = delta;
+	}
+	if(type == LOG_START && len < LOG_SIZE)
+		LOG_buf[len++] = data;
+	if(len < LOG_SIZE)			// a record is only kept whole
+		LOG_len = len;
+}
+
+// number of bytes of the record starting at rec
+unsigned char log_length(const unsigned char *rec){
+	unsigned char len = 1;
+
+	if((rec[0] & LOG_DELTA) == 7){
+		while(rec[len] == 254)
+			len++;
+		len++;
+	}
+	if((rec[0] & LOG_TYPE) == LOG_START)
+		len++;
+	return len;
+}
+
+// erase segment and program its first byte, 0 if it didn't: a handler can
+// start something time critical between main's log_quiet and this
+char flash_erase(unsigned char *segment, unsigned char first){
+	_disable_interrupts();
+	if(!log_quiet()){
+		_enable_interrupts();
+		return 0;
+	}
+	FCTL3 = FWKEY;				// unlock (leaves LOCKA alone)
+	FCTL1 = FWKEY + ERASE;
+	*segment = 0;				// dummy write starts the erase, the CPU waits for it
+	FCTL1 = FWKEY + WRT;
+	*segment = first;
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+	_enable_interrupts();
+	return 1;
+}
+
+// program len bytes at dst, ~75us each, 0 if it didn't for the same reason as flash_erase
+char flash_write(unsigned char *dst, const unsigned char *src, unsigned char len){
+	_disable_interrupts();
+	if(!log_quiet()){
+		_enable_interrupts();
+		return 0;
+	}
+	FCTL3 = FWKEY;
+	FCTL1 = FWKEY + WRT;
+	while(len-- != 0)
+		*dst++ = *src++;
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+	_enable_interrupts();
+	return 1;
+}
+
+// find where the log ended before the last reset: after the last record of
+// the segment with the newest sequence byte
+void log_init(){
+	unsigned char i, newest = 0;
+	unsigned char *segment;
+
+	FCTL2 = FWKEY + FSSEL_1 + 19;	// flash timing generator = MCLK / 20 = 400kHz (257-476kHz)
+
+	LOG_seg = 0xFF;
+	for(i = 0; i < LOG_SEGS; i++){
+		segment = LOG_SEGMENT(i);
+		if(segment[0] == 0xFF)
+			continue;
+		if((LOG_seg == 0xFF) || ((unsigned char)(segment[0] - newest) < 0x80)){
+			LOG_seg = i;
+			newest = segment[0];
 		}
+	}
+	if(LOG_seg == 0xFF){			// blank log, the first flush opens segment 0
+		LOG_seg = LOG_SEGS - 1;
+		LOG_seq = 0xFE;
+		LOG_pos = LOG_SEG_SIZE;
+	}
+	else{
+		LOG_seq = newest;
+		segment = LOG_SEGMENT(LOG_seg);
+		for(LOG_pos = 1; (LOG_pos < LOG_SEG_SIZE) && (segment[LOG_pos] != 0xFF); )
+			LOG_pos += log_length(segment + LOG_pos);
+	}
+	LOG_len = 0;
+	LOG_jiffies = 0;
+}
+
+// 1 if flash can hold the CPU for a segment erase (~20ms) without anyone noticing
+char log_quiet(){
+	if(DEB_sampling != 0)
+		return 0;
+	return (unsigned int)(TA0CCR0 - time_now()) > ONE_SEC / 16;
+}
 
-		//-----Turn off Scrolling-----
-		case 66: {	// write 0001...
-			cmdtoLCD(0x02, 0x01);
+// write every queued record that fits in the open segment with one flash_write,
+// opening the next segment first when not even the oldest one fits
+void log_flush(){
+	unsigned char len, end, i;
+
+	if(LOG_pos + log_length(LOG_buf) > LOG_SEG_SIZE){	// handlers only append, the oldest record holds still
+		i = (LOG_seg + 1) % LOG_SEGS;
+		len = (LOG_seq == 0xFE) ? 0 : LOG_seq + 1;
+		if(!flash_erase(LOG_SEGMENT(i), len))
+			return;					// main tries again once it is quiet
+		LOG_seg = i;
+		LOG_seq = len;
+		LOG_pos = 1;
+		return;						// the write is a flush of its own, main checks log_quiet again
+	}
+
+	end = LOG_len;					// records queued from here on wait for the next flush
+	for(len = 0; len < end; len += i){
+		i = log_length(LOG_buf + len);
+		if(LOG_pos + len + i > LOG_SEG_SIZE)
 			break;
+	}
+	if(!flash_write(LOG_SEGMENT(LOG_seg) + LOG_pos, LOG_buf, len))
+		return;
+	LOG_pos += len;
+
+	_disable_interrupts();
+	for(i = len; i < LOG_len; i++)
+		LOG_buf[i - len] = LOG_buf[i];
+	LOG_len -= len;
+	_enable_interrupts();
+}
+
+//-----Telemetry-----
+// A frame of the game state goes out of the UART whenever an FSM event changed
+// what it holds, so a running game sends about one a second:
+//	0 TLM_SYNC, 1 sequence number, 2 state, 3 owner (bits 7-4) | attacker (bits 3-0),
+//	4-7 RED, GRN, BLU, YEL score (BCD), 8-9 game time left (BCD MM, SS), 10 flag time (seconds),
+//	11 capture time (seconds), 12 checksum: bytes 1-12 add up to 0
+// A team nibble is TLM_NOTEAM when there is no owner/attacker, missing teams score 0.
+// Handlers only put frames in TX_ring, tx_handler sends them byte by byte. A frame
+// that doesn't fit is dropped whole, the receiver sees the gap in the sequence.
+
+// fill in frame with the game as it is now, but for the sequence number and checksum
+void tlm_frame(unsigned char *frame){
+	unsigned int left;
+	unsigned char t;
+
+	frame[0] = TLM_SYNC;
+	frame[2] = state;
+	frame[3] = (state == ST_OWNED || state == ST_STEAL) ? owner << 4 : TLM_NOTEAM << 4;
+	frame[3] |= (TIMER_armed & (1 << T_CAPTURE)) ? attacker : TLM_NOTEAM;
+	for(t = 0; t < 4; t++)
+		frame[4 + t] = (t < NUM_TEAMS) ? SCORE[t] : 0;
+	if(TIMER_armed & (1 << T_GAMEOVER))
+		left = GAME_clock;
+	else if(state == ST_OVER)
+		left = 0;
+	else
+		left = bcd(MINUTES) << 8;		// not started yet
+	frame[8] = left >> 8;
+	frame[9] = left & 0xFF;
+	frame[10] = 0;
+	if(TIMER_armed & (1 << T_OWNWIN))
+		frame[10] = (SEC(OWNWIN_SECS) - timer_left(T_OWNWIN)) / JIFFY_DIV;
+	frame[11] = 0;
+	if(TIMER_armed & (1 << T_CAPTURE))
+		frame[11] = CAPTURE_SECS - timer_left(T_CAPTURE) / JIFFY_DIV;
+}
+
+// free bytes in TX_ring
+unsigned char tx_room(){
+	return (TX_head - TX_tail - 1) & (TX_SIZE - 1);
+}
+
+// fill in the checksum of a frame (bytes 1 to len - 1 add up to 0) and queue it
+// the caller has checked tx_room
+void tx_frame(unsigned char *frame, unsigned char len){
+	unsigned char i, sum = 0;
+
+	for(i = 1; i < len - 1; i++)
+		sum += frame[i];
+	frame[len - 1] = -sum;
+	for(i = 0; i < len; i++){
+		TX_ring[TX_tail] = frame[i];
+		TX_tail = (TX_tail + 1) & (TX_SIZE - 1);
+	}
+	UC0IE |= UCA0TXIE;			// UCA0TXIFG is set while TXBUF is empty
+}
+
+// queue a frame if the game changed since the last one
+// returns 1 while the UART is sending, the handler must then leave SMCLK on (LPM0)
+char tlm_update(){
+	unsigned char frame[TLM_LEN];
+	unsigned char i, changed = 0;
+
+	if(TLM_dirty){
+		TLM_dirty = 0;
+		tlm_frame(frame);
+		for(i = 2; i < TLM_LEN - 1; i++){
+			if(frame[i] != TLM_last[i]){
+				TLM_last[i] = frame[i];
+				changed = 1;
+			}
 		}
-		case 67: { // ...then 0000 to turn off scrolling between character writing
-			cmdtoLCD(0x02, 0x00);
-			break;
+		if(changed && (tx_room() >= TLM_LEN)){
+			frame[1] = TLM_seq;
+			tx_frame(frame, TLM_LEN);
 		}
+		if(changed)
+			TLM_seq++;
 	}
+	return (UC0IE & UCA0TXIE) != 0;
 }
 
-void interrupt gpio_handler(){
-	switch (state)
-	{
-		case 'i':
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// called at the end of every handler: push whatever the game changed to the LCD
+// and the UART. returns 1 if the handler has to wake main up, to pick LPM0 while
+// Timer A1 or the UART needs SMCLK or to write the log
+char handler_done(){
+	char busy = LCD_update();
+
+#ifdef PROBE
+	probe_dump();
+#endif
+#ifdef RECORD
+	if(REPLAY_on)
+		replay_ack();
+	else
+		rec_dump();
+#endif
+	if(tlm_update())
+		busy = 1;
+	return busy || (LOG_len != 0);
+}
 
-		case 0: //game initialization
-			//on UP button hit, increment TIME (MINUTE) (if 20, go to 2) - GPIO
-			if(P1IFG & UP){
-				P2OUT &= ~(REDFLAG + GRNFLAG);
-				if(begin_update == 0){
-					if((MINUTES == 15)||(MINUTES == 0))
-						MINUTES = 2;
-					else
-						MINUTES++;
-
-					singles_digit = MINUTES % 10;
-					tens_digit = MINUTES / 10;
-					begin_update = 1;
-				}
-			}
-			//on ENTER button hit, go to state 1 - GPIO
-			if(P1IFG & ENTER){
-				P2OUT &= ~(REDFLAG + GRNFLAG);
-				if(begin_update == 0){
-					state = 1;
-				}
-			}
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+#ifdef PROBE
+//-----ISR Probes-----
+// Built with -DPROBE every handler notes TA1R (1us, runs whenever the CPU does)
+// when it starts and adds its duration to its probe's histogram when it ends;
+// LCD_handler also adds how late it started after its compare to P_LCD_LATE.
+// With -DPROBE_PIN=<P1 bit> that pin is also high while a handler runs.
+// Bucket b counts durations of 4 << b - 1 us at most, the last one the rest.
+// The histograms take 108 bytes of RAM (of 512) and count from reset: once a
+// second probe_dump sends the next probe's as a frame on the telemetry UART:
+//	0 PROBE_SYNC, 1 probe, 2-17 bucket counts (little endian), 18-19 longest (us),
+//	20 checksum: bytes 1-20 add up to 0
+
+void probe_record(unsigned char p, unsigned int us){
+	unsigned char b = 0;
+	unsigned int rest = us >> 2;
+
+	while((rest != 0) && (b < PROBE_BUCKETS - 1)){
+		rest >>= 1;
+		b++;
+	}
+	if(PROBE_hist[p][b] != 0xFFFF)
+		PROBE_hist[p][b]++;
+	if(us > PROBE_max[p])
+		PROBE_max[p] = us;
+}
 
-		case 1: //signal start up
-			//no GPIO activity
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+void probe_dump(){
+	unsigned char frame[PROBE_LEN];
+	unsigned char i;
+
+	if(((unsigned int)(JIFFIES - PROBE_jiffies) < SEC(1)) || (tx_room() < PROBE_LEN))
+		return;
+	PROBE_jiffies = JIFFIES;
+	frame[0] = PROBE_SYNC;
+	frame[1] = PROBE_next;
+	for(i = 0; i < PROBE_BUCKETS; i++){
+		frame[2 + 2 * i] = PROBE_hist[PROBE_next][i] & 0xFF;
+		frame[3 + 2 * i] = PROBE_hist[PROBE_next][i] >> 8;
+	}
+	frame[PROBE_LEN - 3] = PROBE_max[PROBE_next] & 0xFF;
+	frame[PROBE_LEN - 2] = PROBE_max[PROBE_next] >> 8;
+	tx_frame(frame, PROBE_LEN);
+	if(++PROBE_next == N_PROBES)
+		PROBE_next = 0;
+}
+#endif
+
+//-----Input Record/Replay-----
+// Built with -DRECORD the station records every input the game sees: a target
+// edge, a debounce sample that reads a new level and a button press, each
+// with the ACLK tick it was seen at. As the game only ever reads its inputs at
+// those ticks, and everything else runs off Timer A0, the same inputs at the
+// same ticks, in the same order, play the same game. The stream after a reset is
+//	header: ONE_SEC (little endian), NUM_TEAMS, levels of the TAKES pins
+//	records: (ticks since the last record << 2 | kind) 7 bits a byte, low bits
+//		first, bit 7 set in all but the last byte, then the data byte:
+//		REC_SAMPLE/REC_EDGE: the new levels of the TAKES pins,
+//		REC_BUTTONS: P2IFG bits
+// rec_dump sends it in frames on the telemetry UART:
+//	0 REC_SYNC, 1 sequence number, 2 REC_START | REC_LOST | stream bytes (0-12),
+//	3-14 stream bytes, 15 checksum: bytes 1-15 add up to 0
+// tools/ssreplay plays a captured stream on the host, or sends it back to a
+// station powered up with ENTER held, which then replays it instead of
+// recording: P1.1 (GRN's target, unplug them all) becomes UCA0RXD and the
+// stream comes in there, REC_SYNC and the header first, into REC_buf. Its
+// acks go out as frames with REC_ACK and no stream bytes, data byte 0 the
+// stream bytes taken so far (mod 256), REC_START on the first, REC_LOST once
+// a byte was lost or came too late to play. The sender keeps no more than
+// REC_SIZE - 1 bytes unacked. The replay reads REPLAY_takes instead of the
+// target pins: debounce_sample takes the REC_SAMPLE records, Timer A0 CCR2
+// plays the others at their tick, the edges latched in REPLAY_ifg for
+// replay_port to start debouncing as target_handler would, the buttons straight
+// into the FSM (PxSEL turns P1.1's interrupt off, P1IFG can't stand in for it).
+// Only CCR2 losing to CCR1 (TA0IV priority) can put an input the station saw
+// just before a sample in the same tick after it; the host replay keeps the order.
+
+#ifdef RECORD
+// free bytes in REC_buf
+unsigned char rec_room(){
+	return (REC_head - REC_tail - 1) & (REC_SIZE - 1);
+}
 
-		case 2: //initial waiting state
-			if(P1IFG & REDTAKE){
-				//unnecessary LED indicator
-				P2OUT |= REDFLAG;
-				P2OUT &= ~GRNFLAG;
+void rec_put(unsigned char c){
+	REC_buf[REC_tail] = c;
+	REC_tail = (REC_tail + 1) & (REC_SIZE - 1);
+}
 
-				last_state = 2;
-				state = 3;
+// start the stream over with its header
+void rec_init(){
+	REC_head = 0;
+	REC_tail = 0;
+	REC_flags = REC_START;
+	REC_ticks = 0;
+	REC_takes = P1IN & TAKES;
+	rec_put(ONE_SEC & 0xFF);
+	rec_put(ONE_SEC >> 8);
+	rec_put(NUM_TEAMS);
+	rec_put(REC_takes);
+}
 
-				P1IES &= ~REDTAKE;	//switch to 0->1 transition
-				P1IFG &= ~REDTAKE;
-			}
-			if(P1IFG & GRNTAKE){
-				//unnecessary LED indicator
-				P2OUT |= GRNFLAG;
-				P2OUT &= ~REDFLAG;
+// record an input seen at TA0R = now, dropping it if REC_buf is full
+void rec_event(unsigned int now, unsigned char kind, unsigned char data){
+	unsigned long ticks;
+	unsigned long code;
+
+	if(REPLAY_on)
+		return;
+	ticks = time_ticks(now);
+	if((kind != REC_SAMPLE) && REC_quiet && (ticks == REC_sample)){
+		REC_quiet = 0;			// a sample in the same tick came first, record it to keep the order
+		rec_event(now, REC_SAMPLE, REC_takes);
+	}
+	code = ((ticks - REC_ticks) << 2) | kind;
+	if(rec_room() < REC_MAX){
+		REC_flags |= REC_LOST;
+		return;
+	}
+	REC_ticks = ticks;
+	while(code >= 0x80){
+		rec_put(code | 0x80);
+		code >>= 7;
+	}
+	rec_put(code);
+	rec_put(data);
+}
 
-				last_state = 2;
-				state = 4;
+// send REC_buf once it fills a frame, or whatever it holds a second after the last frame
+void rec_dump(){
+	unsigned char frame[REC_LEN];
+	unsigned char i, len = (REC_tail - REC_head) & (REC_SIZE - 1);
+
+	if((len == 0) || (tx_room() < REC_LEN))
+		return;
+	if((len < REC_DATA) && !(REC_flags & REC_START) && ((unsigned int)(JIFFIES - REC_jiffies) < SEC(1)))
+		return;
+	if(len > REC_DATA)
+		len = REC_DATA;
+	REC_jiffies = JIFFIES;
+	frame[0] = REC_SYNC;
+	frame[1] = REC_seq++;
+	frame[2] = REC_flags | len;
+	REC_flags = 0;
+	for(i = 0; i < REC_DATA; i++){
+		frame[3 + i] = 0;
+		if(i < len){
+			frame[3 + i] = REC_buf[REC_head];
+			REC_head = (REC_head + 1) & (REC_SIZE - 1);
+		}
+	}
+	tx_frame(frame, REC_LEN);
+}
 
-				P1IES &= ~GRNTAKE;	//switch to 0->1 transition
-				P1IFG &= ~GRNTAKE;
-			}
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// take the next stream byte of a replay
+unsigned char rec_get(){
+	unsigned char c = REC_buf[REC_head];
 
-		case 3: //RED tries to take
-			if(P1IES & ~REDTAKE)
-				REDPRESS = 0;
-			else if(P1IES & REDTAKE)
-				REDPRESS = 1;
-
-			if(P1IFG & REDTAKE){
-				if(REDPRESS == 0){
-					if(second_ctr < 5){ //RED let go; RED failed to take the flag
-						second_ctr = 0;			//reset time counters
-						wdt_ctr = 0;
-						OWN_SECONDS = 0;
-						OWN_MINUTES = 0;
-						P2OUT &= ~REDFLAG;
-						begin_update = 3;
-
-//						P2OUT &= ~LCDB3;	//random...;
-
-						state = last_state;
-					}
-				}
-			}
-			else{
-				state = 3;
-			}
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);	//switch back to 1->0 transition
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+	REC_head = (REC_head + 1) & (REC_SIZE - 1);
+	REPLAY_taken++;
+	return c;
+}
 
-		case 4: //GRN tries to take
-			if(P1IES & ~GRNTAKE)
-				GRNPRESS = 0;
-			else if(P1IES & GRNTAKE)
-				GRNPRESS = 1;
-
-			if(P1IFG & GRNTAKE){
-				if(GRNPRESS == 0){
-					if(second_ctr < 5){ //GRN let go; GRN failed to take the flag
-						second_ctr = 0;			//reset time counters
-						wdt_ctr = 0;
-						OWN_SECONDS = 0;
-						OWN_MINUTES = 0;
-						P2OUT &= ~GRNFLAG;
-						begin_update = 4;
-
-//						P2OUT &= ~LCDB3;	//random...
-
-						state = last_state;
-					}
-				}
-			}
-			else{
-				state = 4;
-			}
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);	//switch back to 1->0 transition
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// 1 if the record at REPLAY_tick is already past TA0R = now
+char replay_past(unsigned int now){
+	return (long)(time_ticks(now) - REPLAY_tick) >= 0;
+}
 
-		case 5: //RED owns flag
-			//if we're still in this state, RED hasn't won yet
-			// (hasn't been 2 minutes yet)
-			if(P1IFG & GRNTAKE){	//GRN hits the flag target GRNTAKE
-				begin_update = 6;
-				state = 9;			//move to "GRN tries to take" state (4)
-			}
-			else{
-				last_state = 5;
-				state = 5;
-			}
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// decode the time and kind of the next record once REC_buf holds all of it,
+// leaving its data byte there
+void replay_next(){
+	unsigned long code = 0;
+	unsigned char i, c, shift = 0;
+
+	REPLAY_kind = REPLAY_WAIT;
+	for(i = REC_head; (i != REC_tail) && (REC_buf[i] & 0x80); i = (i + 1) & (REC_SIZE - 1));
+	if((i == REC_tail) || (((i + 1) & (REC_SIZE - 1)) == REC_tail))
+		return;					// the rest of it, or its data byte, is still on the way
+	do{
+		c = rec_get();
+		code |= (unsigned long)(c & 0x7F) << shift;
+		shift += 7;
+	}while(c & 0x80);
+	REPLAY_kind = code & REC_KIND;
+	REPLAY_tick += code >> 2;
+}
 
-		case 6: //GRN owns flag
-			if(P1IFG & REDTAKE){	//RED hits the flag target REDTAKE
-				begin_update = 6;
-				state = 8;			//move to "RED tries to take" state (3)
-			}
-			else{
-				last_state = 6;
-				state = 6;
-			}
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// wait for REC_SYNC and the header of the stream, with interrupts still off,
+// and take ONE_SEC and the starting pin levels from it, before init_timer
+void replay_init(){
+	P1SEL |= RXD;
+	P1SEL2 |= RXD;
+	P2IE &= ~(ENTER + UP);		// the buttons come from the stream
+	do{
+		do{
+			while(!(UC0IFG & UCA0RXIFG));
+		}while(UCA0RXBUF != REC_SYNC);
+		for(REC_tail = 0; REC_tail < 4; )
+			if(UC0IFG & UCA0RXIFG)
+				REC_buf[REC_tail++] = UCA0RXBUF;
+	}while((REC_buf[2] != NUM_TEAMS) || (REC_buf[3] & ~TAKES));	// synced on a byte of an earlier header
+	REC_head = 4;
+	ONE_SEC = REC_buf[0] | (REC_buf[1] << 8);
+	REPLAY_takes = REC_buf[3];
+	REPLAY_ifg = 0;
+	REPLAY_tick = 0;
+	REPLAY_kind = REPLAY_WAIT;
+	REPLAY_taken = 4;
+	REPLAY_acked = 4;
+	REC_flags = REC_START;
+	UC0IE |= UCA0RXIE;
+}
 
-		case 7: //Game Over
-			if(P1IFG & UP){	//restart game when ENTER pressed
-				state = 0;
-				last_state = 0;
+// a stream byte came in, play the next record if it was waiting for it
+void replay_feed(unsigned char c){
+	if(((REC_head - REC_tail - 1) & (REC_SIZE - 1)) == 0){
+		REC_flags |= REC_LOST;	// the sender didn't wait for the ack
+		return;
+	}
+	rec_put(c);
+	if(REPLAY_kind != REPLAY_WAIT)
+		return;
+	replay_next();
+	if((REPLAY_kind != REPLAY_WAIT) && ((long)(time_ticks(time_now()) - REPLAY_tick) > 0))
+		REC_flags |= REC_LOST;	// due before it came
+	replay_due(time_now());
+}
 
-				RED_SCORE = 0;
-				GRN_SCORE = 0;
-			}
-			//reset interrupt flags for the next game
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// the levels the debounce sample at TA0R = at read when it was recorded
+void replay_sample(unsigned int at){
+	if(REPLAY_kind == REPLAY_WAIT)
+		replay_next();
+	while((REPLAY_kind == REC_SAMPLE) && replay_past(at)){
+		REPLAY_takes = rec_get();
+		replay_next();
+	}
+}
 
-		case 8: //RED tries to take when GRN owns FLAG
-			if(P1IES & ~REDTAKE)
-				REDPRESS = 0;
-			else if(P1IES & REDTAKE)
-				REDPRESS = 1;
-
-			if(REDPRESS == 0){
-				if(second_ctr < 5){ //RED let go; RED failed to take the flag
-					second_ctr = 0;			//reset time counters
-					wdt_ctr = 0;
-//					OWN_SECONDS = 0;
-//					OWN_MINUTES = 0;
-					P2OUT &= ~REDFLAG;
-					begin_update = 3;
-
-					state = 6;
-				}
-			}
-			else{
-				state = 8;
-			}
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);	//switch back to 1->0 transition
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// play the edges and buttons due by TA0R = now, up to the next sample's
+// record, then set CCR2 for the next one. An edge on the level P1IES waits for
+// is latched like P1IFG would latch it, a press runs its event.
+void replay_due(unsigned int now){
+	unsigned char data;
+
+	if(REPLAY_kind == REPLAY_WAIT)
+		replay_next();
+	while(((REPLAY_kind == REC_EDGE) || (REPLAY_kind == REC_BUTTONS)) && replay_past(now)){
+		data = rec_get();
+		if(REPLAY_kind == REC_EDGE){
+			REPLAY_ifg |= (REPLAY_takes ^ data) & (P1IES ^ data) & TAKES;	// P1IES 1: 1->0, 0: 0->1
+			REPLAY_takes = data;
+			replay_port();
+		}
+		else{
+			if(data & UP)
+				fsm_run(EV_UP, 0);
+			if(data & ENTER)
+				fsm_run(EV_ENTER, 0);
+		}
+		replay_next();
+	}
+	if((REPLAY_kind == REC_EDGE) || (REPLAY_kind == REC_BUTTONS)){
+		TA0CCR2 = REPLAY_tick;		// a record more than a TA0R wrap ahead comes back here early
+		TA0CCTL2 = CCIE;
+		if(replay_past(time_now()))
+			TA0CCTL2 |= CCIFG;		// it came in late, or TA0R got there before CCR2 was set
+	}
+	else
+		TA0CCTL2 = 0;				// waiting for debounce_sample, or for the stream
+}
 
-		case 9: //GRN tries to take when RED owns FLAG
-			if(P1IES & ~GRNTAKE)
-				GRNPRESS = 0;
-			else if(P1IES & GRNTAKE)
-				GRNPRESS = 1;
-
-			if(P1IFG & GRNTAKE){
-				if(GRNPRESS == 0){
-					if(second_ctr < 5){ //GRN let go; GRN failed to take the flag
-						second_ctr = 0;			//reset time counters
-						wdt_ctr = 0;
-//						OWN_SECONDS = 0;
-//						OWN_MINUTES = 0;
-						P2OUT &= ~GRNFLAG;
-						begin_update = 4;
-
-						state = 5;
-					}
-				}
-			}
-			else{
-				state = 9;
-			}
-			P1IES |= (ENTER + UP + REDTAKE + GRNTAKE);	//switch back to 1->0 transition
-			P1IFG &= ~(ENTER + UP + REDTAKE + GRNTAKE);
-			break;
+// what target_handler does once an enabled pin's flag is up: start debouncing
+// every pin flagged, the disabled ones too
+void replay_port(){
+	unsigned char ifg = REPLAY_ifg;
+
+	if(!(ifg & P1IE))
+		return;
+	REPLAY_ifg = 0;
+	debounce_start(ifg);
+}
+
+// ack the stream bytes taken once there are REPLAY_ACK of them, or a second after the last ack
+void replay_ack(){
+	unsigned char frame[REC_LEN];
+	unsigned char i;
+
+	if(tx_room() < REC_LEN)
+		return;
+	if(!(REC_flags & REC_START) && ((unsigned char)(REPLAY_taken - REPLAY_acked) < REPLAY_ACK)
+	&& ((unsigned int)(JIFFIES - REC_jiffies) < SEC(1)))
+		return;
+	REC_jiffies = JIFFIES;
+	REPLAY_acked = REPLAY_taken;
+	frame[0] = REC_SYNC;
+	frame[1] = REC_seq++;
+	frame[2] = REC_ACK | REC_flags;
+	REC_flags &= REC_LOST;			// a lost byte spoils the rest of the replay, keep saying so
+	frame[3] = REPLAY_taken;
+	for(i = 4; i < REC_LEN - 1; i++)
+		frame[i] = 0;
+	tx_frame(frame, REC_LEN);
+}
+#endif
+
+//-----Game FSM-----
+// Both handlers turn what happened into an event and run FSM[state][event](team).
+// Only one team can be taking the flag (attacker) or own it (owner) at a time,
+// so all teams share every state and the actions look team data up in TEAM[].
+// The clocks on the LCD are worked out from the timers when they are shown.
+
+// binary 0-99 to packed BCD, doubling the result in decimal (DADD) for each bit from the top
+unsigned char bcd(unsigned char bin){
+	unsigned int result = 0;
+	unsigned char bit;
+
+	for(bit = 0x40; bit != 0; bit >>= 1){
+		result = __bcd_add_short(result, result);
+		if(bin & bit)
+			result = __bcd_add_short(result, 1);
 	}
+	return result;
 }
-ISR_VECTOR(gpio_handler,".int02") // declare interrupt vector
 
-// ===== Watchdog Timer Interrupt Handler =====
-// This event handler is called to handle the watchdog timer interrupt,
-//    which is occurring regularly at intervals of 32K/1MHz ~= 32ms.
+// packed BCD MMSS as MM:SS at col (MM) and col + 3 (SS) of row
+void show_time(char row, char col, unsigned int clock){
+	LCD_put2(row, col, clock >> 8);
+	LCD_put2(row, col + 3, clock & 0xFF);
+}
 
-void interrupt WDT_interval_handler(){
+// start the capture timers for team t
+void capture_begin(unsigned char t){
+	attacker = t;
+	CAPTURE_bar = 0;
+	log_event(LOG_TAKE, LOG_TEAMOF(t), 0);
+	timer_arm(T_BLINK, SEC(1), SEC(1));
+	timer_arm(T_PROGRESS, CAPTURE_STEP, CAPTURE_STEP);
+	timer_arm(T_CAPTURE, SEC(CAPTURE_SECS), 0);
+}
 
-	switch (state)
-	{
-		case 'i': //start LCD
-			LCD_init(whichcase);
-			if(whichcase < INIT_CNT){
-				whichcase++;
-			}
-			else if(whichcase == INIT_CNT)
-			{
-				whichcase = 0;
-				state = 0;
-			}
-			break;
+// take the capture timers off and empty the attacker's progress bar
+void capture_end(){
+	timer_stop(T_BLINK);
+	timer_stop(T_PROGRESS);
+	timer_stop(T_CAPTURE);
+	LCD_putc(2, TEAM[attacker].take_col, BAR(0));
+}
 
-		case 0: //game initialization
-			//update LCD when MINUTES changes
-			if(begin_update == 1)
-			{
-				if(whichcase == 0){
-					LCD_LUT(tens_digit);
-					gotoLCDpos(1, 1, 7);
-				}
-				else if(whichcase == 1){
-					gotoLCDpos(2, 1, 7);
-				}
-				else if(whichcase == 2){
-					chartoLCD(1, highnibble);
-				}
-				else if(whichcase == 3){
-					chartoLCD(2, lownibble);
-				}
-
-				else if(whichcase == 4){
-					LCD_LUT(singles_digit);
-					gotoLCDpos(1, 1, 8);
-				}
-				else if(whichcase == 5){
-					gotoLCDpos(2, 1, 8);
-				}
-				else if(whichcase == 6){
-					chartoLCD(1, highnibble);
-				}
-				else if(whichcase == 7){
-					chartoLCD(2, lownibble);
-					begin_update = 0;
-				}
-
-				if(whichcase < 7){
-					whichcase++;
-				}
-				else{
-					whichcase = 0;
-				}
-			}
-			break;
+//blink attacker's FLAG LEDs every second - it is about to take FLAG
+void capture_blink(unsigned char t){
+	flag_toggle(TEAM[attacker].flag);
+}
 
-		case 1: //signal start up
-			//flash (toggle) all LEDs every second - WDT
-			if(wdt_ctr < ONE_SEC)		//until a second is reached,
-				wdt_ctr++;						//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT ^= (REDFLAG + GRNFLAG);	//toggle FLAG LEDs
-				wdt_ctr = 0;					//reset to start count for the new cycle
-				second_ctr++;					//increase number of seconds that passed
-			}
-			//when 20 seconds (20 seconds / time of 1 cycle = N WDT cycles), go to state 2 - WDT
-			if(second_ctr == 6){
-				second_ctr = 0;					//reset time counters (just in case)
-				wdt_ctr = 0;
-				P2OUT &= ~(REDFLAG + GRNFLAG);	//FLAG is un-owned so has no color
-				state = 2;						//move onto next state
-				begin_countdown = 1;			//start the game timer
-			}
-			break;
+//grow the attacker's progress bar a pixel row, only its one cell is sent to the LCD
+void capture_progress(unsigned char t){
+	if(CAPTURE_bar < BAR_LEVELS - 1)
+		CAPTURE_bar++;
+	LCD_putc(2, TEAM[attacker].take_col, BAR(CAPTURE_bar));
+}
 
-/*		case 2: //initial waiting state
-			//nothing special happening here. just waiting for GPIO activity
-			break;
-*/
-		case 3: //RED tries to take
-			if(wdt_ctr < ONE_SEC)		//until a second is reached,
-				wdt_ctr++;					//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT ^= REDFLAG;			//blink REDFLAG LEDs - RED is about to take FLAG
-				wdt_ctr = 0;				//reset to start count for the new cycle
-				second_ctr++;				//increase number of seconds that passed
-				begin_update = 3;
-			}
-			//when 5 seconds (5 seconds / time of 1 cycle = M WDT cycles), go to state 5 - WDT
-			if(second_ctr > 5){
-				second_ctr = 0;			//reset time counters (just in case)
-				second_ctr_flg = 0;
-				wdt_ctr = 0;
-				wdt_ctr_flg = 0;
-				P2OUT |= REDFLAG;		//FLAG is now owned by RED
-				P2OUT &= ~GRNFLAG;
-				begin_update = 3;
-
-				state = 5;				//move onto state 5
-			}
-			break;
+//attacker held its target for CAPTURE_SECS, attacker owns the FLAG
+void capture_done(unsigned char t){
+	capture_end();
+	flag_off(FLAGS);
+	flag_on(TEAM[attacker].flag);	//FLAG is now owned by attacker
+	LCD_putc(LCD_FLAG_ROW, LCD_FLAG_COL, '0');
+	LCD_put2(LCD_FLAG_ROW, LCD_FLAG_COL + 2, 0);
+
+	owner = attacker;
+	log_event(LOG_OWNED, LOG_TEAMOF(owner), 0);
+	timer_arm(T_SCORE, SEC(SCORE_SECS), SEC(SCORE_SECS));
+	timer_arm(T_OWNWIN, SEC(OWNWIN_SECS), 0);
+	state = ST_OWNED;
+}
 
-		case 4: //GRN tries to take
-			if(wdt_ctr < ONE_SEC)		//until a second is reached,
-				wdt_ctr++;					//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT ^= GRNFLAG;			//blink GRNFLAG LEDs - GRN is about to take FLAG
-				wdt_ctr = 0;					//reset to start count for the new cycle
-				second_ctr++;					//increase number of seconds that passed
-				begin_update = 4;
-			}
-			//when 5 seconds (5 seconds / time of 1 cycle = M WDT cycles), go to state 5 - WDT
-			if(second_ctr > 5){
-				second_ctr = 0;			//reset time counters (just in case)
-				second_ctr_flg = 0;
-				wdt_ctr = 0;
-				wdt_ctr_flg = 0;
-				P2OUT |= GRNFLAG;		//FLAG is now owned by GRN
-				P2OUT &= ~REDFLAG;		//make sure REDFLAG is off
-				begin_update = 4;
-
-				state = 6;				//move onto state 6
-			}
-			break;
+// team t let go of its target, returns 1 if that was the attacker
+char capture_abort(unsigned char t){
+	if(t != attacker)
+		return 0;
+	log_event(LOG_ABORT, LOG_TEAMOF(attacker), 0);
+	capture_end();
+	flag_off(TEAM[attacker].flag);
+	return 1;
+}
 
-		case 5: //RED owns flag
-			if(wdt_ctr_flg < ONE_SEC)		//until a second is reached,
-				wdt_ctr_flg++;						//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT |= REDFLAG;			//make sure RED owns the FLAG
-				P2OUT &= ~GRNFLAG;			// and GRN doesn't
-
-				wdt_ctr_flg = 0;				//reset to start count for the new cycle
-				second_ctr_flg++;				//increase number of seconds that passed
-				OWN_SECONDS++;				//increment OWN_TIME (SECOND)
-				begin_update = 5;
-			}
-			//increment RED_SCORE by 1 every 10 seconds
-			if(second_ctr_flg == 10){
-				RED_SCORE++;
-				second_ctr = 0;			//reset time counters
-				second_ctr_flg = 0;
-				wdt_ctr = 0;			// (just in case)
-				wdt_ctr_flg = 0;
-				begin_update = 7;
-			}
-			//increment OWN_TIME (SECOND) every second (if 59 -> 00, increment MINUTE) - WDT
-			if(OWN_SECONDS == 60)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES++;
-				begin_update = 6;
-			}
-			if(OWN_MINUTES == 2)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES = 0;
-				WINNER = 'R';
-				begin_countdown = 0;
-				state = 7;
-			}
-			break;
+// zero every team's score
+void score_clear(){
+	unsigned char t;
 
-		case 6: //GRN owns flag
-			if(wdt_ctr_flg < ONE_SEC)		//until a second is reached,
-				wdt_ctr_flg++;						//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT |= GRNFLAG;			//make sure GRN owns the FLAG
-				P2OUT &= ~REDFLAG;			// and RED doesn't
-
-				wdt_ctr_flg = 0;				//reset to start count for the new cycle
-				second_ctr_flg++;				//increase number of seconds that passed
-				OWN_SECONDS++;				//increment OWN_TIME (SECOND)
-				begin_update = 5;
-			}
-			//increment RED_SCORE by 1 every 10 seconds
-			if(second_ctr_flg == 10){
-				GRN_SCORE++;
-				second_ctr = 0;			//reset time counters
-				second_ctr_flg = 0;
-				wdt_ctr = 0;			// (just in case)
-				wdt_ctr_flg = 0;
-				begin_update = 8;
-			}
-			//increment OWN_TIME (SECOND) every second (if 59 -> 00, increment MINUTE) - WDT
-			if(OWN_SECONDS == 60)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES++;
-				begin_update = 6;
-			}
-			if(OWN_MINUTES == 2)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES = 0;
-				WINNER = 'G';
-				begin_countdown = 0;
-				state = 7;
-			}
-			break;
+	for(t = 0; t < NUM_TEAMS; t++)
+		SCORE[t] = 0;
+}
 
-		case 7: //Game Over
-			if(WINNER == 'R'){
-				P2OUT |= REDFLAG;
-				P2OUT &= ~GRNFLAG;
-			}
-			else if(WINNER == 'G'){
-				P2OUT |= GRNFLAG;
-				P2OUT &= ~REDFLAG;
-			}
-			else if(WINNER == 'T'){
-				P2OUT |= (REDFLAG + GRNFLAG);
-			}
+// the team with the highest score, NO_TEAM if more than one team has it
+unsigned char score_leader(){
+	unsigned char t, best = 0, tie = 0;
 
-			//Restart Game and Reset Everything
-			begin_countdown = 0;
+	for(t = 1; t < NUM_TEAMS; t++){
+		if(SCORE[t] > SCORE[best]){
+			best = t;
+			tie = 0;
+		}
+		else if(SCORE[t] == SCORE[best])
+			tie = 1;
+	}
+	return tie ? NO_TEAM : best;
+}
 
-			MINUTES = 2;
-			SECONDS = 0;
-			wdt_ctr_timer = 0;
+// stop every timer, light the winner's FLAG (the FLAG of every team sharing
+// the highest score for a tie) and show it until the next tick
+void game_over(unsigned char winner){
+	unsigned char t, best = 0;
+
+	for(t = 0; t < N_TIMERS; t++)
+		timer_stop(t);
+	if(winner == NO_TEAM){
+		flag_off(FLAGS);
+		for(t = 0; t < NUM_TEAMS; t++)
+			if(SCORE[t] > best)
+				best = SCORE[t];		// packed BCD compares like binary
+		for(t = 0; t < NUM_TEAMS; t++)
+			if(SCORE[t] == best)
+				flag_on(TEAM[t].flag);
+		log_event(LOG_TIE, 0, 0);
+	}
+	else{
+		flag_off(FLAGS);
+		flag_on(TEAM[winner].flag);
+		log_event(LOG_OVER, LOG_TEAMOF(winner), 0);
+	}
+	timer_arm(T_POLL, 1, 0);
+	state = ST_OVER;
+}
 
-			wdt_ctr = 0;
-			second_ctr = 0;
+void no_action(unsigned char t){
+}
 
-			OWN_SECONDS = 0;
-			OWN_MINUTES = 0;
+void lcd_poll(unsigned char t){
+	if(*LCD_pc == LCD_END){		//init script is queued, the start screen follows it
+		timer_stop(T_POLL);
+		state = ST_SETUP;
+	}
+}
 
-			REDPRESS = 0;
-			GRNPRESS = 0;
+//on UP button hit, increment TIME (MINUTE) (if MINUTES_MAX, go to 2)
+void setup_up(unsigned char t){
+	flag_off(FLAGS);
+	if((MINUTES == MINUTES_MAX)||(MINUTES == 0))
+		MINUTES = 2;
+	else
+		MINUTES++;
+	GAME_clock = bcd(MINUTES) << 8;
+	LCD_put2(LCD_TIME_ROW, LCD_TIME_COL, GAME_clock >> 8);
+}
 
-			RED_SCORE = 0;
-			GRN_SCORE = 0;
+//on ENTER button hit, signal start up
+void setup_enter(unsigned char t){
+	flag_off(FLAGS);
+	timer_arm(T_BLINK, SEC(1), SEC(1));
+	timer_arm(T_STARTUP, SEC(STARTUP_SECS), 0);
+	state = ST_START;
+}
 
-			last_state = 7;
-			state = 'i';
-			break;
+//flash (toggle) all LEDs every second
+void start_blink(unsigned char t){
+	flag_toggle(FLAGS);
+}
 
-		case 8: //RED tries to take when GRN owns FLAG
-			if(wdt_ctr < ONE_SEC)		//until a second is reached,
-				wdt_ctr++;					//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT ^= REDFLAG;			//blink REDFLAG LEDs - RED is about to take FLAG
-				wdt_ctr = 0;				//reset to start count for the new cycle
-				second_ctr++;				//increase number of seconds that passed
-				begin_update = 3;
-			}
-			//when 5 seconds (5 seconds / time of 1 cycle = M WDT cycles), go to state 5 - WDT
-			if(second_ctr > 5){
-				second_ctr = 0;
-				second_ctr_flg = 0;
-				wdt_ctr = 0;
-				wdt_ctr_flg = 0;
-				OWN_SECONDS = 0;
-				OWN_MINUTES = 0;
-				P2OUT |= REDFLAG;		//FLAG is now owned by RED
-				P2OUT &= ~GRNFLAG;
-				begin_update = 3;
-
-				state = 5;				//move onto state 5
-			}
+//start up signal is over, start the game timer
+void start_done(unsigned char t){
+	timer_stop(T_BLINK);
+	flag_off(FLAGS);				//FLAG is un-owned so has no color
+	timer_arm(T_GAMEOVER, SEC(60) * MINUTES, 0);
+	timer_arm(T_SECOND, SEC(1), SEC(1));	// runs in step with T_GAMEOVER, GAME_clock hits 00:00 with it
+	GAME_clock = bcd(MINUTES) << 8;
+	log_event(LOG_START, 0, MINUTES);
+	state = ST_WAIT;
+}
 
-			if(wdt_ctr_flg < ONE_SEC)		//until a second is reached,
-				wdt_ctr_flg++;						//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT |= GRNFLAG;			//make sure GRN owns the FLAG
-				P2OUT &= ~REDFLAG;			// and RED doesn't
+//count the game time left down and show it and, while the flag is owned, the flag time
+void game_second(unsigned char t){
+	unsigned char owned;
+	char minute = '0';
+
+	GAME_clock = __bcd_add_short(GAME_clock, 0x9999);	// - 1 in BCD
+	if((GAME_clock & 0xFF) == 0x99)
+		GAME_clock -= 0x99 - 0x59;		// MM:00 - 1 = (MM - 1):59
+	show_time(LCD_TIME_ROW, LCD_TIME_COL, GAME_clock);
+	if(TIMER_armed & (1 << T_OWNWIN)){
+		owned = (SEC(OWNWIN_SECS) - timer_left(T_OWNWIN)) / JIFFY_DIV;
+		if(owned >= 60){			//flag time has a single minute digit, OWNWIN_SECS <= 120
+			owned -= 60;
+			minute = '1';
+		}
+		LCD_putc(LCD_FLAG_ROW, LCD_FLAG_COL, minute);
+		LCD_put2(LCD_FLAG_ROW, LCD_FLAG_COL + 2, bcd(owned));
+	}
+}
 
-				wdt_ctr_flg = 0;				//reset to start count for the new cycle
-				second_ctr_flg++;				//increase number of seconds that passed
-				OWN_SECONDS++;				//increment OWN_TIME (SECOND)
-				begin_update = 5;
-			}
-			//increment RED_SCORE by 1 every 10 seconds
-			if(second_ctr_flg == 10){
-				GRN_SCORE++;
-				second_ctr_flg = 0;			//reset time counters
-				wdt_ctr_flg = 0;			// (just in case)
-				begin_update = 8;
-			}
-			//increment OWN_TIME (SECOND) every second (if 59 -> 00, increment MINUTE) - WDT
-			if(OWN_SECONDS == 60)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES++;
-				begin_update = 6;
-			}
-			if(OWN_MINUTES == 2)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES = 0;
-				WINNER = 'G';
-				begin_countdown = 0;
-				state = 7;
-			}
-			break;
+//when the game time runs out, the highest score wins - GAME OVER
+void game_time_up(unsigned char t){
+	GAME_clock = 0;
+	show_time(LCD_TIME_ROW, LCD_TIME_COL, GAME_clock);
+	game_over(score_leader());
+}
 
-		case 9: //GRN tries to take when RED owns FLAG
-			if(wdt_ctr < ONE_SEC)		//until a second is reached,
-				wdt_ctr++;					//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT ^= GRNFLAG;			//blink GRNFLAG LEDs - GRN is about to take FLAG
-				wdt_ctr = 0;					//reset to start count for the new cycle
-				second_ctr++;					//increase number of seconds that passed
-				begin_update = 4;
-			}
-			//when 5 seconds (5 seconds / time of 1 cycle = M WDT cycles), go to state 5 - WDT
-			if(second_ctr > 5){
-				second_ctr = 0;			//reset time counters (just in case)
-				second_ctr_flg = 0;
-				wdt_ctr = 0;
-				wdt_ctr_flg = 0;
-				OWN_SECONDS = 0;
-				OWN_MINUTES = 0;
-				P2OUT |= GRNFLAG;		//FLAG is now owned by GRN
-				P2OUT &= ~REDFLAG;		//make sure REDFLAG is off
-				begin_update = 4;
-
-				state = 6;				//move onto state 6
-			}
+//a team hits the un-owned flag's target
+void wait_hit(unsigned char t){
+	flag_off(FLAGS);
+	flag_on(TEAM[t].flag);
+	capture_begin(t);
+	state = ST_TAKE;
+}
 
-			if(wdt_ctr_flg < ONE_SEC)		//until a second is reached,
-				wdt_ctr_flg++;						//keep counting WDT intervals
-			else{						//at every second,
-				P2OUT |= GRNFLAG;			//make sure GRN owns the FLAG
-				P2OUT &= ~REDFLAG;			// and RED doesn't
+//attacker let go; it failed to take the flag
+void take_letgo(unsigned char t){
+	if(capture_abort(t))
+		state = ST_WAIT;
+}
 
-				wdt_ctr_flg = 0;				//reset to start count for the new cycle
-				second_ctr_flg++;				//increase number of seconds that passed
-				OWN_SECONDS++;				//increment OWN_TIME (SECOND)
-				begin_update = 5;
-			}
-			//increment RED_SCORE by 1 every 10 seconds
-			if(second_ctr_flg == 10){
-				GRN_SCORE++;
-				second_ctr_flg = 0;			//reset time counters
-				wdt_ctr = 0;			// (just in case)
-				begin_update = 8;
-			}
-			//increment OWN_TIME (SECOND) every second (if 59 -> 00, increment MINUTE) - WDT
-			if(OWN_SECONDS == 60)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES++;
-				begin_update = 6;
-			}
-			if(OWN_MINUTES == 2)
-			{
-				OWN_SECONDS = 0;
-				OWN_MINUTES = 0;
-				WINNER = 'G';
-				begin_countdown = 0;
-				state = 7;
-			}
-			break;
+//another team hits the owned flag's target
+void owned_hit(unsigned char t){
+	if(t != owner){
+		capture_begin(t);
+		state = ST_STEAL;
+	}
+}
+
+//increment owner's SCORE by 1 every 10 seconds
+void owned_score(unsigned char t){
+	flag_on(TEAM[owner].flag);		//make sure owner's FLAG is on
+	SCORE[owner] = __bcd_add_short(SCORE[owner], 1);
+	log_event(LOG_SCORE, LOG_TEAMOF(owner), 0);
+	LCD_put2(1, TEAM[owner].score_col, SCORE[owner]);
+}
+
+//owning the FLAG for 2 minutes wins the game
+void owned_win(unsigned char t){
+	game_over(owner);
+}
 
+void steal_letgo(unsigned char t){
+	if(capture_abort(t)){
+		flag_on(TEAM[owner].flag);
+		state = ST_OWNED;
 	}
+}
 
-	if(begin_countdown == 1)	// game counter gets incremented and displayed
-	{
-		if(wdt_ctr_timer < ONE_SEC)		//until a second is reached,
-			wdt_ctr_timer++;					//keep counting WDT intervals
-		else{						//at every second,
-			begin_update = 1;
-			wdt_ctr_timer = 0;					//reset to start count for the new cycle
-			if(SECONDS == 0){
-				SECONDS = 59;
-				MINUTES = MINUTES - 1;
-				begin_update = 2;
-			}
-			else
-				SECONDS = SECONDS - 1;					//increase number of seconds that passed
-		}
-		//when 5 seconds (5 seconds / time of 1 cycle = M WDT cycles), go to state 5 - WDT
-		if((MINUTES == 0) && (SECONDS == 0)){
-			if(RED_SCORE > GRN_SCORE)
-			{
-				WINNER = 'R';
-			}
-			else if(GRN_SCORE > RED_SCORE)
-			{
-				WINNER = 'G';
-			}
-			else if(GRN_SCORE == RED_SCORE)
-			{
-				WINNER = 'T';
-			}
-			begin_countdown = 0;
-			state = 7;				//move onto state 7 - GAME OVER
-		}
+//reset everything and restart the LCD for the next game
+void over_poll(unsigned char t){
+	MINUTES = 2;
 
-		if(begin_update == 8)	//updates GRN_SCORE
-		{
-			if(whichcase == 0){
-				tens_digit = GRN_SCORE / 10;
-				singles_digit = GRN_SCORE % 10;
+	score_clear();
 
-//				LCD_LUT(tens_digit);
-				gotoLCDpos(1, 1, 3);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 1, 3);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, tens_digit);
-			}
+	LCD_script(LCD_INIT_SCRIPT);
+	LCD_screen(LCD_START_SCREEN);
+	timer_arm(T_POLL, 1, 1);
+	state = ST_LCD;
+}
 
-			else if(whichcase == 4){
-//				LCD_LUT(singles_digit);
-				gotoLCDpos(1, 1, 4);
-			}
-			else if(whichcase == 5){
-				gotoLCDpos(2, 1, 4);
-			}
-			else if(whichcase == 6){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 7){
-				chartoLCD(2, singles_digit);
-				begin_update = 6;
-			}
+//restart game when UP pressed
+void over_up(unsigned char t){
+	timer_stop(T_POLL);
+	state = ST_SETUP;
 
-			if(whichcase < 7){
-				whichcase++;
-			}
-			else if(whichcase == 7){
-				whichcase = 0;
-			}
-		}
-		else if(begin_update == 7)	//updates RED_SCORE
-		{
-			if(whichcase == 0){
-				tens_digit = RED_SCORE / 10;
-				singles_digit = RED_SCORE % 10;
-
-//				LCD_LUT(tens_digit);
-				gotoLCDpos(1, 1, 15);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 1, 15);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, tens_digit);
-			}
+	score_clear();
+}
 
-			else if(whichcase == 4){
-//				LCD_LUT(singles_digit);
-				gotoLCDpos(1, 1, 16);
-			}
-			else if(whichcase == 5){
-				gotoLCDpos(2, 1, 16);
-			}
-			else if(whichcase == 6){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 7){
-				chartoLCD(2, singles_digit);
-				begin_update = 6;
-			}
+// action for each (state, event), the team argument only matters for EV_HIT/EV_LETGO
+void (*const FSM[N_STATES][N_EVENTS])(unsigned char) = {
+	//				EV_UP		EV_ENTER	EV_HIT		EV_LETGO
+	//				EV_POLL		EV_SECOND	EV_BLINK		EV_STARTUP	EV_CAPTURE		EV_SCORE	EV_OWNWIN	EV_GAMEOVER		EV_PROGRESS
+	/* ST_LCD */	{no_action,	no_action,	no_action,	no_action,
+					lcd_poll,	no_action,	no_action,		no_action,	no_action,		no_action,	no_action,	no_action,		no_action},
+	/* ST_SETUP */	{setup_up,	setup_enter,no_action,	no_action,
+					no_action,	no_action,	no_action,		no_action,	no_action,		no_action,	no_action,	no_action,		no_action},
+	/* ST_START */	{no_action,	no_action,	no_action,	no_action,
+					no_action,	no_action,	start_blink,	start_done,	no_action,		no_action,	no_action,	no_action,		no_action},
+	/* ST_WAIT */	{no_action,	no_action,	wait_hit,	no_action,
+					no_action,	game_second,no_action,		no_action,	no_action,		no_action,	no_action,	game_time_up,	no_action},
+	/* ST_TAKE */	{no_action,	no_action,	no_action,	take_letgo,
+					no_action,	game_second,capture_blink,	no_action,	capture_done,	no_action,	no_action,	game_time_up,	capture_progress},
+	/* ST_OWNED */	{no_action,	no_action,	owned_hit,	no_action,
+					no_action,	game_second,no_action,		no_action,	no_action,		owned_score,owned_win,	game_time_up,	no_action},
+	/* ST_OVER */	{over_up,	no_action,	no_action,	no_action,
+					over_poll,	no_action,	no_action,		no_action,	no_action,		no_action,	no_action,	no_action,		no_action},
+	/* ST_STEAL */	{no_action,	no_action,	no_action,	steal_letgo,
+					no_action,	game_second,capture_blink,	no_action,	capture_done,	owned_score,owned_win,	game_time_up,	capture_progress}
+};
+
+// run event ev (of team t) in the current state
+void fsm_run(unsigned char ev, unsigned char t){
+	FSM[state][ev](t);
+	TLM_dirty = 1;				// the game may have changed, tlm_update looks
+}
 
-			if(whichcase < 7){
-				whichcase++;
-			}
-			else if(whichcase == 7){
-				whichcase = 0;
-			}
-		}
-		else if(begin_update == 6)	//updates time (minutes) FLAG OWNED (OWN_MINUTES)
-		{
-			if(whichcase == 0){
-//				LCD_LUT(OWN_MINUTES);
-				gotoLCDpos(1, 2, 8);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 2, 8);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, OWN_MINUTES);
-				begin_update = 5;
-			}
+//-----Target Debounce-----
+// A flickering laser or ambient IR can toggle a target's phototransistor many
+// times a second. The first edge of a target only turns its edge interrupt off
+// and starts sampling it every DEB_period on Timer A0 CCR1: an integrator counts
+// up while the pin is low (shot at) and down while it is high. EV_HIT/EV_LETGO
+// run when it crosses DEB_HOLD/DEB_RELEASE, and once it settles at 0 or DEB_MAX
+// the edge interrupt is back on. A noisy target so costs at most DEB_RATE
+// interrupts a second, and a glitch shorter than DEB_HOLD samples is ignored.
+// Targets are handled as P1 bit masks and only the pins being debounced are
+// visited, PIN_TEAM gives the team of a pin, so more teams cost nothing extra.
+
+// the pins of takes moved, debounce them instead of trusting the edges
+void debounce_start(unsigned char takes){
+	unsigned int now = time_now();
+
+#ifdef RECORD
+	rec_event(now, REC_EDGE, (REC_takes & ~takes) | (~P1IES & takes));	// P1IES is the edge that moved them
+	REC_takes = (REC_takes & ~takes) | (~P1IES & takes);
+#endif
+	P1IE &= ~takes;
+	DEB_sampling |= takes;
+	if(!(TA0CCTL1 & CCIE)){
+		TA0CCR1 = now + DEB_period;
+		TA0CCTL1 = CCIE;
+	}
+}
 
-			if(whichcase < 3){
-				whichcase++;
-			}
-			else if(whichcase == 3){
-				whichcase = 0;
-			}
-		}
-		else if(begin_update == 5)	//updates time (seconds) FLAG OWNED (OWN_SECONDS)
-		{
-			if(whichcase == 0){
-				tens_digit = OWN_SECONDS / 10;
-				singles_digit = OWN_SECONDS % 10;
-
-//				LCD_LUT(tens_digit);
-				gotoLCDpos(1, 2, 10);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 2, 10);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, tens_digit);
-			}
+// team t's target is settled: watch its pin for the edge away from the settled level
+void debounce_watch(unsigned char t){
+	unsigned char take = TEAM[t].take;
+
+	DEB_sampling &= ~take;
+	if(DEB_held & take)
+		P1IES &= ~take;		// hit (0), wait for 0->1
+	else
+		P1IES |= take;		// let go (1), wait for 1->0
+	P1IFG &= ~take;			// changing P1IES can set P1IFG
+#ifdef RECORD
+	REPLAY_ifg &= ~take;
+#endif
+	P1IE |= take;
+	if(((TAKES_IN & take) == 0) != ((DEB_held & take) != 0)){
+#ifdef RECORD
+		if(REPLAY_on)
+			REPLAY_ifg |= take;	// P1IFG can't be raised for P1.1, it is UCA0RXD
+		else
+#endif
+		P1IFG |= take;		// it already moved again, raise the interrupt by hand
+	}
+}
 
-			else if(whichcase == 4){
-//				LCD_LUT(singles_digit);
-				gotoLCDpos(1, 2, 11);
-			}
-			else if(whichcase == 5){
-				gotoLCDpos(2, 2, 11);
-			}
-			else if(whichcase == 6){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 7){
-				chartoLCD(2, singles_digit);
-				begin_update = 2;
-			}
+// take one sample of every target being debounced
+void debounce_sample(){
+	unsigned char t, pin, take, pins, in;
+	unsigned int next, late;
+#ifdef RECORD
+	unsigned int at = TA0CCR1;
+
+	if(REPLAY_on)
+		replay_sample(at);
+#endif
+	in = TAKES_IN;
+#ifdef RECORD
+	REC_sample = time_ticks(TA0CCR1);
+	REC_quiet = !((in ^ REC_takes) & DEB_sampling);
+	if(!REC_quiet){
+		REC_takes = (REC_takes & ~DEB_sampling) | (in & DEB_sampling);
+		rec_event(TA0CCR1, REC_SAMPLE, REC_takes);
+	}
+#endif
 
-			if(whichcase < 7){
-				whichcase++;
-			}
-			else if(whichcase == 7){
-				whichcase = 0;
-			}
+	for(pins = DEB_sampling, pin = 0, take = 1; pins != 0; pins >>= 1, pin++, take <<= 1){
+		if(!(pins & 1))
+			continue;
+		t = PIN_TEAM[pin];
+		if(!(in & take)){
+			if(DEB_count[t] < DEB_MAX)
+				DEB_count[t]++;
 		}
-		else if(begin_update == 4)	//updates time until GRN seizes FLAG
-		{
-			if(whichcase == 0){
-//				LCD_LUT(tens_digit);
-				gotoLCDpos(1, 2, 3);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 2, 3);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, second_ctr);
-				begin_update = 2;
-			}
+		else if(DEB_count[t] > 0)
+			DEB_count[t]--;
 
-			if(whichcase < 3){
-				whichcase++;
-			}
-			else if(whichcase == 3){
-				whichcase = 0;
-			}
+		if(!(DEB_held & take) && (DEB_count[t] >= DEB_HOLD)){
+			DEB_held |= take;
+			fsm_run(EV_HIT, t);
 		}
-		else if(begin_update == 3)	//updates time until RED seizes FLAG
-		{
-			if(whichcase == 0){
-//				LCD_LUT(second_ctr);
-				gotoLCDpos(1, 2, 15);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 2, 15);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, second_ctr);
-				begin_update = 2;
-			}
-
-			if(whichcase < 3){
-				whichcase++;
-			}
-			else if(whichcase == 3){
-				whichcase = 0;
-			}
+		else if((DEB_held & take) && (DEB_count[t] <= DEB_RELEASE)){
+			DEB_held &= ~take;
+			fsm_run(EV_LETGO, t);
 		}
-		else if(begin_update == 2)	//updates MINUTES for TIMER
-		{
-			if(whichcase == 0){
-				tens_digit = MINUTES / 10;
-				singles_digit = MINUTES % 10;
-
-//				LCD_LUT(tens_digit);
-				gotoLCDpos(1, 1, 7);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 1, 7);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, tens_digit);
-			}
+		if(DEB_count[t] == ((DEB_held & take) ? DEB_MAX : 0))
+			debounce_watch(t);
+	}
+	if(DEB_sampling != 0){
+		next = TA0CCR1 + DEB_period;
+		late = time_now() + TIME_MIN;	// after a stall, sample now rather than a TA0R wrap later
+		if((int)(next - late) < 0)
+			next = late;
+		TA0CCR1 = next;
+	}
+	else
+		TA0CCTL1 = 0;
+#ifdef RECORD
+	if(REPLAY_on){
+		replay_due(at);			// inputs recorded after this sample
+		replay_port();			// and the edges debounce_watch raised
+	}
+#endif
+}
 
-			else if(whichcase == 4){
-//				LCD_LUT(singles_digit);
-				gotoLCDpos(1, 1, 8);
-			}
-			else if(whichcase == 5){
-				gotoLCDpos(2, 1, 8);
-			}
-			else if(whichcase == 6){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 7){
-				chartoLCD(2, singles_digit);
-				begin_update = 1;
-			}
+// ===== Port 1 Interrupt Handler =====
+// A target's edge starts debouncing it, its EV_HIT/EV_LETGO come from debounce_sample.
 
-			if(whichcase < 7){
-				whichcase++;
-			}
-			else if(whichcase == 7){
-				whichcase = 0;
-			}
-		}
-		else if(begin_update == 1)
-		{
-			if(whichcase == 0){
-				tens_digit = SECONDS / 10;
-				singles_digit = SECONDS % 10;
-
-//				LCD_LUT(tens_digit);
-				gotoLCDpos(1, 1, 10);
-			}
-			else if(whichcase == 1){
-				gotoLCDpos(2, 1, 10);
-			}
-			else if(whichcase == 2){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 3){
-				chartoLCD(2, tens_digit);
-			}
+void interrupt target_handler(){
+	unsigned char ifg;
 
-			else if(whichcase == 4){
-				LCD_LUT(singles_digit);
-				gotoLCDpos(1, 1, 11);
-			}
-			else if(whichcase == 5){
-				gotoLCDpos(2, 1, 11);
-			}
-			else if(whichcase == 6){
-				chartoLCD(1, highnibble);
-			}
-			else if(whichcase == 7){
-				chartoLCD(2, singles_digit);
-				begin_update = 0;
-			}
+	PROBE_ENTER();
+	ifg = P1IFG & TAKES;
+	P1IFG &= ~ifg;
+	if(!REPLAY_on)				// the targets are unplugged, replay_due plays their edges
+		debounce_start(ifg);
+	PROBE_EXIT(P_PORT);
+}
+ISR_VECTOR(target_handler,".int02") // declare interrupt vector
+
+// ===== Port 2 Interrupt Handler =====
+// UP/ENTER are only watched for 1->0.
+
+void interrupt button_handler(){
+	unsigned char ifg;
+
+	PROBE_ENTER();
+	ifg = P2IFG & (ENTER + UP);
+	P2IFG &= ~ifg;
+#ifdef RECORD
+	rec_event(time_now(), REC_BUTTONS, ifg);
+#endif
+	time_sync();
+
+	if(ifg & UP)
+		fsm_run(EV_UP, 0);
+	if(ifg & ENTER)
+		fsm_run(EV_ENTER, 0);
+	time_schedule();
+	if(handler_done())
+		_bic_SR_register_on_exit(LPM3_bits);
+	PROBE_EXIT(P_PORT);
+}
+ISR_VECTOR(button_handler,".int03") // declare interrupt vector
+
+// ===== Timer A0 CCR0 Interrupt Handler =====
+// This event handler is called at the deadline set by time_schedule, when the
+//    next timer on the wheel may be due.
+
+void interrupt timer_handler(){
+	PROBE_ENTER();
+	time_sync();				// runs the events of the timers that expired
+	time_schedule();
+	if(handler_done())			// push whatever the game changed on screen and out the UART
+		_bic_SR_register_on_exit(LPM3_bits);
+	PROBE_EXIT(P_TIMER);
+}
+// DECLARE timer_handler as handler for interrupt 9 (TIMER0_A0)
+ISR_VECTOR(timer_handler, ".int09")
+
+// ===== Timer A0 CCR1 Interrupt Handler =====
+// This event handler is called every DEB_period while a target is debounced,
+//    and from CCR2 when the next input of a replay is due.
+
+void interrupt debounce_handler(){
+	switch(TA0IV){
+		case TA0IV_TACCR1:
+			PROBE_ENTER();
+			time_sync();
+			debounce_sample();
+			time_schedule();
+			if(handler_done())
+				_bic_SR_register_on_exit(LPM3_bits);
+			PROBE_EXIT(P_DEBOUNCE);
+			break;
+#ifdef RECORD
+		case TA0IV_TACCR2:
+			time_sync();
+			replay_due(time_now());		// not TA0CCR2, it may be a TA0R wrap early
+			time_schedule();
+			if(handler_done())
+				_bic_SR_register_on_exit(LPM3_bits);
+			break;
+#endif
+	}
+}
+// DECLARE debounce_handler as handler for interrupt 8 (TIMER0_A1)
+ISR_VECTOR(debounce_handler, ".int08")
+
+// ===== USCI A0 Transmit Interrupt Handler =====
+// Moves TX_ring into UCA0TXBUF a byte per interrupt (~87us at 115200 baud) and
+// turns itself off when the ring is empty.
+
+void interrupt tx_handler(){
+	PROBE_ENTER();
+	if(TX_head != TX_tail){
+		UCA0TXBUF = TX_ring[TX_head];
+		TX_head = (TX_head + 1) & (TX_SIZE - 1);
+	}
+	if(TX_head == TX_tail){
+		UC0IE &= ~UCA0TXIE;
+		_bic_SR_register_on_exit(LPM3_bits);	// main picks the low power mode again
+	}
+	PROBE_EXIT(P_TX);
+}
+// DECLARE tx_handler as handler for interrupt 6 (USCIAB0TX)
+ISR_VECTOR(tx_handler, ".int06")
+
+#ifdef RECORD
+// ===== USCI A0 Receive Interrupt Handler =====
+// Takes the stream of a replay a byte at a time. The USCI turns SMCLK on
+//    for a byte coming in, even in LPM3.
+
+void interrupt rx_handler(){
+	if(UCA0STAT & UCOE)
+		REC_flags |= REC_LOST;		// a byte came in before the last one was read
+	time_sync();
+	replay_feed(UCA0RXBUF);
+	time_schedule();
+	if(handler_done())
+		_bic_SR_register_on_exit(LPM3_bits);
+}
+// DECLARE rx_handler as handler for interrupt 7 (USCIAB0RX)
+ISR_VECTOR(rx_handler, ".int07")
+#endif
+
+// ===== Timer A1 CCR0 Interrupt Handler =====
+// Sends one LCD_queue entry per interrupt (TA1 counts 1us at SMCLK/8). Command
+// and data bytes go out as soon as the LCD's busy flag clears, so each takes
+// only as long as the controller really needs. The busy flag can't be read
+// before 4 bit mode is on, so single nibbles and LCD_Q_WAITs keep fixed delays.
+// Stops itself once there is nothing left to send.
+
+void interrupt LCD_handler(){
+	unsigned int entry;
+	unsigned char value;
+
+	PROBE_ENTER();
+#ifdef PROBE
+	probe_record(P_LCD_LATE, PROBE_start - TA1CCR0);
+#endif
+	if(LCD_head == LCD_tail)
+		LCD_fill();
+	if(LCD_head == LCD_tail){
+		TA1CCTL0 = 0;
+		_bic_SR_register_on_exit(LPM3_bits);	// nothing needs SMCLK now, main can go to LPM3
+		PROBE_EXIT(P_LCD);
+		return;
+	}
 
-			if(whichcase < 7){
-				whichcase++;
-			}
-			else if(whichcase == 7){
-				whichcase = 0;
-			}
-		}
+	entry = LCD_queue[LCD_head];
+	value = entry & 0xFF;
 
+	if((entry >= LCD_Q_CMD) && (entry < LCD_Q_WAIT)){
+		if((LCD_status() & LCD_BUSY) && (LCD_polls < LCD_POLL_MAX)){
+			LCD_polls++;				// still executing the last one, look again shortly
+			TA1CCR0 += LCD_T_POLL;
+			PROBE_EXIT(P_LCD);
+			return;
+		}
 	}
+	LCD_polls = 0;
+	LCD_head = (LCD_head + 1) & (LCD_QSIZE - 1);
 
+	switch(entry & 0xFF00){
+		case LCD_Q_NIB:
+			cmdtoLCD(2, value);
+			TA1CCR0 += LCD_T_EXEC;
+			break;
+		case LCD_Q_CMD:
+			cmdtoLCD(1, value);
+			cmdtoLCD(2, value);
+			TA1CCR0 += LCD_T_POLL;
+			break;
+		case LCD_Q_DATA:
+			chartoLCD(1, value);
+			chartoLCD(2, value);
+			TA1CCR0 += LCD_T_POLL;
+			break;
+		case LCD_Q_WAIT:
+			TA1CCR0 += value * 1000u;		// 16 bit int, value * 1000 overflows past 32 ms
+			break;
+	}
+	PROBE_EXIT(P_LCD);
 }
-// DECLARE WDT_interval_handler as handler for interrupt 10
-ISR_VECTOR(WDT_interval_handler, ".int10")
+// DECLARE LCD_handler as handler for interrupt 13 (TIMER1_A0)
+ISR_VECTOR(LCD_handler, ".int13")
@@ -0,0 +1,230 @@
+/***********************************************************************
+	HD44780 LCD controller model for the host builds, runs on the PC
+
+	The controller on a 4 bit bus (D7-D4) as the HD44780U datasheet has
+	it, for a tool to hang on the emulated port pins (host/hostemu.h):
+	it calls hd44780_bus with the time and the levels of RS, RW, E and
+	D7-D4 whenever one of them may have changed, and puts the nibble it
+	returns on the data pins while it is not -1.
+
+	- after power up the bus is 8 bits wide, a write latches D7-D4 as
+	  the high nibble of a whole byte, until function set 0x20 makes it
+	  4 bits wide. From then on a byte is two writes, high nibble first.
+	- writes latch on the falling edge of E, reads drive D7-D4 from the
+	  rising edge of E to its fall: the busy flag and address counter,
+	  high nibble first, in 4 bit mode.
+	- clear display and return home keep the busy flag set for 1.52ms,
+	  every other instruction and data write for 37us.
+	- DDRAM (80 characters, lines at 0x00 and 0x40) and CGRAM (8 glyphs
+	  of 8 rows), the address counter with the entry mode's increment or
+	  decrement, display on/off. Shifting the display isn't kept.
+
+	It counts each way the MCU can get the protocol wrong, in
+	errors[HD_ERRORS]: see HD_ERROR_NAMES.
+
+ ***********************************************************************/
+
+#ifndef HOST_HD44780_H
+#define HOST_HD44780_H
+
+#include <string.h>
+
+#define HD_PS_US	1000000ULL		// picoseconds in a microsecond
+#define HD_POWER_UP	(40000 * HD_PS_US)	// the controller's own reset, no access before then
+#define HD_SLOW		(1520 * HD_PS_US)	// clear display, return home
+#define HD_FAST		(37 * HD_PS_US)		// the rest
+#define HD_PWEH		(230 * 1000ULL)		// shortest E high time, 230ns
+
+#define HD_EARLY	0		// errors: accessed before HD_POWER_UP
+#define HD_BUSY		1		// written while the busy flag was set
+#define HD_SETUP	2		// RS or RW moved while E was high, or with its rise (no tAS)
+#define HD_PULSE	3		// E high shorter than HD_PWEH
+#define HD_CLASH	4		// the MCU drove D7-D4 while the LCD did
+#define HD_EARLY_READ 5		// the busy flag read in 8 bit mode, where it can't be
+#define HD_ERRORS	6
+
+const char *HD_ERROR_NAMES[HD_ERRORS] = {
+	"accesses before the controller's 40ms power up",
+	"writes while busy",
+	"RS/RW changes while E was high or as it rose",
+	"E pulses under 230ns",
+	"bus clashes, MCU and LCD driving D7-D4",
+	"busy flag reads in 8 bit mode"
+};
+
+struct hd44780 {
+	unsigned char ddram[0x80];		// 0x00-0x27 line 1, 0x40-0x67 line 2
+	unsigned char cgram[64];
+	unsigned char ac;				// address counter
+	unsigned char cg;				// ac points at CGRAM
+	unsigned char inc;				// entry mode I/D
+	unsigned char on;				// display on
+	unsigned char four;				// 4 bit bus
+	unsigned char half;				// high nibble of a byte came, its low one is next
+	unsigned char hi;				// that high nibble
+	unsigned char reading;			// the next read is the low nibble
+	int rs, rw, e;					// the pins as last seen
+	unsigned long long e_rose;		// time E went high
+	unsigned long long busy_until;
+	unsigned long long was_busy;	// time the busy flag has been set in all
+	unsigned long writes, reads, busy_reads, bytes, commands;
+	unsigned long errors[HD_ERRORS];
+};
+
+void hd44780_init(struct hd44780 *lcd){
+	memset(lcd, 0, sizeof *lcd);
+	memset(lcd->ddram, ' ', sizeof lcd->ddram);
+	lcd->inc = 1;
+	lcd->busy_until = HD_POWER_UP;
+}
+
+int hd44780_busy(struct hd44780 *lcd, unsigned long long ps){
+	return ps < lcd->busy_until;
+}
+
+void hd44780_exec(struct hd44780 *lcd, unsigned long long ps, unsigned long long length){
+	lcd->busy_until = ps + length;
+	lcd->was_busy += length;
+}
+
+// move the address counter on after a RAM access
+void hd44780_step(struct hd44780 *lcd){
+	if(lcd->cg)
+		lcd->ac = (lcd->ac + (lcd->inc ? 1 : -1)) & 0x3F;
+	else
+		lcd->ac = (lcd->ac + (lcd->inc ? 1 : -1)) & 0x7F;
+}
+
+void hd44780_command(struct hd44780 *lcd, unsigned long long ps, unsigned char c){
+	lcd->commands++;
+	if(c & 0x80){					// set DDRAM address
+		lcd->ac = c & 0x7F;
+		lcd->cg = 0;
+	}
+	else if(c & 0x40){				// set CGRAM address
+		lcd->ac = c & 0x3F;
+		lcd->cg = 1;
+	}
+	else if(c & 0x20){				// function set, DL
+		lcd->four = !(c & 0x10);
+		lcd->half = 0;
+	}
+	else if(c & 0x10){				// cursor or display shift
+		if(!(c & 0x08))
+			hd44780_step(lcd);
+	}
+	else if(c & 0x08)				// display on/off control
+		lcd->on = (c & 0x04) != 0;
+	else if(c & 0x04)				// entry mode set
+		lcd->inc = (c & 0x02) != 0;
+	else if(c & 0x02){				// return home
+		lcd->ac = 0;
+		lcd->cg = 0;
+		hd44780_exec(lcd, ps, HD_SLOW);
+		return;
+	}
+	else if(c & 0x01){				// clear display
+		memset(lcd->ddram, ' ', sizeof lcd->ddram);
+		lcd->ac = 0;
+		lcd->cg = 0;
+		lcd->inc = 1;
+		hd44780_exec(lcd, ps, HD_SLOW);
+		return;
+	}
+	hd44780_exec(lcd, ps, HD_FAST);
+}
+
+void hd44780_data(struct hd44780 *lcd, unsigned long long ps, unsigned char c){
+	if(lcd->cg)
+		lcd->cgram[lcd->ac & 0x3F] = c & 0x1F;
+	else
+		lcd->ddram[lcd->ac & 0x7F] = c;
+	hd44780_step(lcd);
+	hd44780_exec(lcd, ps, HD_FAST);
+}
+
+// a write latched on E's falling edge
+void hd44780_write(struct hd44780 *lcd, unsigned long long ps, unsigned char nibble){
+	unsigned char c;
+
+	lcd->writes++;
+	if(hd44780_busy(lcd, ps))
+		lcd->errors[(ps < HD_POWER_UP) ? HD_EARLY : HD_BUSY]++;
+	if(!lcd->four){					// 8 bit bus, D3-D0 aren't wired so read as 0
+		lcd->bytes++;
+		if(lcd->rs)
+			hd44780_data(lcd, ps, nibble << 4);
+		else
+			hd44780_command(lcd, ps, nibble << 4);
+		return;
+	}
+	if(!lcd->half){
+		lcd->hi = nibble;
+		lcd->half = 1;
+		return;
+	}
+	lcd->half = 0;
+	lcd->bytes++;
+	c = (lcd->hi << 4) | nibble;
+	if(lcd->rs)
+		hd44780_data(lcd, ps, c);
+	else
+		hd44780_command(lcd, ps, c);
+}
+
+// the pins at time ps: rs, rw, e as 0/1, out the nibble on D7-D4 and
+// drives whether the MCU drives them. Returns the nibble the LCD drives
+// on D7-D4, -1 while it leaves them alone
+int hd44780_bus(struct hd44780 *lcd, unsigned long long ps, int rs, int rw, int e, unsigned char out, int drives){
+	unsigned char status;
+	int driving;
+
+	if((lcd->e || e) && ((rs != lcd->rs) || (rw != lcd->rw)))
+		lcd->errors[HD_SETUP]++;
+	lcd->rs = rs;
+	if(rw != lcd->rw){
+		lcd->rw = rw;
+		lcd->reading = 0;
+		if(lcd->e && !rw)
+			lcd->e_rose = ps;			// E was high while reading, it's a write cycle now
+	}
+	if(e && !lcd->e){
+		lcd->e_rose = ps;
+		if(rw && !rs){					// read busy flag and address counter
+			lcd->reads++;
+			if(ps < HD_POWER_UP)
+				lcd->errors[HD_EARLY]++;
+			else if(!lcd->four)
+				lcd->errors[HD_EARLY_READ]++;
+			if(hd44780_busy(lcd, ps) && !lcd->reading)
+				lcd->busy_reads++;
+		}
+	}
+	else if(!e && lcd->e){
+		if(ps - lcd->e_rose < HD_PWEH)
+			lcd->errors[HD_PULSE]++;
+		if(!rw)
+			hd44780_write(lcd, ps, out & 0x0F);
+		else if(!rs)
+			lcd->reading ^= 1;
+	}
+	lcd->e = e;
+	driving = e && rw && !rs;
+	if(!driving)
+		return -1;
+	if(drives)
+		lcd->errors[HD_CLASH]++;
+	status = (hd44780_busy(lcd, ps) ? 0x80 : 0) | (lcd->cg ? lcd->ac & 0x3F : lcd->ac);
+	return lcd->reading ? status & 0x0F : status >> 4;
+}
+
+// characters 0x08-0x0F mirror the CGRAM glyphs 0-7 as 0x00-0x07 do
+void hd44780_row(struct hd44780 *lcd, int row, char text[17]){
+	int col;
+
+	for(col = 0; col < 16; col++)
+		text[col] = lcd->ddram[(row ? 0x40 : 0x00) + col];
+	text[16] = 0;
+}
+
+#endif
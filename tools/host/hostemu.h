@@ -0,0 +1,777 @@
+/***********************************************************************
+	MSP430G2553 emulator for the host builds, runs on the PC
+
+	Include it before the firmware, which then finds host/msp430g2553.h
+	already in, and start the firmware's main with emu_run. Every register access
+	then runs the peripherals up to the time it happens, on a virtual
+	clock in picoseconds (EMU_ps), and takes the interrupts that are
+	due, calling the handlers ISR_VECTOR put in HOST_VECTORS in priority
+	order. While the CPU sleeps time jumps from one interrupt to the
+	next, so an hour on the chip runs in milliseconds.
+
+	Modelled, as in the MSP430x2xx family user's guide:
+	- clocks: MCLK and SMCLK (DIVS) from the DCO, at its 1MHz or 8MHz
+	  calibration (RSEL of BCSCTL1), 1.1MHz otherwise. ACLK from the VLO
+	  (EMU_vlo_hz) with LFXT1S_2, from a 32768Hz crystal otherwise, DIVA.
+	  The low power modes stop them: CPUOFF MCLK, SCG1 SMCLK, OSCOFF ACLK.
+	- Timer A0 and A1: ACLK or SMCLK, ID, stop/up/continuous mode (up/down
+	  counts like up, no program uses it), compares setting CCIFG and the
+	  OUT bit in OUTMOD 0/1/4/5, TAIFG, TAxIV (an access clears the flag
+	  it shows). Captures of ACLK on TA0 CCI0B and of P1.1/P1.2 on TA0
+	  CCI0A/CCI1A, COV when one is missed.
+	- the watchdog: interval timer (WDTIFG) or watchdog, which resets the
+	  chip and ends the run. A change of WDTCTL starts the interval over.
+	- ports 1-3: PxIN reads the levels emu_pin drives (EMU_in) on inputs
+	  and PxOUT on outputs, PxIFG is set on the edge PxIES picks.
+	- USCI_A0 UART transmit: UCA0BR0/1 and UCBRSx of BRCLK (SMCLK), 10
+	  bit frames, TXBUF and the shift register, UCA0TXIFG and UCBUSY.
+	  Each byte goes to emu_uart when its stop bit ends. SMCLK stopping
+	  under it stalls it (EMU_tx_stalls), a byte written over one still
+	  waiting in TXBUF is lost (EMU_tx_overruns).
+	- USCI_A0 UART receive: a byte the tool hands emu_uart_rx at the end
+	  of its stop bit lands in RXBUF with UCA0RXIFG (P1.1 has to be
+	  UCA0RXD), reading RXBUF clears it and UCOE. One coming in over a
+	  byte not read yet sets UCOE (EMU_rx_overruns). The USCI starts
+	  SMCLK for a byte by itself, so the low power modes don't matter.
+	- flash: the one region given to emu_flash, erased (a segment) and
+	  programmed (bytes can only go 1 -> 0) through FCTL1-3, the CPU held
+	  meanwhile for tERASE/tPROG flash clocks (FCTL2). A write while LOCK
+	  is set or out of ERASE/WRT is undone and sets ACCVIFG.
+	- resets (PUC): the watchdog, WDTCTL or FCTLx written without its key,
+	  an interrupt without a handler. They end the run, EMU_why says why.
+	- CPU: a register access takes EMU_ACCESS MCLK cycles, taking an
+	  interrupt 6 and reti 5, __delay_cycles its cycles (plus the
+	  interrupts that come in meanwhile). Everything else the code does
+	  takes no time, so EMU_irq_ps is a floor for each handler's length.
+
+	The status register (GIE and the LPM bits) is HOST_SR: a handler runs
+	with it cleared and returns to HOST_SR_exit, which
+	_bic_SR_register_on_exit changes. Sleeping with GIE off ends the run.
+	Time spent active and in each low power mode adds up in EMU_mode_ps.
+
+	The tool can drive inputs at times it picks by setting EMU_event_at and
+	emu_event, which is called when the virtual clock gets there. Output
+	changes call emu_ports, and each UART byte sent calls emu_uart.
+
+ ***********************************************************************/
+
+#ifndef HOST_HOSTEMU_H
+#define HOST_HOSTEMU_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "msp430g2553.h"
+
+#define EMU_PS		1000000000000ULL	// picoseconds in a second
+#define EMU_NEVER	(~0ULL)
+#define EMU_ACCESS	3		// MCLK cycles of an instruction with a register (absolute) operand
+#define EMU_ENTRY	6		// MCLK cycles from an interrupt to the first instruction of its handler
+#define EMU_RETI	5
+#define EMU_ERASE	4819	// flash clocks of a segment erase (tERASE)
+#define EMU_PROG	30		// and of programming a byte (tPROG + tBYTE/2 for a run)
+
+// what ended emu_run
+#define EMU_END		1		// the time it was given ran out
+#define EMU_RESET	2		// a reset, EMU_why says what caused it
+#define EMU_HALT	3		// the CPU went to sleep with GIE off, nothing can wake it
+
+#define EMU_ACTIVE	0		// EMU_mode_ps
+#define EMU_LPM0	1		// LPM0 and LPM1
+#define EMU_LPM3	2		// LPM2 and LPM3
+#define EMU_LPM4	3
+
+unsigned long long EMU_ps;				// virtual time since power up
+unsigned long long EMU_end;				// emu_run stops here
+unsigned long long EMU_mode_ps[4];		// time spent in each mode
+unsigned long long EMU_irq_ps[16];		// time spent in each handler, entry and reti included
+unsigned long EMU_irqs[16];				// runs of each handler
+unsigned long EMU_vlo_hz = 12000;		// the VLO of this chip, 4-20kHz over parts and temperature
+unsigned char EMU_in[3] = {0xFF, 0xFF, 0xFF};	// levels driven on the port pins, pulled up
+const char *EMU_why;					// the reset that ended emu_run
+unsigned long EMU_tx_overruns, EMU_rx_overruns, EMU_flash_erases, EMU_flash_bytes, EMU_flash_errors;
+unsigned long long EMU_tx_stalls;		// time a UART byte stood still with SMCLK off
+unsigned long long EMU_event_at = EMU_NEVER;	// emu_event runs then, it sets the next one
+void (*emu_event)(void);
+void (*emu_ports)(void);				// a port output, PxDIR or a timer output changed
+void (*emu_uart)(unsigned char);		// a byte left the UART
+unsigned long long EMU_uart_ps;			// time its stop bit ended, EMU_ps may not be there yet
+
+struct emu_timer {
+	volatile unsigned short *ctl, *r, *iv, *cctl[3], *ccr[3];
+	unsigned char vec0, vec1;			// vectors of CCR0 and of the rest
+	unsigned short count;				// TAR
+	unsigned long long next;			// time of its next count, 0 while it doesn't count
+	unsigned long long aclk;			// time of the next ACLK edge it can capture, 0 while off
+	unsigned long toggles[3];			// OUTMOD_4 toggles of each output
+};
+
+struct emu_timer EMU_timers[2] = {
+	{.ctl = &HOST_TA0CTL, .r = &HOST_TA0R, .iv = &HOST_TA0IV,
+		.cctl = {&HOST_TA0CCTL0, &HOST_TA0CCTL1, &HOST_TA0CCTL2},
+		.ccr = {&HOST_TA0CCR0, &HOST_TA0CCR1, &HOST_TA0CCR2}, .vec0 = 9, .vec1 = 8},
+	{.ctl = &HOST_TA1CTL, .r = &HOST_TA1R, .iv = &HOST_TA1IV,
+		.cctl = {&HOST_TA1CCTL0, &HOST_TA1CCTL1, &HOST_TA1CCTL2},
+		.ccr = {&HOST_TA1CCR0, &HOST_TA1CCR1, &HOST_TA1CCR2}, .vec0 = 13, .vec1 = 12}
+};
+
+static jmp_buf emu_stop;
+static unsigned short emu_wdtctl;		// WDTCTL as last seen
+static unsigned long long emu_wdt_next;	// time the watchdog interval ends, 0 while it is held
+static int emu_tx_byte = -1;			// byte in the shift register
+static int emu_txbuf = -1;				// byte waiting in TXBUF
+static unsigned long long emu_tx_end;	// time the shift register empties
+static unsigned char *emu_flash_mem, *emu_flash_was;
+static unsigned int emu_flash_size, emu_flash_seg;
+static unsigned char emu_outs[12];		// port outputs as emu_ports last saw them
+
+void emu_to(unsigned long long t);
+
+//-----Clocks-----
+
+unsigned long emu_dco_hz(void){
+	switch(HOST_BCSCTL1 & 0x0F){		// RSEL, DCOCTL picks within it
+		case 0x06:	return 1000000;		// CALBC1_1MHZ
+		case 0x0D:	return 8000000;		// CALBC1_8MHZ
+	}
+	return 1100000;
+}
+
+// length of a cycle of each clock, 0 while it is off
+unsigned long long emu_mclk_ps(void){
+	return (HOST_SR & CPUOFF) ? 0 : EMU_PS / emu_dco_hz();
+}
+
+unsigned long long emu_smclk_ps(void){
+	return (HOST_SR & SCG1) ? 0 : (EMU_PS << ((HOST_BCSCTL2 >> 1) & 3)) / emu_dco_hz();
+}
+
+unsigned long long emu_aclk_ps(void){
+	unsigned long hz = (HOST_BCSCTL3 & LFXT1S_2) ? EMU_vlo_hz : 32768;
+
+	return (HOST_SR & OSCOFF) ? 0 : (EMU_PS << ((HOST_BCSCTL1 >> 4) & 3)) / hz;
+}
+
+// stop the run, from wherever in the firmware it is
+void emu_reset(const char *why){
+	EMU_why = why;
+	longjmp(emu_stop, EMU_RESET);
+}
+
+//-----Timer_A-----
+
+// time of one count, 0 while the timer stands still
+unsigned long long emu_timer_ps(struct emu_timer *t){
+	unsigned short ctl = *t->ctl;
+	unsigned long long ps;
+
+	if(!(ctl & MC_3) || (((ctl & MC_3) != MC_2) && (*t->ccr[0] == 0)))
+		return 0;						// stopped, or up mode to 0
+	switch(ctl & 0x0300){
+		case TASSEL_1:	ps = emu_aclk_ps();	break;
+		case TASSEL_2:	ps = emu_smclk_ps();	break;
+		default:		return 0;		// TACLK and INCLK aren't wired
+	}
+	return ps << ((ctl >> 6) & 3);
+}
+
+// the count the timer goes back to 0 after
+unsigned long emu_timer_top(struct emu_timer *t){
+	return ((*t->ctl & MC_3) == MC_2) ? 0xFFFF : *t->ccr[0];
+}
+
+// counts until compare x matches, x = 3 for TAIFG, 0 if it never does
+unsigned long emu_timer_steps(struct emu_timer *t, int x){
+	unsigned long c = t->count, top = emu_timer_top(t), ccr;
+	unsigned long wrap = (c > top) ? 0x10000 - c : top - c + 1;
+
+	if(x == 3)
+		return wrap;
+	ccr = *t->ccr[x];
+	if((*t->cctl[x] & CAP) || (ccr > top))
+		return 0;
+	return (c < ccr) ? ccr - c : wrap + ccr;
+}
+
+// compare x matched k times, OUTMOD sets its output
+void emu_timer_out(struct emu_timer *t, int x, unsigned long long k){
+	unsigned short cctl = *t->cctl[x];
+
+	*t->cctl[x] |= CCIFG;
+	switch(cctl & OUTMOD_7){
+		case OUTMOD_1:	cctl |= OUT;	break;
+		case OUTMOD_4:
+			t->toggles[x] += k;
+			if(k & 1)
+				cctl ^= OUT;
+			break;
+		case OUTMOD_5:	cctl &= ~OUT;	break;
+	}
+	if((cctl ^ *t->cctl[x]) & OUT)
+		*t->cctl[x] ^= OUT;
+}
+
+// n counts of the timer
+void emu_timer_count(struct emu_timer *t, unsigned long long n){
+	unsigned long long cycle = emu_timer_top(t) + 1, d;
+	int x;
+
+	for(x = 0; x < 3; x++){
+		d = emu_timer_steps(t, x);
+		if(d && (n >= d))
+			emu_timer_out(t, x, 1 + (n - d) / cycle);
+	}
+	d = emu_timer_steps(t, 3);
+	if(n >= d){
+		*t->ctl |= TAIFG;
+		t->count = (n - d) % cycle;
+	}
+	else
+		t->count += n;
+}
+
+// capture x takes the count, a capture still unread is overwritten (COV)
+void emu_capture(struct emu_timer *t, int x, unsigned short count){
+	if(*t->cctl[x] & CCIFG)
+		*t->cctl[x] |= COV;
+	*t->ccr[x] = count;
+	*t->cctl[x] |= CCIFG;
+}
+
+// run the timer up to time to
+void emu_timer_to(struct emu_timer *t, unsigned long long to){
+	unsigned long long ps = emu_timer_ps(t), aps, n, edge;
+
+	if(*t->ctl & TACLR){
+		*t->ctl &= ~TACLR;
+		t->count = *t->r = 0;			// not a write to TAR
+		t->next = 0;
+	}
+	if(*t->r != t->count)				// the firmware wrote TAR
+		t->count = *t->r;
+	if(ps == 0)
+		t->next = 0;
+	else{
+		if(t->next == 0)
+			t->next = EMU_ps + ps;
+		if(to >= t->next){
+			n = (to - t->next) / ps + 1;
+			t->next += n * ps;
+			emu_timer_count(t, n);
+		}
+	}
+	// TA0 CCR0 capturing ACLK (CCI0B), one edge a cycle whichever CM picks
+	aps = emu_aclk_ps();
+	if((t == &EMU_timers[0]) && (*t->cctl[0] & CAP) && ((*t->cctl[0] & 0x3000) == CCIS_1)
+	&& (*t->cctl[0] & CM_3) && aps){
+		if(t->aclk == 0)
+			t->aclk = EMU_ps + aps;
+		if(to >= t->aclk){
+			n = (to - t->aclk) / aps + 1;
+			edge = t->aclk + (n - 1) * aps;
+			t->aclk += n * aps;
+			emu_capture(t, 0, t->count - (ps ? (to - edge) / ps : 0));
+		}
+	}
+	else
+		t->aclk = 0;
+	*t->r = t->count;
+}
+
+// time the timer next raises an interrupt that is enabled, EMU_NEVER if it doesn't
+unsigned long long emu_timer_next(struct emu_timer *t){
+	unsigned long long ps = emu_timer_ps(t), at = EMU_NEVER, when;
+	unsigned long d;
+	int x;
+
+	if(ps == 0)
+		return EMU_NEVER;
+	for(x = 0; x <= 3; x++){
+		if((x < 3) ? !(*t->cctl[x] & CCIE) : !(*t->ctl & TAIE))
+			continue;
+		d = emu_timer_steps(t, x);
+		if(d == 0)
+			continue;
+		when = (t->next ? t->next : EMU_ps + ps) + (d - 1) * ps;
+		at = (when < at) ? when : at;
+	}
+	if(t->aclk && (*t->cctl[0] & CCIE) && (t->aclk < at))
+		at = t->aclk;
+	return at;
+}
+
+// TAxIV shows the highest flag that is enabled, and reading it clears that one
+void emu_timer_iv(struct emu_timer *t){
+	int x;
+
+	for(x = 1; x < 3; x++){
+		if((*t->cctl[x] & (CCIE | CCIFG)) == (CCIE | CCIFG)){
+			*t->cctl[x] &= ~CCIFG;
+			*t->iv = 2 * x;
+			return;
+		}
+	}
+	if((*t->ctl & (TAIE | TAIFG)) == (TAIE | TAIFG)){
+		*t->ctl &= ~TAIFG;
+		*t->iv = 0x0A;
+		return;
+	}
+	*t->iv = 0;
+}
+
+//-----Watchdog-----
+
+unsigned long long emu_wdt_ps(void){
+	static const unsigned long INTERVAL[4] = {32768, 8192, 512, 64};
+	unsigned long long ps = (HOST_WDTCTL & WDTSSEL) ? emu_aclk_ps() : emu_smclk_ps();
+
+	return (HOST_WDTCTL & WDTHOLD) ? 0 : ps * INTERVAL[HOST_WDTCTL & 3];
+}
+
+void emu_wdt_to(unsigned long long to){
+	unsigned long long ps = emu_wdt_ps();
+
+	if(HOST_WDTCTL != emu_wdtctl){
+		if((HOST_WDTCTL & 0xFF00) != WDTPW)
+			emu_reset("WDTCTL written without WDTPW");
+		HOST_WDTCTL &= ~WDTCNTCL;
+		emu_wdtctl = HOST_WDTCTL;
+		emu_wdt_next = 0;
+	}
+	if(ps == 0){
+		emu_wdt_next = 0;
+		return;
+	}
+	if(emu_wdt_next == 0)
+		emu_wdt_next = EMU_ps + ps;
+	if(to >= emu_wdt_next){
+		if(!(HOST_WDTCTL & WDTTMSEL))
+			emu_reset("the watchdog timed out");
+		emu_wdt_next += ((to - emu_wdt_next) / ps + 1) * ps;
+		HOST_IFG1 |= WDTIFG;
+	}
+}
+
+//-----UART-----
+
+// bit time of USCI_A0, from BRCLK = SMCLK (0 while it is off)
+unsigned long long emu_bit_ps(void){
+	unsigned long br = HOST_UCA0BR0 | (HOST_UCA0BR1 << 8);
+
+	return emu_smclk_ps() * (8 * br + ((HOST_UCA0MCTL >> 1) & 7)) / 8;
+}
+
+// move TXBUF into the shift register if that is empty, at time at
+void emu_tx_load(unsigned long long at){
+	if((emu_tx_byte >= 0) || (emu_txbuf < 0))
+		return;
+	emu_tx_byte = emu_txbuf;
+	emu_txbuf = -1;
+	emu_tx_end = at + 10 * emu_bit_ps();
+	HOST_IFG2 |= UCA0TXIFG;
+	HOST_UCA0STAT |= UCBUSY;
+}
+
+// take a byte the firmware wrote to TXBUF
+void emu_tx_sync(void){
+	if(HOST_UCA0CTL1 & UCSWRST){
+		emu_txbuf = emu_tx_byte = -1;
+		HOST_IFG2 |= UCA0TXIFG;
+		HOST_UCA0STAT &= ~UCBUSY;
+		HOST_UCA0TXBUF = 0x100;
+		return;
+	}
+	if(HOST_UCA0TXBUF < 0x100){
+		if(emu_txbuf >= 0)
+			EMU_tx_overruns++;
+		emu_txbuf = HOST_UCA0TXBUF;
+		HOST_UCA0TXBUF = 0x100;
+		HOST_IFG2 &= ~UCA0TXIFG;
+		emu_tx_load(EMU_ps);
+	}
+}
+
+void emu_tx_to(unsigned long long to){
+	if(emu_tx_byte < 0)
+		return;
+	if(emu_smclk_ps() == 0){			// BRCLK is off, the byte waits
+		EMU_tx_stalls += to - EMU_ps;
+		emu_tx_end += to - EMU_ps;
+		return;
+	}
+	if(to < emu_tx_end)
+		return;
+	EMU_uart_ps = emu_tx_end;
+	if(emu_uart)
+		emu_uart(emu_tx_byte);
+	emu_tx_byte = -1;
+	HOST_UCA0STAT &= ~UCBUSY;
+	emu_tx_load(emu_tx_end);
+}
+
+// a byte's stop bit came in on UCA0RXD now, lost unless the USCI is set up to take it
+void emu_uart_rx(unsigned char c){
+	if((HOST_UCA0CTL1 & UCSWRST) || !(HOST_P1SEL & HOST_P1SEL2 & 0x02))
+		return;
+	if(HOST_IFG2 & UCA0RXIFG){
+		HOST_UCA0STAT |= UCOE;
+		EMU_rx_overruns++;
+	}
+	HOST_UCA0RXBUF = c;
+	HOST_IFG2 |= UCA0RXIFG;
+}
+
+//-----Flash-----
+
+// the firmware's flash is mem, size bytes of seg byte segments
+void emu_flash(unsigned char *mem, unsigned int size, unsigned int seg){
+	emu_flash_mem = mem;
+	emu_flash_size = size;
+	emu_flash_seg = seg;
+	free(emu_flash_was);
+	emu_flash_was = malloc(size);
+	memcpy(emu_flash_was, mem, size);
+}
+
+// take the bytes the firmware wrote to flash since the last look, returns how
+// long the flash controller holds the CPU for them
+unsigned long long emu_flash_sync(void){
+	unsigned long long clock, hold = 0;
+	unsigned int i, seg;
+
+	if((HOST_FCTL1 & 0xFF00) != FWKEY || (HOST_FCTL2 & 0xFF00) != FWKEY || (HOST_FCTL3 & 0xFF00) != FWKEY)
+		emu_reset("FCTLx written without FWKEY");
+	if(!emu_flash_mem || !memcmp(emu_flash_mem, emu_flash_was, emu_flash_size))
+		return 0;
+	switch(HOST_FCTL2 & 0xC0){
+		case 0x00:	clock = emu_aclk_ps();	break;
+		case 0x40:	clock = EMU_PS / emu_dco_hz();	break;
+		default:	clock = (EMU_PS << ((HOST_BCSCTL2 >> 1) & 3)) / emu_dco_hz();	break;
+	}
+	clock *= (HOST_FCTL2 & 0x3F) + 1;
+	for(i = 0; i < emu_flash_size; i++){
+		if(emu_flash_mem[i] == emu_flash_was[i])
+			continue;
+		if(!(HOST_FCTL3 & LOCK) && (HOST_FCTL1 & ERASE)){
+			seg = i - i % emu_flash_seg;
+			memset(emu_flash_mem + seg, 0xFF, emu_flash_seg);
+			memset(emu_flash_was + seg, 0xFF, emu_flash_seg);
+			hold += EMU_ERASE * clock;
+			EMU_flash_erases++;
+			i = seg + emu_flash_seg - 1;
+		}
+		else if(!(HOST_FCTL3 & LOCK) && (HOST_FCTL1 & WRT)){
+			if(emu_flash_mem[i] & ~emu_flash_was[i])
+				EMU_flash_errors++;		// a 0 bit can't be programmed back to 1
+			emu_flash_mem[i] &= emu_flash_was[i];
+			emu_flash_was[i] = emu_flash_mem[i];
+			hold += EMU_PROG * clock;
+			EMU_flash_bytes++;
+		}
+		else{
+			emu_flash_mem[i] = emu_flash_was[i];
+			HOST_FCTL3 |= ACCVIFG;
+			EMU_flash_errors++;
+		}
+	}
+	return hold;
+}
+
+//-----Ports-----
+
+// drive the pins mask of port (1-3) to level, raising PxIFG and timer captures
+void emu_pin(int port, unsigned char mask, int level){
+	volatile unsigned char *ifg = (port == 1) ? &HOST_P1IFG : &HOST_P2IFG;
+	volatile unsigned char *ies = (port == 1) ? &HOST_P1IES : &HOST_P2IES;
+	unsigned char old = EMU_in[port - 1], now = level ? (old | mask) : (old & ~mask);
+	unsigned char moved = old ^ now, rising = moved & now;
+	struct emu_timer *t = &EMU_timers[0];
+	int x;
+
+	EMU_in[port - 1] = now;
+	if(port < 3)
+		*ifg |= moved & (rising ^ *ies);	// PxIES 0: 0->1, 1: 1->0
+	if(port != 1)
+		return;
+	for(x = 0; x < 2; x++){				// P1.1 is TA0 CCI0A, P1.2 CCI1A
+		if(!(moved & HOST_P1SEL & (0x02 << x)) || !(*t->cctl[x] & CAP) || (*t->cctl[x] & 0x3000))
+			continue;
+		if(*t->cctl[x] & ((rising & (0x02 << x)) ? CM_1 : CM_2))
+			emu_capture(t, x, t->count);
+	}
+}
+
+// PxIN reads the driven levels on inputs and PxOUT on outputs, emu_ports
+// hears of every change of an output
+void emu_ports_sync(void){
+	unsigned char outs[12];
+	int x;
+
+	outs[0] = HOST_P1OUT;	outs[1] = HOST_P1DIR;	outs[2] = HOST_P1SEL;
+	outs[3] = HOST_P2OUT;	outs[4] = HOST_P2DIR;	outs[5] = HOST_P2SEL;
+	outs[6] = HOST_P3OUT;	outs[7] = HOST_P3DIR;	outs[8] = HOST_P3SEL;
+	outs[9] = outs[10] = outs[11] = 0;
+	for(x = 0; x < 3; x++){
+		outs[9] |= (*EMU_timers[0].cctl[x] & OUT) << x;
+		outs[10] |= (*EMU_timers[1].cctl[x] & OUT) << x;
+	}
+	if(memcmp(outs, emu_outs, sizeof outs)){
+		memcpy(emu_outs, outs, sizeof outs);
+		if(emu_ports)
+			emu_ports();				// it may drive pins in answer, a model of the LCD does
+	}
+	HOST_P1IN = (EMU_in[0] & ~HOST_P1DIR) | (HOST_P1OUT & HOST_P1DIR);
+	HOST_P2IN = (EMU_in[1] & ~HOST_P2DIR) | (HOST_P2OUT & HOST_P2DIR);
+	HOST_P3IN = (EMU_in[2] & ~HOST_P3DIR) | (HOST_P3OUT & HOST_P3DIR);
+}
+
+// level of an output pin, through PxSEL to the timer outputs of port 1
+// (P1.1/P1.5 TA0.0, P1.2/P1.6 TA0.1)
+int emu_out(int port, unsigned char bit){
+	volatile unsigned char *out = (port == 1) ? &HOST_P1OUT : (port == 2) ? &HOST_P2OUT : &HOST_P3OUT;
+
+	if((port == 1) && (HOST_P1SEL & bit) && !(HOST_P1SEL2 & bit)){
+		if(bit & 0x22)
+			return (*EMU_timers[0].cctl[0] & OUT) != 0;
+		if(bit & 0x44)
+			return (*EMU_timers[0].cctl[1] & OUT) != 0;
+	}
+	return (*out & bit) != 0;
+}
+
+//-----CPU-----
+
+// the highest priority interrupt that is pending and enabled, -1 for none
+int emu_pending(void){
+	struct emu_timer *t;
+	int i, x;
+
+	for(i = 1; i >= 0; i--){
+		t = &EMU_timers[i];
+		if((*t->cctl[0] & (CCIE | CCIFG)) == (CCIE | CCIFG))
+			return t->vec0;
+		for(x = 1; x < 3; x++)
+			if((*t->cctl[x] & (CCIE | CCIFG)) == (CCIE | CCIFG))
+				return t->vec1;
+		if((*t->ctl & (TAIE | TAIFG)) == (TAIE | TAIFG))
+			return t->vec1;
+		if((i == 1) && (HOST_IE1 & HOST_IFG1 & WDTIFG) && (HOST_WDTCTL & WDTTMSEL))
+			return 10;					// between TIMER1 and TIMER0
+	}
+	if(HOST_IE2 & HOST_IFG2 & UCA0RXIFG)
+		return 7;
+	if(HOST_IE2 & HOST_IFG2 & UCA0TXIFG)
+		return 6;
+	if(HOST_P2IE & HOST_P2IFG)
+		return 3;
+	if(HOST_P1IE & HOST_P1IFG)
+		return 2;
+	return -1;
+}
+
+// run handler v, the way the CPU takes an interrupt
+void emu_interrupt(int v){
+	unsigned short sr_exit = HOST_SR_exit;
+	unsigned long long start = EMU_ps;
+
+	if(HOST_VECTORS[v] == NULL)
+		emu_reset("an interrupt without a handler");
+	if(v == 9 || v == 13)				// single source flags clear themselves
+		*EMU_timers[v == 13].cctl[0] &= ~CCIFG;
+	if(v == 10)
+		HOST_IFG1 &= ~WDTIFG;
+	HOST_SR_exit = HOST_SR;
+	HOST_SR = 0;						// GIE off, the CPU and its clocks on
+	emu_to(EMU_ps + EMU_ENTRY * emu_mclk_ps());
+	EMU_irqs[v]++;
+	HOST_VECTORS[v]();
+	emu_to(EMU_ps + EMU_RETI * emu_mclk_ps());
+	HOST_SR = HOST_SR_exit;
+	HOST_SR_exit = sr_exit;
+	EMU_irq_ps[v] += EMU_ps - start;
+}
+
+void emu_dispatch(void){
+	int v;
+
+	while((HOST_SR & GIE) && ((v = emu_pending()) >= 0))
+		emu_interrupt(v);
+}
+
+// the next time something can happen without the CPU: an enabled
+// interrupt, a UART byte ending, the tool's event or the end of the run
+unsigned long long emu_next(void){
+	unsigned long long at = EMU_end, t;
+	int i;
+
+	at = (EMU_event_at < at) ? EMU_event_at : at;
+	if((emu_tx_byte >= 0) && (emu_tx_end < at))
+		at = emu_tx_end;
+	for(i = 0; i < 2; i++){
+		t = emu_timer_next(&EMU_timers[i]);
+		at = (t < at) ? t : at;
+	}
+	if(emu_wdt_ps() && (!(HOST_WDTCTL & WDTTMSEL) || (HOST_IE1 & WDTIE))){
+		t = emu_wdt_next ? emu_wdt_next : EMU_ps + emu_wdt_ps();
+		at = (t < at) ? t : at;
+	}
+	return (at > EMU_ps) ? at : EMU_ps + 1;
+}
+
+// the peripherals from EMU_ps to t, with nothing happening in between
+void emu_step(unsigned long long t){
+	int mode = EMU_ACTIVE;
+
+	emu_timer_to(&EMU_timers[0], t);
+	emu_timer_to(&EMU_timers[1], t);
+	emu_wdt_to(t);
+	emu_tx_to(t);
+	if(HOST_SR & CPUOFF)
+		mode = (HOST_SR & OSCOFF) ? EMU_LPM4 : (HOST_SR & SCG1) ? EMU_LPM3 : EMU_LPM0;
+	EMU_mode_ps[mode] += t - EMU_ps;
+	EMU_ps = t;
+}
+
+// move the virtual clock to t (and on for as long as flash holds the CPU),
+// stopping at every UART byte and tool event on the way
+void emu_to(unsigned long long t){
+	unsigned long long at;
+
+	emu_tx_sync();
+	t += emu_flash_sync();
+	for(;;){
+		emu_ports_sync();
+		if(EMU_event_at <= EMU_ps){
+			EMU_event_at = EMU_NEVER;
+			if(emu_event)
+				emu_event();
+			continue;
+		}
+		if(EMU_ps >= EMU_end)
+			longjmp(emu_stop, EMU_END);
+		if(EMU_ps >= t)
+			break;
+		at = (t < EMU_end) ? t : EMU_end;
+		at = (EMU_event_at < at) ? EMU_event_at : at;
+		if((emu_tx_byte >= 0) && (emu_tx_end < at))
+			at = emu_tx_end;
+		emu_step((at > EMU_ps) ? at : EMU_ps + 1);
+	}
+	*EMU_timers[0].r = EMU_timers[0].count;
+	*EMU_timers[1].r = EMU_timers[1].count;
+}
+
+// HOST_access: every register access takes EMU_ACCESS cycles, interrupts
+// come in between them
+void emu_access(const volatile void *reg){
+	emu_to(EMU_ps + EMU_ACCESS * emu_mclk_ps());
+	emu_dispatch();
+	if(reg == &HOST_TA0IV)
+		emu_timer_iv(&EMU_timers[0]);
+	else if(reg == &HOST_TA1IV)
+		emu_timer_iv(&EMU_timers[1]);
+	else if(reg == &HOST_UCA0RXBUF){
+		HOST_IFG2 &= ~UCA0RXIFG;
+		HOST_UCA0STAT &= ~UCOE;
+	}
+}
+
+// HOST_sr: wait out __delay_cycles, take the interrupts GIE lets in and
+// sleep while CPUOFF is set
+void emu_sr(void){
+	unsigned long long end, t;
+
+	if(HOST_delay){
+		end = EMU_ps + HOST_delay * emu_mclk_ps();
+		HOST_delay = 0;
+		while(EMU_ps < end){
+			t = emu_next();
+			emu_to((t < end) ? t : end);
+			t = EMU_ps;
+			emu_dispatch();
+			end += EMU_ps - t;				// the handlers took their cycles out of the wait
+		}
+	}
+	emu_dispatch();
+	while(HOST_SR & CPUOFF){
+		if(!(HOST_SR & GIE))
+			longjmp(emu_stop, EMU_HALT);
+		emu_to(emu_next());
+		emu_dispatch();
+	}
+}
+
+// the registers as a power up leaves them
+void emu_power_up(void){
+	int i, x;
+
+	HOST_access = emu_access;
+	HOST_sr = emu_sr;
+	HOST_SR = HOST_SR_exit = 0;
+	HOST_delay = 0;
+	EMU_ps = 0;
+	memset(EMU_mode_ps, 0, sizeof EMU_mode_ps);
+	memset(EMU_irq_ps, 0, sizeof EMU_irq_ps);
+	memset(EMU_irqs, 0, sizeof EMU_irqs);
+	EMU_why = NULL;
+	EMU_tx_overruns = EMU_rx_overruns = EMU_flash_erases = EMU_flash_bytes = EMU_flash_errors = 0;
+	EMU_tx_stalls = 0;
+	HOST_WDTCTL = emu_wdtctl = WDTPW;	// the watchdog runs, SMCLK / 32768
+	emu_wdt_next = 0;
+	HOST_IE1 = HOST_IFG1 = HOST_IE2 = 0;
+	HOST_IFG2 = UCA0TXIFG;
+	HOST_BCSCTL1 = 0x87;
+	HOST_BCSCTL2 = 0;
+	HOST_BCSCTL3 = 0x05;
+	HOST_DCOCTL = 0x60;
+	HOST_CALBC1_1MHZ = 0x86;
+	HOST_CALDCO_1MHZ = 0xB2;
+	HOST_CALBC1_8MHZ = 0x8D;
+	HOST_CALDCO_8MHZ = 0x84;
+	HOST_P1OUT = HOST_P1DIR = HOST_P1IFG = HOST_P1IES = HOST_P1IE = HOST_P1SEL = HOST_P1SEL2 = HOST_P1REN = 0;
+	HOST_P2OUT = HOST_P2DIR = HOST_P2IFG = HOST_P2IES = HOST_P2IE = HOST_P2SEL2 = HOST_P2REN = 0;
+	HOST_P2SEL = 0xC0;					// XIN/XOUT
+	HOST_P3OUT = HOST_P3DIR = HOST_P3SEL = HOST_P3SEL2 = HOST_P3REN = 0;
+	for(i = 0; i < 2; i++){
+		*EMU_timers[i].ctl = *EMU_timers[i].r = *EMU_timers[i].iv = 0;
+		for(x = 0; x < 3; x++){
+			*EMU_timers[i].cctl[x] = *EMU_timers[i].ccr[x] = 0;
+			EMU_timers[i].toggles[x] = 0;
+		}
+		EMU_timers[i].count = 0;
+		EMU_timers[i].next = EMU_timers[i].aclk = 0;
+	}
+	HOST_FCTL1 = FWKEY;
+	HOST_FCTL2 = FWKEY + FSSEL_1 + 2;
+	HOST_FCTL3 = FWKEY + LOCK;
+	HOST_UCA0CTL0 = HOST_UCA0BR0 = HOST_UCA0BR1 = HOST_UCA0MCTL = HOST_UCA0STAT = 0;
+	HOST_UCA0CTL1 = UCSWRST;
+	HOST_UCA0TXBUF = 0x100;
+	HOST_UCA0RXBUF = 0;
+	emu_txbuf = emu_tx_byte = -1;
+	memset(emu_outs, 0, sizeof emu_outs);
+}
+
+// power up and run firmware (its main) for seconds of virtual time, returns
+// EMU_END, EMU_RESET or EMU_HALT. A main that returns ends up in the
+// loop after it, with the CPU on.
+int emu_run(void (*firmware)(void), double seconds){
+	int why;
+
+	emu_power_up();
+	EMU_end = seconds * EMU_PS;
+	why = setjmp(emu_stop);
+	if(why == 0){
+		firmware();
+		HOST_SR &= ~(CPUOFF | SCG0 | SCG1 | OSCOFF);
+		for(;;){
+			emu_to(emu_next());
+			emu_dispatch();
+		}
+	}
+	HOST_access = NULL;
+	HOST_sr = NULL;
+	return why;
+}
+
+#endif
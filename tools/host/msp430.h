@@ -0,0 +1,2 @@
+// Host stand-in for msp430.h, the device is always the MSP430G2553
+#include "msp430g2553.h"
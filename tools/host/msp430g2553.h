@@ -0,0 +1,264 @@
+/***********************************************************************
+	Host stand-in for msp430g2553.h, for building firmware on the PC
+
+	Enough for all six programs: laserTag/Seize&Secure.c (ssreplay),
+	blinkSOS/blinkSOS_main.c (morsebench), blinkSOS_WDT/blinkSOS_WDT.c
+	(sospower), LEDrecorder/recordLED.c (ledbench, ledflash),
+	reactionTimer/rxnTimer.c and synthesizer/synthesizer.c (msprun).
+	Include it from the one file that includes the firmware, the registers
+	are defined here.
+
+	Registers are volatile variables, each access first calls HOST_access
+	with the register's address. Without an emulator (HOST_access NULL)
+	the host program drives them itself: it sets HOST_ticks (ACLK ticks
+	since the firmware cleared Timer A0, TA0R and TA1R read its low word),
+	raises CCIFG in TA0CCTLn when TA0R reaches TA0CCRn, loads TA0IV and
+	calls the handlers. A tool that defines HOST_ACCESS as its own
+	function before including this has every access call that instead,
+	directly. Nothing sleeps or waits then, the status register
+	bits are only kept in HOST_SR and __delay_cycles returns at once.
+	host/hostemu.h installs an emulator in the hooks instead, with a
+	virtual clock that runs the peripherals and calls the handlers
+	ISR_VECTOR registered in HOST_VECTORS.
+
+	The firmware counts on 16 bit ints wrapping, so the tools define int
+	as short around it.
+
+ ***********************************************************************/
+
+#ifndef HOST_MSP430G2553_H
+#define HOST_MSP430G2553_H
+
+#define interrupt
+
+// what CCS takes in the firmware and gcc would warn of: the linker pragmas
+// (LOCATION, NOINIT) that only mean something on the chip, FSM actions that
+// don't all use the argument their table passes, and a main that ends in the
+// sleep it never wakes from
+#pragma GCC diagnostic ignored "-Wunknown-pragmas"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wreturn-type"
+
+void (*HOST_VECTORS[16])(void);	// handler of each interrupt vector (.int00-.int15)
+
+// ISR_VECTOR(handler, ".intNN") puts handler in HOST_VECTORS[NN] before main runs
+#define ISR_VECTOR(handler, vector) \
+	__attribute__((constructor)) static void HOST_vector_##handler(void){ \
+		HOST_VECTORS[(vector[4] - '0') * 10 + vector[5] - '0'] = (void (*)(void))handler; \
+	}
+
+unsigned long HOST_ticks;
+void (*HOST_access)(const volatile void *);	// called before every register access, see host/hostemu.h
+void (*HOST_sr)(void);		// called when the CPU may sleep, take an interrupt or wait HOST_delay
+unsigned short HOST_SR;		// status register bits GIE, CPUOFF, OSCOFF, SCG0, SCG1
+unsigned short HOST_SR_exit;	// the status register a handler returns to, see _bic_SR_register_on_exit
+unsigned long HOST_delay;	// MCLK cycles __delay_cycles still has to wait
+
+volatile unsigned short HOST_TA0R, HOST_TA1R;
+
+static inline void HOST_touch(const volatile void *reg){
+#ifdef HOST_ACCESS
+	HOST_ACCESS(reg);		// a tool's own hook, called directly so it can be inlined
+#else
+	if(HOST_access)
+		HOST_access(reg);
+	else
+		HOST_TA0R = HOST_TA1R = (unsigned short)HOST_ticks;
+#endif
+}
+
+#define HOST_REG(name)	(*(HOST_touch(&HOST_##name), &HOST_##name))
+
+volatile unsigned short HOST_WDTCTL;
+volatile unsigned char HOST_IE1, HOST_IFG1, HOST_IE2, HOST_IFG2;
+volatile unsigned char HOST_BCSCTL1, HOST_BCSCTL2, HOST_BCSCTL3, HOST_DCOCTL;
+volatile unsigned char HOST_CALBC1_1MHZ, HOST_CALDCO_1MHZ, HOST_CALBC1_8MHZ, HOST_CALDCO_8MHZ;
+volatile unsigned char HOST_P1OUT, HOST_P1IN, HOST_P1DIR, HOST_P1IFG, HOST_P1IES, HOST_P1IE, HOST_P1SEL, HOST_P1SEL2, HOST_P1REN;
+volatile unsigned char HOST_P2OUT, HOST_P2IN, HOST_P2DIR, HOST_P2IFG, HOST_P2IES, HOST_P2IE, HOST_P2SEL, HOST_P2SEL2, HOST_P2REN;
+volatile unsigned char HOST_P3OUT, HOST_P3IN, HOST_P3DIR, HOST_P3SEL, HOST_P3SEL2, HOST_P3REN;
+volatile unsigned short HOST_TA0CTL, HOST_TA0IV, HOST_TA0CCTL0, HOST_TA0CCTL1, HOST_TA0CCTL2, HOST_TA0CCR0, HOST_TA0CCR1, HOST_TA0CCR2;
+volatile unsigned short HOST_TA1CTL, HOST_TA1IV, HOST_TA1CCTL0, HOST_TA1CCTL1, HOST_TA1CCTL2, HOST_TA1CCR0, HOST_TA1CCR1, HOST_TA1CCR2;
+volatile unsigned short HOST_FCTL1, HOST_FCTL2, HOST_FCTL3;
+volatile unsigned char HOST_UCA0CTL0, HOST_UCA0CTL1, HOST_UCA0BR0, HOST_UCA0BR1, HOST_UCA0MCTL, HOST_UCA0STAT;
+volatile unsigned short HOST_UCA0TXBUF;	// a word, so an emulator can tell a byte written from one it has taken
+volatile unsigned char HOST_UCA0RXBUF;
+
+#define WDTCTL		HOST_REG(WDTCTL)
+#define IE1			HOST_REG(IE1)
+#define IFG1		HOST_REG(IFG1)
+#define IE2			HOST_REG(IE2)
+#define IFG2		HOST_REG(IFG2)
+#define UC0IE		IE2
+#define UC0IFG		IFG2
+#define BCSCTL1		HOST_REG(BCSCTL1)
+#define BCSCTL2		HOST_REG(BCSCTL2)
+#define BCSCTL3		HOST_REG(BCSCTL3)
+#define DCOCTL		HOST_REG(DCOCTL)
+#define CALBC1_1MHZ	HOST_REG(CALBC1_1MHZ)
+#define CALDCO_1MHZ	HOST_REG(CALDCO_1MHZ)
+#define CALBC1_8MHZ	HOST_REG(CALBC1_8MHZ)
+#define CALDCO_8MHZ	HOST_REG(CALDCO_8MHZ)
+#define P1OUT		HOST_REG(P1OUT)
+#define P1IN		HOST_REG(P1IN)
+#define P1DIR		HOST_REG(P1DIR)
+#define P1IFG		HOST_REG(P1IFG)
+#define P1IES		HOST_REG(P1IES)
+#define P1IE		HOST_REG(P1IE)
+#define P1SEL		HOST_REG(P1SEL)
+#define P1SEL2		HOST_REG(P1SEL2)
+#define P1REN		HOST_REG(P1REN)
+#define P2OUT		HOST_REG(P2OUT)
+#define P2IN		HOST_REG(P2IN)
+#define P2DIR		HOST_REG(P2DIR)
+#define P2IFG		HOST_REG(P2IFG)
+#define P2IES		HOST_REG(P2IES)
+#define P2IE		HOST_REG(P2IE)
+#define P2SEL		HOST_REG(P2SEL)
+#define P2SEL2		HOST_REG(P2SEL2)
+#define P2REN		HOST_REG(P2REN)
+#define P3OUT		HOST_REG(P3OUT)
+#define P3IN		HOST_REG(P3IN)
+#define P3DIR		HOST_REG(P3DIR)
+#define P3SEL		HOST_REG(P3SEL)
+#define P3SEL2		HOST_REG(P3SEL2)
+#define P3REN		HOST_REG(P3REN)
+#define TA0CTL		HOST_REG(TA0CTL)
+#define TA0R		HOST_REG(TA0R)
+#define TA0IV		HOST_REG(TA0IV)
+#define TA0CCTL0	HOST_REG(TA0CCTL0)
+#define TA0CCTL1	HOST_REG(TA0CCTL1)
+#define TA0CCTL2	HOST_REG(TA0CCTL2)
+#define TA0CCR0		HOST_REG(TA0CCR0)
+#define TA0CCR1		HOST_REG(TA0CCR1)
+#define TA0CCR2		HOST_REG(TA0CCR2)
+#define TA1CTL		HOST_REG(TA1CTL)
+#define TA1R		HOST_REG(TA1R)
+#define TA1IV		HOST_REG(TA1IV)
+#define TA1CCTL0	HOST_REG(TA1CCTL0)
+#define TA1CCTL1	HOST_REG(TA1CCTL1)
+#define TA1CCTL2	HOST_REG(TA1CCTL2)
+#define TA1CCR0		HOST_REG(TA1CCR0)
+#define TA1CCR1		HOST_REG(TA1CCR1)
+#define TA1CCR2		HOST_REG(TA1CCR2)
+// the older single timer names, Timer A0
+#define TACTL		TA0CTL
+#define TAR			TA0R
+#define TAIV		TA0IV
+#define TACCTL0		TA0CCTL0
+#define TACCTL1		TA0CCTL1
+#define TACCTL2		TA0CCTL2
+#define TACCR0		TA0CCR0
+#define TACCR1		TA0CCR1
+#define TACCR2		TA0CCR2
+#define FCTL1		HOST_REG(FCTL1)
+#define FCTL2		HOST_REG(FCTL2)
+#define FCTL3		HOST_REG(FCTL3)
+#define UCA0CTL0	HOST_REG(UCA0CTL0)
+#define UCA0CTL1	HOST_REG(UCA0CTL1)
+#define UCA0BR0		HOST_REG(UCA0BR0)
+#define UCA0BR1		HOST_REG(UCA0BR1)
+#define UCA0MCTL	HOST_REG(UCA0MCTL)
+#define UCA0STAT	HOST_REG(UCA0STAT)
+#define UCA0TXBUF	HOST_REG(UCA0TXBUF)
+#define UCA0RXBUF	HOST_REG(UCA0RXBUF)
+
+#define WDTPW		0x5A00
+#define WDTHOLD		0x0080
+#define WDTTMSEL	0x0010
+#define WDTCNTCL	0x0008
+#define WDTSSEL		0x0004
+#define WDTIS1		0x0002
+#define WDTIS0		0x0001
+#define WDTIE		0x01
+#define WDTIFG		0x01
+#define GIE			0x0008
+#define CPUOFF		0x0010
+#define OSCOFF		0x0020
+#define SCG0		0x0040
+#define SCG1		0x0080
+#define LPM0_bits	(CPUOFF)
+#define LPM1_bits	(SCG0 + CPUOFF)
+#define LPM3_bits	(SCG1 + SCG0 + CPUOFF)
+#define LPM4_bits	(SCG1 + SCG0 + OSCOFF + CPUOFF)
+#define DIVA_3		0x30
+#define LFXT1S_2	0x20
+#define DIVS_3		0x06
+#define TASSEL_1	0x0100
+#define TASSEL_2	0x0200
+#define ID_3		0x00C0
+#define MC_1		0x0010
+#define MC_2		0x0020
+#define MC_3		0x0030
+#define TACLR		0x0004
+#define TAIE		0x0002
+#define TAIFG		0x0001
+#define CM_1		0x4000
+#define CM_2		0x8000
+#define CM_3		0xC000
+#define CCIS_1		0x1000
+#define SCS			0x0800
+#define CAP			0x0100
+#define OUTMOD_1	0x0020
+#define OUTMOD_4	0x0080
+#define OUTMOD_5	0x00A0
+#define OUTMOD_7	0x00E0
+#define CCIE		0x0010
+#define CCI			0x0008
+#define OUT			0x0004
+#define COV			0x0002
+#define CCIFG		0x0001
+#define TA0IV_TACCR1	0x0002
+#define TA0IV_TACCR2	0x0004
+#define TA0IV_TAIFG		0x000A
+#define TA1IV_TACCR1	0x0002
+#define TA1IV_TACCR2	0x0004
+#define TA1IV_TAIFG		0x000A
+#define FWKEY		0xA500
+#define FSSEL_1		0x0040
+#define FSSEL_2		0x0080
+#define ERASE		0x0002
+#define WRT			0x0040
+#define LOCK		0x0010
+#define ACCVIFG		0x0004
+#define UCSWRST		0x01
+#define UCSSEL_2	0x80
+#define UCBRS_4		0x08
+#define UCBUSY		0x01
+#define UCOE		0x20
+#define UCA0RXIE	0x01
+#define UCA0TXIE	0x02
+#define UCA0RXIFG	0x01
+#define UCA0TXIFG	0x02
+
+static inline void _bis_SR_register(unsigned short bits){
+	HOST_SR |= bits;
+	if(HOST_sr)
+		HOST_sr();
+}
+static inline void _bic_SR_register_on_exit(unsigned short bits){ HOST_SR_exit &= ~bits; }
+static inline void _bis_SR_register_on_exit(unsigned short bits){ HOST_SR_exit |= bits; }
+static inline void _disable_interrupts(void){ HOST_SR &= ~GIE; }
+static inline void _enable_interrupts(void){ _bis_SR_register(GIE); }
+static inline void _no_operation(void){}
+static inline void __delay_cycles(unsigned long cycles){
+	HOST_delay += cycles;
+	if(HOST_sr)
+		HOST_sr();
+	HOST_delay = 0;
+}
+
+// DADD of two words, the carry out is lost
+static inline unsigned short __bcd_add_short(unsigned short a, unsigned short b){
+	unsigned int sum = 0, digit, carry = 0, i;
+
+	for(i = 0; i < 16; i += 4){
+		digit = ((a >> i) & 0xF) + ((b >> i) & 0xF) + carry;
+		carry = digit > 9;
+		if(carry)
+			digit -= 10;
+		sum |= digit << i;
+	}
+	return sum;
+}
+
+#endif
@@ -0,0 +1,472 @@
+/***********************************************************************
+	recordLED benchmark, runs on the PC (not the MSP430)
+
+	Builds LEDrecorder/recordLED.c on the host and records sample
+	sessions through its handlers: Timer A0 counts in HOST_ticks (8us),
+	the button's edges, each followed by a few bounces, raise P1IFG, and
+	TA0CCR0/1/2 compares and TA0R overflows call the timer handlers, in
+	the MSP430's priority order. Each session is recorded while the one
+	before it keeps playing back, then plays on its own for two loops. At
+	the end a lone tap plays the last one again from the beginning, and
+	double-clicks play it at each of the other speeds, two loops each.
+
+	For each session it prints how many lengths (presses and pauses) fit
+	in a bank of recordMemory and the bytes they took, and the CPU wakeups
+	per second while recording and while playing back, where the old WDT
+	version woke up every 8K/1.1MHz ~= 7.4ms. Next to them, the same
+	session on the old version's layout, its WDT handler run on a copy of
+	its globals: 16 bit counts of WDT intervals in int recordMemory[40]
+	(80 bytes of RAM, against the 2 banks now), recording until
+	recordCounter reached 35, and the most its green LED edges were off
+	when it played them back. Then the largest difference between when
+	the green LED should have moved, from the button's edges, and when it
+	did, over all of it, and at each speed. It fails if that is a tick or
+	more, or if a recording changed while it played back.
+
+	Build:	cc -O2 -Ihost -o ledbench ledbench.c -lm
+	Usage:	ledbench
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "msp430.h"
+
+unsigned char host_flash[4 * 512];	// the slots, left blank
+
+#define HOST_FLASH
+#define SAVE_FLASH host_flash
+#define main record_main
+#include "../LEDrecorder/recordLED.c"
+#undef main
+
+#define OLD_WORDS 40		// the old int recordMemory[40], 80 bytes of RAM
+#define OLD_LIMIT 35		// it stopped recording at recordCounter >= 35
+#define OLD_INTERVAL (8192 / 1.1e6 * TICKS_PER_S)	// ticks between its WDT interrupts, 8K/1.1MHz
+#define SESSIONS 3
+#define MAX_EDGES 1000
+#define MAX_LEDS 20000
+#define BOUNCES 3			// extra edges within the first ms of a press or release
+#define SPEEDS 5			// playShift -2 to 2
+#define WAIT_S 10			// seconds to wait before the first press, for the idle wakeups
+#define TICKS_PER_S (1000L * TICKS_PER_MS)
+
+long edges[SESSIONS][MAX_EDGES];	// times the button moved in each session, first a press
+int lengths[SESSIONS];				// lengths of each session that were recorded
+unsigned char banks[SESSIONS][RECORD_BYTES];	// each recording as it started playing back
+long leds[MAX_LEDS];		// times the green LED moved
+int nleds;
+unsigned char green;		// green LED as last seen
+long wakeups;
+double old_worst_all;		// ms the old version's LED was off by, over the sessions
+
+// the green LED should play session s from start until end, at 2^shift
+struct {
+	int s, shift, edges;
+	long start, end;
+	long loops;				// ticks until the third loop started
+	double worst;			// ticks the LED was off by
+} plays[SESSIONS + 1 + SPEEDS];
+int nplays;
+
+// flash as plain memory, nothing is saved here (see ledflash)
+void flash_erase(unsigned char *segment){
+	memset(segment, 0xFF, SAVE_SEG_SIZE);
+}
+
+void flash_write(unsigned char *dst, const unsigned char *src, unsigned char len){
+	memcpy(dst, src, len);
+}
+
+// button presses and pauses of a session, in ms
+typedef void session(int *press, int *pause);
+
+void taps(int *press, int *pause){			// quick presses
+	*press = 40 + rand() % 150;
+	*pause = 75 + rand() % 370;
+}
+
+void morse(int *press, int *pause){			// Morse code, a dot 90ms (~13 WPM)
+	*press = (rand() & 1) ? 90 : 270;
+	*pause = (rand() % 4 == 0) ? 270 : 90;
+}
+
+void holds(int *press, int *pause){			// long presses, mostly over a second
+	*press = 450 + rand() % 3000;
+	*pause = 150 + rand() % 1500;
+}
+
+// the old version, its WDT handler as it was, on its own copy of the globals
+struct {
+	int currentMode, lastButtonState, playLight, recordCounter;
+	short recordMemory[OLD_WORDS];	// 16 bit ints
+	int green;
+} old;
+
+void old_interval(int pressed){
+	if(!pressed){
+		if(old.currentMode == 0){
+			old.green = 0;
+			if(old.lastButtonState == 1){
+				old.lastButtonState = 0;
+				old.recordCounter++;
+			}
+			old.recordMemory[old.recordCounter]++;
+			if(old.recordMemory[old.recordCounter] >= 300){
+				old.currentMode = 1;
+				old.recordCounter = 0;
+			}
+		}
+		else if((old.currentMode == 1) && (old.recordCounter != -1)){
+			if(old.recordMemory[old.recordCounter] == 0){
+				old.recordCounter++;
+				old.playLight ^= 1;
+			}
+			else{
+				old.green = old.playLight;
+				old.recordMemory[old.recordCounter]--;
+			}
+		}
+	}
+	else{
+		if(old.currentMode == 0){
+			old.green = 1;
+			if(old.lastButtonState == 0){
+				old.lastButtonState = 1;
+				old.recordCounter++;
+			}
+			old.recordMemory[old.recordCounter]++;
+		}
+		else if(old.recordCounter == -1){
+			old.currentMode = 0;
+			old.lastButtonState = 1;
+			old.recordCounter = 0;
+			old.recordMemory[old.recordCounter] = 1;
+		}
+		else if(old.recordMemory[old.recordCounter] == 0){
+			old.recordCounter++;
+			old.playLight ^= 1;
+		}
+		else{
+			old.green = old.playLight;
+			old.recordMemory[old.recordCounter]--;
+		}
+	}
+	if(old.recordCounter >= OLD_LIMIT){
+		if(old.currentMode == 0){
+			old.currentMode = 1;
+			old.recordCounter = 0;
+		}
+		else{
+			old.recordCounter = -1;
+			old.green = 0;
+			old.playLight = 1;
+		}
+	}
+}
+
+// record session s on the old version, from waiting for a press, and play
+// it back: returns the lengths it kept, *worst the most ms a green LED edge
+// was off from the button's, both counted from the first press
+int old_session(int s, double *worst){
+	double led[2 * OLD_LIMIT + 2], t;
+	int k = 0, n = 0, kept = 0, green = 0, was, j;
+
+	memset(&old, 0, sizeof old);
+	old.currentMode = 1;
+	old.recordCounter = -1;
+	old.playLight = 1;
+	for(t = edges[s][0] - TICKS_PER_S; (n < 2 * OLD_LIMIT + 2) && (t < edges[s][MAX_EDGES - 3]); t += OLD_INTERVAL){
+		while((k < MAX_EDGES - 2) && (edges[s][k] <= t))
+			k++;
+		was = old.currentMode;
+		j = old.recordCounter;
+		old_interval(k & 1);			// it ignores the button while playing back
+		if((was == 0) && (old.currentMode == 1)){
+			kept = j + 1;				// it stopped recording, by the timeout or at OLD_LIMIT
+			old.green = 0;				// its playback's edges count from here
+		}
+		if(kept && (old.green != green)){
+			led[n++] = t;
+			green = old.green;
+		}
+		if(kept && (old.recordCounter == -1))
+			break;
+	}
+	*worst = 0;
+	for(j = 0; (j < n) && (j < kept); j++)
+		if(fabs((led[j] - led[0]) - (edges[s][j] - edges[s][0])) > *worst)
+			*worst = fabs((led[j] - led[0]) - (edges[s][j] - edges[s][0]));
+	*worst /= TICKS_PER_MS;
+	return kept;
+}
+
+// ticks from now until TA0R reads low, a whole wrap when it does now
+long until(unsigned int low){
+	unsigned int d = (unsigned short)(low - TA0R);
+
+	return d ? d : 0x10000;
+}
+
+// note when the green LED moves
+void led(){
+	if(((P1OUT & GREEN) != green) && (nleds < MAX_LEDS))
+		leds[nleds++] = HOST_ticks;
+	green = P1OUT & GREEN;
+}
+
+// the port interrupt, when it is raised
+void port(){
+	if(P1IFG & P1IE & BUTTON){
+		button_handler();
+		wakeups++;
+		led();
+	}
+}
+
+// move the button to pressed (1) or not
+void button(int pressed){
+	int was = !(P1IN & BUTTON);
+
+	if(pressed == was)
+		return;
+	P1IN = pressed ? 0 : BUTTON;
+	if((P1IES & BUTTON) ? pressed : !pressed)	// P1IES 1: 1->0, 0: 0->1
+		P1IFG |= BUTTON;
+	port();
+}
+
+// the time of the next compare of a CCRn, after end when it is off
+long compare(unsigned short cctl, unsigned short ccr, long end){
+	return (cctl & CCIE) ? (long)HOST_ticks + until(ccr) : end + 1;
+}
+
+// run the firmware until HOST_ticks reaches end
+void run_until(long end){
+	long t0, t1, t2, tov, t;
+
+	for(;;){
+		t0 = compare(TA0CCTL0, TA0CCR0, end);
+		t1 = compare(TA0CCTL1, TA0CCR1, end);
+		t2 = compare(TA0CCTL2, TA0CCR2, end);
+		tov = HOST_ticks + until(0);
+		t = t0 < t1 ? t0 : t1;
+		t = t < t2 ? t : t2;
+		t = t < tov ? t : tov;
+		if(t > end){
+			HOST_ticks = end;
+			return;
+		}
+		HOST_ticks = t;
+		if(t == tov)
+			TA0CTL |= TAIFG;
+		if(t == t0){					// .int09 first
+			compare_handler();
+			wakeups++;
+			led();
+		}
+		if(t == t1){					// then TA0IV, CCR1, CCR2, the overflow
+			TA0IV = TA0IV_TACCR1;
+			timer_handler();
+			wakeups++;
+		}
+		if((t == t2) && (TA0CCTL2 & CCIE)){
+			TA0IV = TA0IV_TACCR2;
+			timer_handler();
+			wakeups++;
+			led();
+		}
+		if((TA0CTL & TAIFG) && (TA0CTL & TAIE)){
+			TA0CTL &= ~TAIFG;
+			TA0IV = TA0IV_TAIFG;
+			timer_handler();
+			wakeups++;
+		}
+		port();
+	}
+}
+
+// ticks one loop of session s plays for at 1x, its last pause is TIMEOUT
+long period(int s){
+	return edges[s][lengths[s] - 1] - edges[s][0] + TIMEOUT;
+}
+
+// the green LED plays session s from time start on, at playShift
+void play(int s, long start){
+	if(nplays > 0)
+		plays[nplays - 1].end = start;
+	plays[nplays].s = s;
+	plays[nplays].shift = playShift;
+	plays[nplays].start = start;
+	plays[nplays].end = start;
+	nplays++;
+}
+
+// record session s while the last one plays back, then let it play
+// for two loops on its own, printing the results
+int run(const char *name, session *next, int s){
+	int n = 0, press, pause, b, k, at;
+	int old_lengths;
+	long t = HOST_ticks + TICKS_PER_S, start, rec_wakes;
+	double rec_s, old_worst;
+
+	wakeups = 0;
+	start = HOST_ticks;
+	while(n < MAX_EDGES - 2){
+		next(&press, &pause);
+		edges[s][n++] = t;
+		t += press * TICKS_PER_MS + rand() % TICKS_PER_MS;
+		edges[s][n++] = t;
+		t += pause * TICKS_PER_MS + rand() % TICKS_PER_MS;
+	}
+	for(k = 0; (k < n) && ((k == 0) || (currentMode == 0)); k++){
+		run_until(edges[s][k]);
+		button(!(k & 1));
+		for(b = 0; b < BOUNCES; b++){
+			run_until(edges[s][k] + (b + 1) * TICKS_PER_MS / 8);
+			button(k & 1);
+			run_until(edges[s][k] + (b + 1) * TICKS_PER_MS / 8 + 4);
+			button(!(k & 1));
+		}
+	}
+	if(currentMode == 0){
+		printf("%s didn't fill recordMemory\n", name);
+		return -1;
+	}
+	rec_s = (double)(HOST_ticks - start) / TICKS_PER_S;
+	rec_wakes = wakeups;
+
+	if((s > 0) && memcmp(banks[s - 1], recordMemory[playBank ^ 1], RECORD_BYTES)){
+		printf("the recording before %s changed while it played back\n", name);
+		return -1;
+	}
+	for(at = 0; at < playLength; lengths[s]++)
+		record_next(recordMemory[playBank], &at);
+	memcpy(banks[s], recordMemory[playBank], RECORD_BYTES);
+	play(s, edges[s][k - 1]);			// it filled up at the release edges[s][k - 1]
+
+	wakeups = 0;
+	start = HOST_ticks;
+	run_until(plays[nplays - 1].start + 2 * period(s));
+	old_lengths = old_session(s, &old_worst);
+	if(old_worst > old_worst_all)
+		old_worst_all = old_worst;
+	printf("%-6s %7d %5d %9.1f %9.1f %11d %9.1f\n", name, lengths[s], playLength, rec_wakes / rec_s,
+		(double)wakeups * TICKS_PER_S / (HOST_ticks - start), old_lengths, old_worst);
+	return 0;
+}
+
+// the largest difference in ticks between the green LED edges and when
+// they should be for plays[], the exact lengths scaled by 2^shift
+double check(){
+	double t, worst = 0, d;
+	long x;
+	int p, j, s, k = 0, on = 0, missing = 0;
+
+	for(p = 0; p < nplays; p++){
+		s = plays[p].s;
+		plays[p].worst = 0;
+		plays[p].edges = 0;
+		plays[p].loops = 0;
+		for(j = 0; ; j++){
+			x = (j / lengths[s]) * period(s) + edges[s][j % lengths[s]] - edges[s][0];
+			t = plays[p].start + ldexp(x, -plays[p].shift);
+			if(t >= plays[p].end)
+				break;
+			if((!(j & 1)) == on)				// it is on already, a loop starts with the LED on
+				continue;
+			on = !(j & 1);
+			if(k >= nleds){
+				missing++;
+				continue;
+			}
+			if(j == 2 * lengths[s])
+				plays[p].loops = leds[k] - plays[p].start;
+			d = fabs(leds[k++] - t);
+			plays[p].edges++;
+			if(d > plays[p].worst)
+				plays[p].worst = d;
+		}
+		if(plays[p].worst > worst)
+			worst = plays[p].worst;
+	}
+	if(missing || (k != nleds)){
+		printf("the green LED moved %d times, it should have %d\n", nleds, k + missing);
+		return -1;
+	}
+	return worst;
+}
+
+// press and let go at time t, for ms
+void click(long t, int ms){
+	run_until(t);
+	button(1);
+	run_until(t + ms * TICKS_PER_MS);
+	button(0);
+}
+
+int main(void){
+	long tap;
+	double worst, ideal;
+	int p;
+
+	srand(1);
+	P1IN = BUTTON;
+	memset(host_flash, 0xFF, sizeof host_flash);
+	record_init();
+	run_until(WAIT_S * TICKS_PER_S);
+	printf("waiting for the first press: %.1f wakeups/s\n\n", (double)wakeups / WAIT_S);
+	printf("RAM: recordMemory is 2 banks of %d bytes, %d in all; the old int recordMemory[%d] took %d\n",
+		RECORD_BYTES, (int)sizeof recordMemory, OLD_WORDS, OLD_WORDS * 2);
+	printf("%-6s %7s %5s %9s %9s %11s %9s\n", "", "lengths", "bytes", "rec /s", "play /s", "old lengths", "old ms");
+	if(run("taps", taps, 0) || run("morse", morse, 1) || run("holds", holds, 2))
+		return 1;
+
+	// a 100ms tap, that plays holds again TIMEOUT after it is let go
+	tap = HOST_ticks + period(2) / 3;
+	run_until(tap);
+	button(1);
+	run_until(tap + 100 * TICKS_PER_MS);
+	button(0);
+	play(2, tap + 100 * TICKS_PER_MS + TIMEOUT);
+	run_until(plays[nplays - 1].start + 2 * period(2));
+
+	// double-clicks, 80ms presses 150ms apart, each playing it at the next speed
+	for(p = 0; p < SPEEDS; p++){
+		tap = HOST_ticks + period(2) / 5;
+		click(tap, 80);
+		click(tap + 230 * TICKS_PER_MS, 80);
+		run_until(tap + 310 * TICKS_PER_MS + TIMEOUT);
+		play(2, HOST_ticks);
+		run_until(plays[nplays - 1].start + ldexp(2 * period(2), -playShift));
+	}
+	plays[nplays - 1].end = HOST_ticks + 1;
+
+	worst = check();
+	if(worst < 0)
+		return 1;
+	printf("\ngreen LED up to %.2f ticks (%.0fus) off, over %d edges (the old WDT version: up to %.1fms)\n",
+		worst, worst * 1000 / TICKS_PER_MS, nleds, old_worst_all);
+	printf("old WDT version: %.1f wakeups/s always\n", 1.1e6 / 8192);
+	printf("\nholds at each speed, two loops:\n");
+	printf("%-6s %14s %14s %11s %6s %12s\n", "speed", "ideal (ticks)", "played", "off", "edges", "worst ticks");
+	for(p = SESSIONS + 1; p < nplays; p++){
+		ideal = ldexp(2 * period(2), -plays[p].shift);
+		printf("%5gx %14.2f %14ld %11.2f %6d %12.3f\n", ldexp(1, plays[p].shift), ideal,
+			plays[p].loops, plays[p].loops - ideal, plays[p].edges, plays[p].worst);
+		if(fabs(plays[p].loops - ideal) >= 1)
+			worst = 1;
+	}
+	if(worst >= 1){
+		printf("a tick or more off\n");
+		return 1;
+	}
+	if(memcmp(banks[SESSIONS - 1], recordMemory[playBank], RECORD_BYTES)){
+		printf("holds changed while it played back\n");
+		return 1;
+	}
+	printf("each recording was left as recorded while it played back, and the tap didn't replace holds\n");
+	return 0;
+}
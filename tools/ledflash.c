@@ -0,0 +1,214 @@
+/***********************************************************************
+	recordLED flash model, runs on the PC (not the MSP430)
+
+	Builds LEDrecorder/recordLED.c on the host with a model of the main
+	flash segments its slots are saved in: an erase sets a segment to
+	0xFF and counts against its endurance, programming can only clear
+	bits, and a byte is programmed once between erases. The power can be
+	cut at any erase or byte, which leaves that one half done (random
+	bits), and then the firmware starts over from record_init.
+
+	It saves SAVES recordings, most of them in slot 0, checking that every
+	slot still holds the last one saved in it, and prints how the erases
+	spread over the segments, against keeping each slot in a segment of
+	its own. Then it cuts the power at every erase and byte of a save in
+	each slot in turn, and again at random through SAVES more, checking
+	after each reset that every slot holds its last recording, or for the
+	slot being saved the new one, and that the next save goes through.
+
+	Build:	cc -O2 -Ihost -o ledflash ledflash.c
+	Usage:	ledflash
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "msp430.h"
+
+unsigned char host_flash[4 * 512];
+
+#define HOST_FLASH
+#define SAVE_FLASH host_flash
+#define main record_main
+#include "../LEDrecorder/recordLED.c"
+#undef main
+
+#define SAVES 30000
+#define ENDURANCE 10000		// erase/program cycles a segment is good for (datasheet minimum)
+#define CUT_RANGE 300		// a random cut comes within this many flash operations of a save (~200)
+
+long erases[SAVE_SEGS];
+long power = -1;			// flash operations until the power is cut, -1 never
+jmp_buf cut;
+
+// what each slot should hold
+unsigned char expect[SLOTS][RECORD_BYTES];
+int expectLength[SLOTS];
+
+// the flash operation about to happen, returns 1 if the power goes during it
+int cut_now(){
+	if(power < 0)
+		return 0;
+	return power-- == 0;
+}
+
+void flash_erase(unsigned char *segment){
+	int i;
+
+	if(cut_now()){
+		for(i = 0; i < SAVE_SEG_SIZE; i++)
+			segment[i] |= rand();				// some bits came back to 1, some not yet
+		longjmp(cut, 1);
+	}
+	memset(segment, 0xFF, SAVE_SEG_SIZE);
+	erases[(segment - host_flash) / SAVE_SEG_SIZE]++;
+}
+
+void flash_write(unsigned char *dst, const unsigned char *src, unsigned char len){
+	while(len-- != 0){
+		if(*dst != 0xFF){
+			printf("byte %ld programmed twice without an erase\n", (long)(dst - host_flash));
+			exit(1);
+		}
+		if(cut_now()){
+			*dst &= *src | rand();				// some of its 0 bits programmed
+			longjmp(cut, 1);
+		}
+		*dst++ &= *src++;
+	}
+}
+
+// make a recording in slot, as record_stop leaves it, and have it saved
+void record(int slot){
+	int n = 4 + rand() % 100;			// more lengths than a double-click
+
+	currentSlot = slot;
+	record_start(0);
+	while((n-- > 0) && (RECORD_BYTES - recordLength >= MAX_LENGTH + record_size(TIMEOUT)))
+		record_append(rand() % (rand() & 1 ? 0x80 : TIMEOUT));
+	record_stop(0);
+}
+
+// save what record left to save, main would between playback edges
+void save(){
+	while(saveWanted != saveDone)
+		save_step();
+}
+
+// check what the slots hold after a reset, the one being saved may hold
+// the new recording (bank) or the last one, the others the last one
+void check(int slot, const unsigned char *bank, int length, const char *when){
+	const unsigned char *segment;
+	int s, n;
+
+	record_init();
+	for(s = 0; s < SLOTS; s++){
+		segment = (saveLive[s] == NO_SEG) ? NULL : SAVE_SEGMENT(saveLive[s]);
+		n = segment ? segment[3] : 0;
+		if((s == slot) && (n == length) && !memcmp(segment + SAVE_HEAD, bank, n)){
+			memcpy(expect[s], bank, n);		// the new one went through
+			expectLength[s] = n;
+			continue;
+		}
+		if((n != expectLength[s]) || (n && memcmp(segment + SAVE_HEAD, expect[s], n))){
+			printf("slot %d lost its recording %s\n", s, when);
+			exit(1);
+		}
+	}
+}
+
+// expect what the slots hold now
+void expect_saved(){
+	const unsigned char *segment;
+	int s;
+
+	record_init();
+	for(s = 0; s < SLOTS; s++){
+		segment = (saveLive[s] == NO_SEG) ? NULL : SAVE_SEGMENT(saveLive[s]);
+		expectLength[s] = segment ? segment[3] : 0;
+		if(segment)
+			memcpy(expect[s], segment + SAVE_HEAD, segment[3]);
+	}
+}
+
+// record and save in slot, with the power on
+void save_in(int slot){
+	record(slot);
+	save();
+	check(slot, recordMemory[playBank], playLength, "after a save");
+}
+
+// record in slot and cut the power after ops flash operations, returns 0
+// if the save went through first
+int cut_at(int slot, long ops){
+	unsigned char bank[RECORD_BYTES];
+	int length;
+
+	record(slot);
+	memcpy(bank, recordMemory[playBank], playLength);
+	length = playLength;
+	power = ops;
+	if(setjmp(cut) == 0){
+		save();
+		power = -1;
+		check(slot, bank, length, "after a save");
+		return 0;
+	}
+	power = -1;
+	check(slot, bank, length, "after a power cut");
+	return 1;
+}
+
+int main(void){
+	unsigned char saved[sizeof host_flash];
+	long total = 0, most = 0, fixed, cuts = 0, ops;
+	int s, i, slot;
+
+	srand(1);
+	memset(host_flash, 0xFF, sizeof host_flash);
+	expect_saved();
+	for(i = 0; i < SAVES; i++){
+		slot = (rand() % 20 < 16) ? 0 : (rand() % 4 < 3) ? 1 : 2;	// 80%, 15%, 5%
+		save_in(slot);
+	}
+	for(s = 0; s < SAVE_SEGS; s++){
+		total += erases[s];
+		most = (erases[s] > most) ? erases[s] : most;
+	}
+	printf("%d saves, 80%% slot 0, 15%% slot 1, 5%% slot 2: %ld erases\n", SAVES, total);
+	for(s = 0; s < SAVE_SEGS; s++)
+		printf("  segment %d (0x%04X) %6ld\n", s, 0xF600 + s * SAVE_SEG_SIZE, erases[s]);
+	fixed = SAVES * 16 / 20;
+	printf("the most erased segment reaches %d erases after %ld saves,\n", ENDURANCE,
+		(long)ENDURANCE * SAVES / most);
+	printf("with a segment for each slot, slot 0's after %ld (it takes %ld of the %d)\n",
+		(long)ENDURANCE * SAVES / fixed, fixed, SAVES);
+
+	// a recording in each slot, then cut each save of one short at every step
+	memset(host_flash, 0xFF, sizeof host_flash);
+	expect_saved();
+	for(s = 0; s < SLOTS; s++)
+		save_in(s);
+	memcpy(saved, host_flash, sizeof host_flash);
+	for(s = 0; s < SLOTS; s++){
+		for(ops = 0; ; ops++){
+			memcpy(host_flash, saved, sizeof host_flash);
+			expect_saved();
+			if(!cut_at(s, ops))
+				break;
+			cuts++;
+			save_in(s);						// and it saves after the reset
+			save_in((s + 1) % SLOTS);
+		}
+	}
+	printf("\n%ld power cuts, at every erase and byte of a save in each slot: no recording lost\n", cuts);
+
+	memcpy(host_flash, saved, sizeof host_flash);
+	expect_saved();
+	for(i = cuts = 0; i < SAVES; i++)
+		cuts += cut_at(rand() % SLOTS, rand() % CUT_RANGE);
+	printf("%ld power cuts at random in %d saves: no recording lost\n", cuts, SAVES);
+	return 0;
+}
@@ -0,0 +1,135 @@
+/***********************************************************************
+	blinkSOS Morse benchmark, runs on the PC (not the MSP430)
+
+	Builds blinkSOS/blinkSOS_main.c on the host and times the work it
+	does to decide the LED per Morse symbol (a dot or a dash and the gap
+	after it), against the loop it replaced, which compared j with 18
+	constants on each of its 100,000 passes per SOS. The waiting is left
+	out of both, the old 20,000 pass delay loop and __delay_cycles. Also
+	decodes MORSE_stream back into letters, as a check of the table.
+
+	Build:	cc -O2 -Ihost -o morsebench morsebench.c
+	Usage:	morsebench ["MESSAGE"]
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+#include "msp430g2553.h"
+
+#define main blink_main
+#include "../blinkSOS/blinkSOS_main.c"
+#undef main
+
+#define REPEATS 200
+
+// the decisions of the old blinkSOS_main loop for one SOS, its rising edges are the symbols
+unsigned int old_loop(void){
+	unsigned long j;
+	unsigned int symbols = 0;
+
+	for(j = 0; j < 100000; j++)
+	{
+		if(j == 0 || j == 4000 || j == 8000 || j == 15000 || j == 30000 || j == 45000 || j == 60000 || j == 64000 || j == 68000)
+		{
+			symbols += (P1OUT == 0);
+			P1OUT = 0x01;
+		}
+		else if(j == 2000 || j == 6000 || j == 10000 || j == 25000 || j == 40000 || j == 55000 || j == 62000 || j == 66000 || j == 70000)
+		{
+			P1OUT = 0x00;
+		}
+	}
+	return symbols;
+}
+
+// one repeat of MORSE_stream through morse_tick
+unsigned int new_loop(void){
+	unsigned int k, symbols = 0;
+	unsigned char was;
+
+	for(k = 0; k < morse_len; k++){
+		was = P1OUT;
+		morse_tick();
+		symbols += (P1OUT && !was);
+	}
+	return symbols;
+}
+
+double seconds(void){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// print MORSE_stream as letters, from its runs of on and off units
+void decode(void){
+	unsigned int k = 0, run;
+	unsigned char on, code = 0, n = 0, i;
+
+	printf("decodes to: ");
+	while(k < morse_len){
+		on = (MORSE_stream[k >> 3] >> (k & 7)) & 1;
+		for(run = 0; (k < morse_len) && (((MORSE_stream[k >> 3] >> (k & 7)) & 1) == on); k++)
+			run++;
+		if(on){
+			code |= (run >= 3) << n;
+			n++;
+			continue;
+		}
+		if((run < 3) || (n == 0))
+			continue;
+		for(i = 0; (i < 36) && (MORSE[i] != M(n, code)); i++);
+		putchar(i < 10 ? '0' + i : i < 36 ? 'A' + i - 10 : '?');
+		if(run >= 7)
+			putchar(' ');
+		code = 0;
+		n = 0;
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]){
+	const char *msg = (argc > 1) ? argv[1] : MESSAGE;
+	unsigned int k, r, reps, symbols, old_symbols, new_symbols;
+	double t, old_ns, new_ns;
+
+	if(argc > 2){
+		fprintf(stderr, "usage: %s [message]\n", argv[0]);
+		return 2;
+	}
+	morse_encode(msg);
+	printf("message \"%s\": %u units, %.2fs a repeat at %d WPM\n", msg, morse_len, morse_len * UNIT_MS / 1000.0, WPM);
+	printf("stream: ");
+	for(k = 0; k < morse_len; k++)
+		putchar('0' + ((MORSE_stream[k >> 3] >> (k & 7)) & 1));
+	printf("\n");
+	decode();
+
+	old_symbols = old_loop();
+	new_symbols = new_loop();
+	if(new_symbols == 0){
+		fprintf(stderr, "nothing to send in \"%s\"\n", msg);
+		return 1;
+	}
+
+	symbols = 0;
+	t = seconds();
+	for(r = 0; r < REPEATS; r++)
+		symbols += old_loop();
+	old_ns = (seconds() - t) * 1e9 / symbols;
+
+	// as many units as the old loop made passes, so both run a while
+	reps = REPEATS * (100000 / morse_len + 1);
+	symbols = 0;
+	t = seconds();
+	for(r = 0; r < reps; r++)
+		symbols += new_loop();
+	new_ns = (seconds() - t) * 1e9 / symbols;
+
+	printf("\n%-16s %14s %10s\n", "", "passes/symbol", "ns/symbol");
+	printf("%-16s %14.1f %10.2f\n", "old j== loop", 100000.0 / old_symbols, old_ns);
+	printf("%-16s %14.1f %10.2f\n", "morse_tick", (double)morse_len / new_symbols, new_ns);
+	return 0;
+}
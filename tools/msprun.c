@@ -0,0 +1,372 @@
+/***********************************************************************
+	MSP430G2553 runner, runs the firmware on the PC (not the MSP430)
+
+	Builds one of the six programs against host/hostemu.h, the emulator
+	of the chip, and runs it for some seconds of virtual time: the clocks,
+	timers, watchdog, ports, UART and flash move on with every register
+	access, and while the CPU sleeps time jumps to the next interrupt, so
+	minutes of the chip run in a fraction of a second. The firmware is
+	built with 16 bit ints and 32 bit longs, as on the chip.
+
+	A script drives the input pins, one change a line:
+		500 P1.3 0		at 500ms from power up, drive P1.3 low
+		+120 P1.3 1		120ms after the line before
+		wait P1.0 1		until the output P1.0 goes high (the next +
+						line counts from then)
+	Each program has a script of its own that shows it working, a file
+	given on the command line replaces it. Pins are pulled up until the
+	script drives them.
+
+	It prints the changes of the output pins as they happen, and for a
+	timer output toggling (the synthesizer's notes) its frequency when
+	the script next moves something. Then how long the run took against
+	the time it emulated, the runs and time of each interrupt handler,
+	the time spent in each power mode and what the program left behind.
+	Seize&Secure runs with the HD44780 of host/hd44780.h on its LCD pins,
+	sslcd checks its protocol.
+
+	Build:	cc -O2 -Ihost -DRXNTIMER -o msprun msprun.c
+			(one of -DBLINKSOS, -DBLINKSOS_WDT, -DRECORDLED, -DRXNTIMER,
+			-DSYNTHESIZER, -DSEIZE)
+	Usage:	msprun [-s seconds] [-v vlo_hz] [-u uart.bin] [script]
+		-s	seconds to run (default: the program's)
+		-v	frequency of the VLO, 4000-20000 (default 12000)
+		-u	write the bytes sent by the UART to uart.bin (Seize&Secure's
+			telemetry, for sstlm)
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hostemu.h"
+#include "hd44780.h"
+
+// the firmware sees 16 bit ints and 32 bit longs, as the MSP430 compiler gives it
+#define int short
+#define long __attribute__((mode(SI))) int
+#define main firmware_main
+#ifdef RECORDLED
+#undef long		// mode() can't make a function's return or a pointed to long 32 bit, recordLED
+				// only keeps tick counts in its longs, which a 64 bit long holds the same
+#endif
+
+#if defined(BLINKSOS)
+#define NAME "blinkSOS_main"
+#define SECONDS 10.0
+#define SCRIPT ""
+#define TRACE_P1 0x01
+#include "../blinkSOS/blinkSOS_main.c"
+
+#elif defined(BLINKSOS_WDT)
+#define NAME "blinkSOS_WDT"
+#define SECONDS 30.0
+#define SCRIPT ""
+#define TRACE_P1 0x40
+#include "../blinkSOS_WDT/blinkSOS_WDT.c"
+
+#elif defined(RECORDLED)
+#define NAME "recordLED"
+#define SECONDS 12.0
+#define SCRIPT	"1000 P1.3 0\n+150 P1.3 1\n+300 P1.3 0\n+150 P1.3 1\n+600 P1.3 0\n+400 P1.3 1\n"
+#define TRACE_P1 0x41
+#include "../LEDrecorder/recordLED.c"
+
+#elif defined(RXNTIMER)
+#define NAME "rxnTimer"
+#define SECONDS 10.0
+#define SCRIPT	"500 P1.3 0\n+100 P1.3 1\nwait P1.0 1\n+250 P1.2 0\n+100 P1.2 1\n"
+#define TRACE_P1 0x01
+#include "../reactionTimer/rxnTimer.c"
+
+#elif defined(SYNTHESIZER)
+#define NAME "synthesizer"
+#define SECONDS 4.0
+#define SCRIPT	"500 P1.3 0\n+500 P1.2 0\n+500 P1.3 1\n+500 P1.4 0\n+500 P1.2 1\n+500 P1.4 1\n"
+#define TRACE_P1 0x00
+#define asm(text)
+#include "../synthesizer/synthesizer.c"
+#undef asm
+
+#elif defined(SEIZE)
+#define NAME "Seize&Secure"
+#define SECONDS 30.0
+#define SCRIPT	"1000 P2.7 0\n+100 P2.7 1\n+8000 P1.0 0\n+6000 P1.0 1\n"
+#define TRACE_P1 0x00
+unsigned char host_info[3 * 64];
+#define INFO_FLASH host_info
+#include "../laserTag/Seize&Secure.c"
+struct hd44780 lcd;				// on the LCD pins, see sslcd
+
+#else
+#error "build with one of -DBLINKSOS, -DBLINKSOS_WDT, -DRECORDLED, -DRXNTIMER, -DSYNTHESIZER, -DSEIZE"
+#endif
+
+#undef main
+#undef long
+#undef int
+
+#define MAX_LINES 256
+
+const char *VECTOR_NAMES[16] = {
+	NULL, NULL, "PORT1", "PORT2", NULL, NULL, "USCIAB0TX", NULL,
+	"TIMER0_A1", "TIMER0_A0", "WDT", NULL, "TIMER1_A1", "TIMER1_A0", NULL, NULL
+};
+const char *MODE_NAMES[4] = {"active", "LPM0/1", "LPM2/3", "LPM4"};
+
+// the script, one pin change or wait a line
+struct line {
+	unsigned long long at;		// ps, from power up or (rel) from the line before
+	int rel, wait;
+	int port;
+	unsigned char mask;
+	int level;
+} script[MAX_LINES];
+int lines, next_line;
+unsigned long long line_ps;		// time the line before ran
+int waiting;					// the next line waits for an output
+
+unsigned char traced[3];		// outputs as last printed
+unsigned long toggles[2][3];	// timer output toggles at the last look
+unsigned long long toggles_ps;
+FILE *uart_file;
+unsigned long uart_bytes;
+
+// read the script from text, returns 0 if a line is wrong
+int script_parse(const char *text){
+	char buf[64], pin[8];
+	const char *end;
+	double ms;
+	int port, bit, level, n;
+	struct line *l;
+
+	for(lines = 0; *text; text = *end ? end + 1 : end){
+		end = strchr(text, '\n');
+		if(end == NULL)
+			end = text + strlen(text);
+		n = end - text;
+		if((n == 0) || (text[0] == '#'))
+			continue;
+		if((n >= (int)sizeof buf) || (lines == MAX_LINES))
+			return 0;
+		memcpy(buf, text, n);
+		buf[n] = 0;
+		l = &script[lines++];
+		memset(l, 0, sizeof *l);
+		if(sscanf(buf, "wait %7s %d", pin, &level) == 2)
+			l->wait = 1;
+		else if(sscanf(buf, "%lf %7s %d", &ms, pin, &level) == 3){
+			l->rel = (buf[0] == '+');
+			l->at = ms * 1e9;
+		}
+		else
+			return 0;
+		if((sscanf(pin, "P%d.%d", &port, &bit) != 2) || (port < 1) || (port > 3) || (bit < 0) || (bit > 7))
+			return 0;
+		l->port = port;
+		l->mask = 1 << bit;
+		l->level = level;
+	}
+	return 1;
+}
+
+// print the frequency each timer output has toggled at since the last look
+void tones(void){
+	struct emu_timer *t;
+	unsigned long n;
+	double s = (EMU_ps - toggles_ps) / (double)EMU_PS;
+	int i, x;
+
+	for(i = 0; i < 2; i++){
+		t = &EMU_timers[i];
+		for(x = 0; x < 3; x++){
+			n = t->toggles[x] - toggles[i][x];
+			toggles[i][x] = t->toggles[x];
+			if((n > 1) && (s > 0))
+				printf("%11.6f s  TA%d.%d toggled %lu times since %.6f s: %.2f Hz\n",
+					EMU_ps / (double)EMU_PS, i, x, n, toggles_ps / (double)EMU_PS, n / s / 2);
+		}
+	}
+	toggles_ps = EMU_ps;
+}
+
+// schedule the next script line, unless it waits for an output
+void script_next(void){
+	struct line *l;
+
+	EMU_event_at = EMU_NEVER;
+	if(next_line == lines)
+		return;
+	l = &script[next_line];
+	if(l->wait){
+		waiting = 1;
+		return;
+	}
+	EMU_event_at = l->rel ? line_ps + l->at : l->at;
+	if(EMU_event_at < EMU_ps)
+		EMU_event_at = EMU_ps;
+}
+
+// emu_event: run the line that is due
+void script_run(void){
+	struct line *l = &script[next_line++];
+
+	tones();
+	printf("%11.6f s  drive P%d.%d %d\n", EMU_ps / (double)EMU_PS, l->port, __builtin_ctz(l->mask), l->level);
+	emu_pin(l->port, l->mask, l->level);
+	line_ps = EMU_ps;
+	script_next();
+}
+
+// emu_ports: print the traced outputs that changed, and see to a wait
+void ports(void){
+	unsigned char now;
+	struct line *l;
+	int bit;
+
+#if defined(SEIZE)
+	bit = hd44780_bus(&lcd, EMU_ps, (HOST_P1OUT & LCDRS) != 0, (HOST_P1OUT & LCDRW) != 0, (HOST_P1OUT & LCDE) != 0,
+		HOST_P2OUT & LCDDATA, (HOST_P2DIR & LCDDATA) != 0);
+	EMU_in[1] = (EMU_in[1] & ~LCDDATA) | ((bit < 0) ? LCDDATA : bit);
+#endif
+	for(bit = 0; bit < 8; bit++){
+		if(!(TRACE_P1 & (1 << bit)))
+			continue;
+		now = emu_out(1, 1 << bit) << bit;
+		if((now ^ traced[0]) & (1 << bit))
+			printf("%11.6f s  P1.%d %d\n", EMU_ps / (double)EMU_PS, bit, now != 0);
+		traced[0] = (traced[0] & ~(1 << bit)) | now;
+	}
+	if(waiting){
+		l = &script[next_line];
+		if(emu_out(l->port, l->mask) == (l->level != 0)){
+			printf("%11.6f s  P%d.%d went %d\n", EMU_ps / (double)EMU_PS, l->port, __builtin_ctz(l->mask), l->level);
+			waiting = 0;
+			next_line++;
+			line_ps = EMU_ps;
+			script_next();
+		}
+	}
+}
+
+void uart(unsigned char c){
+	uart_bytes++;
+	if(uart_file)
+		fputc(c, uart_file);
+}
+
+void firmware(void){
+	firmware_main();
+}
+
+int main(int argc, char **argv){
+	const char *WHY[4] = {NULL, "ran its time", "reset", "halted, asleep with interrupts off"};
+	double seconds = SECONDS, wall;
+#if defined(SEIZE)
+	char row[17];
+#endif
+	struct timespec start, end;
+	char *text = SCRIPT;
+	FILE *f;
+	long size;
+	int opt, why, v;
+
+	while((opt = getopt(argc, argv, "s:v:u:")) != -1){
+		switch(opt){
+			case 's':	seconds = atof(optarg);	break;
+			case 'v':	EMU_vlo_hz = atol(optarg);	break;
+			case 'u':
+				uart_file = fopen(optarg, "wb");
+				if(uart_file == NULL){
+					perror(optarg);
+					return 1;
+				}
+				break;
+			default:
+				fprintf(stderr, "usage: msprun [-s seconds] [-v vlo_hz] [-u uart.bin] [script]\n");
+				return 1;
+		}
+	}
+	if(optind < argc){
+		f = fopen(argv[optind], "rb");
+		if(f == NULL){
+			perror(argv[optind]);
+			return 1;
+		}
+		fseek(f, 0, SEEK_END);
+		size = ftell(f);
+		rewind(f);
+		text = calloc(size + 1, 1);
+		if(fread(text, 1, size, f) != (size_t)size){
+			perror(argv[optind]);
+			return 1;
+		}
+		fclose(f);
+	}
+	if(!script_parse(text)){
+		fprintf(stderr, "bad script line %d\n", lines);
+		return 1;
+	}
+
+#if defined(RECORDLED)
+	memset(SAVE_AREA, 0xFF, sizeof SAVE_AREA);		// erased, as a new chip comes
+	emu_flash(SAVE_AREA, sizeof SAVE_AREA, SAVE_SEG_SIZE);
+#elif defined(SEIZE)
+	memset(host_info, 0xFF, sizeof host_info);
+	emu_flash(host_info, sizeof host_info, LOG_SEG_SIZE);
+	hd44780_init(&lcd);
+#endif
+	emu_event = script_run;
+	emu_ports = ports;
+	emu_uart = uart;
+	printf("%s for %.3f s of virtual time\n", NAME, seconds);
+	script_next();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	why = emu_run(firmware, seconds);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	tones();
+	wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("\n%s %s at %.6f s%s%s\n", NAME, WHY[why], EMU_ps / (double)EMU_PS,
+		EMU_why ? ": " : "", EMU_why ? EMU_why : "");
+	printf("%.6f s virtual in %.3f s on the PC, %.0fx real time\n",
+		EMU_ps / (double)EMU_PS, wall, EMU_ps / (double)EMU_PS / wall);
+	for(v = 0; v < 16; v++){
+		if(EMU_irqs[v] == 0)
+			continue;
+		printf("  %-10s %8lu runs, %10.1f us in all, %8.2f us each\n", VECTOR_NAMES[v] ? VECTOR_NAMES[v] : "?",
+			EMU_irqs[v], EMU_irq_ps[v] / 1e6, EMU_irq_ps[v] / 1e6 / EMU_irqs[v]);
+	}
+	for(v = 0; v < 4; v++)
+		if(EMU_mode_ps[v])
+			printf("  %-10s %10.6f s, %5.1f%%\n", MODE_NAMES[v], EMU_mode_ps[v] / (double)EMU_PS,
+				100.0 * EMU_mode_ps[v] / EMU_ps);
+	if(next_line < lines)
+		printf("  the script stopped at line %d of %d%s\n", next_line + 1, lines, waiting ? ", waiting" : "");
+
+#if defined(RXNTIMER)
+	printf("  rxnTime %lu timer counts, %.3f ms at SMCLK/8 = 1MHz\n", (unsigned long)rxnTime, rxnTime / 1000.0);
+#elif defined(RECORDLED)
+	printf("  flash: %lu segment erases, %lu bytes programmed, %lu errors\n",
+		EMU_flash_erases, EMU_flash_bytes, EMU_flash_errors);
+#elif defined(SEIZE)
+	printf("  state %d, scores", state);
+	for(v = 0; v < NUM_TEAMS; v++)
+		printf(" %02X", SCORE[v]);
+	printf(", %lu UART bytes, %lu overruns, UART stalled %.3f ms\n", uart_bytes, EMU_tx_overruns, EMU_tx_stalls / 1e9);
+	printf("  flash: %lu segment erases, %lu bytes programmed, %lu errors\n",
+		EMU_flash_erases, EMU_flash_bytes, EMU_flash_errors);
+	for(v = 0; v < 2; v++){
+		hd44780_row(&lcd, v, row);
+		for(opt = 0; opt < 16; opt++)
+			if((unsigned char)row[opt] < 0x10)
+				row[opt] = '0' + (row[opt] & 7);	// bar glyphs as their level
+		printf("  LCD |%s|\n", row);
+	}
+#endif
+	if(uart_file)
+		fclose(uart_file);
+	return (why == EMU_RESET) || (why == EMU_HALT && next_line < lines);
+}
@@ -0,0 +1,88 @@
+/***********************************************************************
+	blinkSOS_WDT power model, runs on the PC (not the MSP430)
+
+	Builds blinkSOS_WDT/blinkSOS_WDT.c on the host and plays one repeat
+	of its message (SOS unless built with -DMESSAGE=...) through it:
+	every time TA0R reaches TA0CCR1 the LED toggles (OUTMOD_4) and
+	blink_handler runs. It prints the toggles it saw, then the CPU
+	wakeups and the current of one repeat against the old WDT version,
+	which took an interrupt every 8K/1.1MHz ~= 7.4ms in LPM0 and counted
+	them down to the next toggle. Currents are the MSP430G2553 datasheet
+	typicals at 3V, the LED itself is left out. The handler lengths are
+	estimates, interrupt entry and reti included. The VLO is taken at its
+	typical VLO_HZ, the real one is anywhere from 4kHz to 20kHz.
+
+	The firmware is built with 16 bit ints as on the MSP430 (int defined
+	as short), and every toggle has to come its run of a[] times
+	UNIT_MS * VLO_HZ / 1000 ticks after the last one, worked out here in
+	long math, or sospower fails.
+
+	Build:	cc -Ihost -o sospower sospower.c
+		or	cc -Ihost -DMESSAGE='M_C(LETTER) M_Q(WORD)' -o sospower sospower.c
+	Usage:	sospower
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include "msp430g2553.h"
+
+#define main blink_main
+#define int short
+#include "../blinkSOS_WDT/blinkSOS_WDT.c"
+#undef int
+#undef main
+
+#define WDT_S (8192 / 1.1e6)	// the old WDT interval
+#define I_ACTIVE 330.0		// uA, active at 1MHz
+#define I_LPM0 75.0			// uA, LPM0 with the DCO on for the WDT
+#define I_LPM3 0.6			// uA, LPM3 with the VLO
+#define WDT_CYCLES 30		// the old handler, decrement and test
+#define TIMER_CYCLES 45		// blink_handler, TA0IV, wrap test and the next compare
+#define CPU_HZ 1.1e6		// the uncalibrated DCO both versions run their handler on
+
+// average current of a cycle of s seconds with n wakeups of the given length
+double current(double s, unsigned long n, int cycles, double sleep){
+	double awake = n * cycles / CPU_HZ;
+
+	return (awake * I_ACTIVE + (s - awake) * sleep) / s;
+}
+
+int main(void){
+	unsigned long wdt, wakes = 0, at, want;
+	unsigned int i, n = sizeof a, d;
+	unsigned char led = 1;		// the first run of a[] is on
+	double s, old_ua, new_ua;
+
+	blink_main();
+	if(!(P1SEL & LED) || ((TA0CCTL1 & (OUTMOD_4 | CCIE)) != (OUTMOD_4 | CCIE))){
+		fprintf(stderr, "P1.6 isn't set up as the CCR1 toggle output\n");
+		return 1;
+	}
+	printf("%6s %8s %8s %5s\n", "toggle", "ticks", "ms", "LED");
+	for(i = 0; i < n; i++){
+		want = a[i] * ((long)UNIT_MS * VLO_HZ / 1000);
+		d = (unsigned short)(TA0CCR1 - TA0R);
+		if(d != want){
+			fprintf(stderr, "toggle %u came after %u ticks, not %lu\n", i + 1, d, want);
+			return 1;
+		}
+		HOST_ticks += d ? d : 0x10000;
+		led ^= 1;				// OUTMOD_4 toggles P1.6 in hardware
+		TA0IV = TA0IV_TACCR1;
+		blink_handler();
+		wakes++;
+		printf("%6u %8u %8.1f %5s\n", i + 1, d, d * 1000.0 / VLO_HZ, led ? "on" : "off");
+	}
+	at = HOST_ticks;
+	s = (double)at / VLO_HZ;
+	wdt = s / WDT_S + 0.5;		// the WDT version blinking the same
+
+	old_ua = current(s, wdt, WDT_CYCLES, I_LPM0);
+	new_ua = current(s, wakes, TIMER_CYCLES, I_LPM3);
+	printf("\none repeat of a[]: %.2fs (%lu VLO ticks, %u bytes of flash)\n", s, at, n);
+	printf("%-10s %8s %8s\n", "", "wakeups", "uA");
+	printf("%-10s %8lu %8.2f\n", "WDT LPM0", wdt, old_ua);
+	printf("%-10s %8lu %8.2f\n", "TA0 LPM3", wakes, new_ua);
+	printf("%lu times fewer wakeups, %.0f times less current\n", wdt / wakes, old_ua / new_ua);
+	return 0;
+}
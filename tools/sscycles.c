@@ -0,0 +1,215 @@
+/***********************************************************************
+	Seize&Secure display path cycle counts, runs on the PC (not the MSP430)
+
+	There is no MSP430 compiler here, so the cycles of the display path
+	can't be measured on the chip or read off the compiler's listing, and
+	the emulator (host/hostemu.h) only charges register accesses, the
+	arithmetic is free in it. This counts them on a model instead: each
+	step of the number formatting before and after user-013 (BCD) is
+	charged the cycles of the MSP430 instructions it takes, from the
+	instruction cycle tables of the MSP430x2xx family user's guide
+	(SLAU144), written out next to each. Division, with no hardware
+	divider or multiplier, calls a shift-subtract routine of the kind the
+	runtime library has: 16 turns of a loop that costs 8 cycles, 10 when
+	it subtracts, so it depends on the numbers. / and % are two calls,
+	LCD_put2's char argument divides signed. The LCD_putc calls and the
+	handler around game_second are the same before and after and are left
+	out, so are the timer_left lookups (the old game time took one more,
+	which only flatters the old code).
+
+	It first checks the BCD code itself, the firmware's own bcd, LCD_put2,
+	show_time and game_second built with 16 bit ints: every game time from
+	15:00 down to 00:00 and every flag time 0:00-1:59 must show the digits
+	the old / and % gave, and so must every score 00-99.
+
+	Build:	cc -O2 -Ihost -o sscycles sscycles.c
+	Usage:	sscycles
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include "msp430g2553.h"
+
+unsigned char host_info[3 * 64];
+
+#define INFO_FLASH host_info
+#define main firmware_main
+#define int short
+#define long __attribute__((mode(SI))) int
+#include "../laserTag/Seize&Secure.c"
+#undef long
+#undef int
+#undef main
+
+//-----the old code, / and %-----
+
+// CALL #divu 5, CLR R14 1, MOV #16,R15 2, 16 x (RLA R12 1, RLC R14 1,
+// CMP R13,R14 1, JLO 2, [SUB R13,R14 1, BIS #1,R12 1], DEC R15 1, JNZ 2),
+// RET 3. The quotient is left in R12, the remainder in R14
+unsigned long divu_cycles(unsigned int num, unsigned int den){
+	unsigned long cycles = 5 + 1 + 2 + 3;
+	unsigned int rem = 0;
+	int i;
+
+	for(i = 0; i < 16; i++){
+		rem = (rem << 1) | (num >> 15);
+		num <<= 1;
+		cycles += 8;
+		if(rem >= den){
+			rem -= den;
+			cycles += 2;
+		}
+	}
+	return cycles;
+}
+
+// signed: TST R12 1, JGE 2, TST R13 1, JGE 2 around divu, both are >= 0 here
+unsigned long divi_cycles(unsigned int num, unsigned int den){
+	return 6 + divu_cycles(num, den);
+}
+
+// LCD_put2(value): MOV.B #10,R13 2 and divi, ADD.B #'0',R12 2; the same for %
+unsigned long old_put2(unsigned char value){
+	return 2 * (2 + divi_cycles(value, 10) + 2);
+}
+
+// show_time(seconds): MOV #60,R13 2 and divu twice, then LCD_put2 of each
+unsigned long old_time(unsigned int seconds){
+	return 2 * (2 + divu_cycles(seconds, 60)) + old_put2(seconds / 60) + old_put2(seconds % 60);
+}
+
+// flag time: owned / 60 as a digit (ADD.B #'0' 2), LCD_put2(owned % 60)
+unsigned long old_flag(unsigned int owned){
+	return 2 * (2 + divu_cycles(owned, 60)) + 2 + old_put2(owned % 60);
+}
+
+//-----the new code, BCD-----
+
+// LCD_put2(value): MOV.B R12,R14 1, RRA.B x4 4, AND.B #15,R14 2 (the top
+// digit), AND.B #15,R12 2, ADD.B #'0' x2 4
+unsigned long new_put2(void){
+	return 1 + 4 + 2 + 2 + 4;
+}
+
+// game_second's countdown: MOV &GAME_clock,R12 3, CLRC 1, DADD #0x9999,R12 2,
+// CMP.B #0x99,R12 2, JNE 2, [SUB #0x40,R12 2], MOV R12,&GAME_clock 4, then
+// show_time: SWPB R12 1, MOV.B R12,R12 1 and LCD_put2 for the minutes,
+// MOV.B 1 and LCD_put2 for the seconds
+unsigned long new_time(unsigned int clock){
+	return 3 + 1 + 2 + 2 + 2 + (((clock & 0xFF) == 0x59) ? 2 : 0) + 4 + 2 + new_put2() + 1 + new_put2();
+}
+
+// bcd(bin): CALL 5, CLR R14 1, MOV.B #0x40,R15 2, 7 x (CLRC 1, DADD R14,R14 1,
+// BIT.B R15,R12 1, JEQ 2, [CLRC 1, DADD #1,R14 1], CLRC 1, RRC.B R15 1, JNE 2),
+// MOV R14,R12 1, RET 3
+unsigned long bcd_cycles(unsigned char bin){
+	unsigned long cycles = 5 + 1 + 2 + 1 + 3;
+	unsigned char bit;
+
+	for(bit = 0x40; bit != 0; bit >>= 1)
+		cycles += 9 + ((bin & bit) ? 2 : 0);
+	return cycles;
+}
+
+// flag time: CMP.B #60,R12 2, JLO 2, [SUB.B #60,R12 2, MOV.B #'1',R13 2], bcd, LCD_put2
+unsigned long new_flag(unsigned int owned){
+	return 2 + 2 + ((owned >= 60) ? 4 : 0) + bcd_cycles(owned % 60) + new_put2();
+}
+
+//-----checks of the firmware's BCD code against / and %-----
+
+int check_digits(const char *what, unsigned int n, int row, int col, unsigned char high, unsigned char low){
+	if((LCD_shadow[row - 1][col - 1] == '0' + high) && (LCD_shadow[row - 1][col] == '0' + low))
+		return 0;
+	printf("FAILED: %s %u shows %c%c, not %u%u\n", what, n, LCD_shadow[row - 1][col - 1], LCD_shadow[row - 1][col],
+		high, low);
+	return 1;
+}
+
+int check_bcd(void){
+	unsigned int left, owned, elapsed, minutes, score;
+	int bad = 0;
+
+	for(score = 0; score < 100; score++){
+		LCD_put2(1, 1, bcd(score));
+		bad |= check_digits("score", score, 1, 1, score / 10, score % 10);
+	}
+	for(minutes = 2; minutes <= 15; minutes++){
+		GAME_clock = bcd(minutes) << 8;
+		TIMER_armed = 1 << T_OWNWIN;
+		JIFFIES = 0;
+		for(left = minutes * 60 - 1, elapsed = 1; elapsed <= minutes * 60; left--, elapsed++){
+			owned = elapsed % OWNWIN_SECS;			// the flag changes hands as it would be won
+			JIFFIES += SEC(1);
+			TIMERS[T_OWNWIN].expires = JIFFIES + SEC(OWNWIN_SECS) - SEC(owned);
+			game_second(0);
+			bad |= check_digits("game time minutes, at", left, LCD_TIME_ROW, LCD_TIME_COL, left / 600, left / 60 % 10);
+			bad |= check_digits("game time seconds, at", left, LCD_TIME_ROW, LCD_TIME_COL + 3, left % 60 / 10, left % 10);
+			bad |= check_digits("flag time seconds, at", owned, LCD_FLAG_ROW, LCD_FLAG_COL + 2, owned % 60 / 10, owned % 10);
+			if(LCD_shadow[LCD_FLAG_ROW - 1][LCD_FLAG_COL - 1] != (char)('0' + owned / 60)){
+				printf("FAILED: flag time %u shows minute %c\n", owned, LCD_shadow[LCD_FLAG_ROW - 1][LCD_FLAG_COL - 1]);
+				bad = 1;
+			}
+			if(bad)
+				return 1;
+		}
+	}
+	printf("the BCD code shows every score 00-99, game time 15:00-00:00 and flag time 0:00-1:59 as / and %% did\n\n");
+	return 0;
+}
+
+//-----cycle counts-----
+
+struct range {
+	unsigned long min, max, sum, n;
+};
+
+void add(struct range *r, unsigned long cycles){
+	if((r->n == 0) || (cycles < r->min))
+		r->min = cycles;
+	if(cycles > r->max)
+		r->max = cycles;
+	r->sum += cycles;
+	r->n++;
+}
+
+void print_row(const char *what, struct range *old, struct range *new){
+	printf("  %-34s %4lu %6.1f %4lu   %4lu %6.1f %4lu   %5.1fx\n", what, old->min, (double)old->sum / old->n, old->max,
+		new->min, (double)new->sum / new->n, new->max, ((double)old->sum / old->n) / ((double)new->sum / new->n));
+}
+
+int main(void){
+	struct range old_p = {0}, new_p = {0}, old_t = {0}, new_t = {0}, old_f = {0}, new_f = {0}, old_s = {0}, new_s = {0};
+	unsigned int n, left, clock;
+	unsigned long old_game = 0, new_game = 0;
+
+	if(check_bcd())
+		return 1;
+	for(n = 0; n < 100; n++){
+		add(&old_p, old_put2(n));
+		add(&new_p, new_put2());
+	}
+	for(left = 0; left < 15 * 60; left++){
+		clock = (bcd(left / 60) << 8) | bcd(left % 60);
+		add(&old_t, old_time(left));
+		add(&new_t, new_time(clock));
+		add(&old_s, old_time(left) + old_flag(left % OWNWIN_SECS));
+		add(&new_s, new_time(clock) + new_flag(left % OWNWIN_SECS));
+		old_game += old_time(left) + old_flag(left % OWNWIN_SECS);
+		new_game += new_time(clock) + new_flag(left % OWNWIN_SECS);
+	}
+	for(n = 0; n < OWNWIN_SECS; n++){
+		add(&old_f, old_flag(n));
+		add(&new_f, new_flag(n));
+	}
+
+	printf("MCLK cycles (model, see the top of sscycles.c)   old: / and %%      new: BCD\n");
+	printf("  %-34s  min    avg  max    min    avg  max\n", "");
+	print_row("two digits, LCD_put2 (scores)", &old_p, &new_p);
+	print_row("game time MM:SS", &old_t, &new_t);
+	print_row("flag time M:SS", &old_f, &new_f);
+	print_row("game_second, the flag owned", &old_s, &new_s);
+	printf("  a 15 minute game with the flag owned throughout: %lu cycles old, %lu new,\n", old_game, new_game);
+	printf("  %.2f ms and %.2f ms at 8MHz\n", old_game / 8000.0, new_game / 8000.0);
+	return 0;
+}
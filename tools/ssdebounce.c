@@ -0,0 +1,312 @@
+/***********************************************************************
+	Seize&Secure target debounce test, runs on the PC (not the MSP430)
+
+	Replays noisy pulse trains on the REDTAKE/GRNTAKE phototransistor
+	inputs (P1.0/P1.1) of the flag station firmware, built for the
+	emulated MSP430G2553 (host/hostemu.h), and checks what the FSM made
+	of them. Each train runs in a process of its own, from a power up,
+	after ENTER has started a 2 minute game:
+
+	- glitches: 600 ambient IR glitches of 20us-3ms on either target,
+	  10-200ms apart. No capture may start.
+	- dropouts: RED held 6s with a 3ms dropout every 40ms, a flickering
+	  laser. One capture, never aborted, RED owns the flag.
+	- release: GRN held 2s through the same dropouts, then let go. One
+	  capture started and aborted, a real release still gets through.
+	- storm: 10s of random edges on GRN, 1.9kHz on average. The edge
+	  and sample interrupts (PORT1, TIMER0_A1) must stay under 2 x
+	  DEB_RATE a second: at most DEB_RATE samples, and a pin's edge
+	  interrupt is off from its first edge until a sample sees it settle.
+
+	The FSM's state is looked at on every register access the firmware
+	makes, so a capture that starts and aborts within one handler is
+	still counted. The trains come from a fixed seed, so every run is
+	the same. -f replays a recorded train instead: a line per edge,
+	"<us> <R|G> <0|1>" with the time from the game's start, and only
+	the interrupt rate is checked, over a second at least.
+
+	The firmware before user-009's debounce, which trusted every edge, can
+	be built instead to compare against (it has no DEB_RATE, so it is
+	only reported, not checked):
+		git show 0f8689d^:"laserTag/Seize&Secure.c" > /tmp/old.c
+		cc -O2 -Ihost -DFIRMWARE='"/tmp/old.c"' -o ssdebounce_old ssdebounce.c
+
+	Build:	cc -O2 -Ihost -o ssdebounce ssdebounce.c
+	Usage:	ssdebounce [-v vlo_hz] [-f train.txt]
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "hostemu.h"
+
+#ifndef FIRMWARE
+#define FIRMWARE "../laserTag/Seize&Secure.c"
+#endif
+
+unsigned char host_info[3 * 64];
+
+#define INFO_FLASH host_info
+#define main firmware_main
+#define int short
+#define long __attribute__((mode(SI))) int
+#include FIRMWARE
+#undef long
+#undef int
+#undef main
+
+#define PS_MS		1000000000ULL	// picoseconds in a millisecond
+#define PS_US		1000000ULL
+#define START_MS	1000		// ENTER is pressed
+#define NOISE_MS	8000		// the game is on (STARTUP_SECS after ENTER), the train starts
+#define TAIL_MS		8000		// the train is followed by this much quiet
+#define MAX_EDGES	100000
+#define BUTTON_PORT ((ENTER == 0x80) ? 2 : 1)	// UP/ENTER moved from P1 to P2.6/P2.7 with the UART
+
+struct edge {
+	unsigned long long ps;
+	unsigned char mask;
+	int level;
+};
+
+struct edge TRAIN[MAX_EDGES];
+int edges, next_edge;
+unsigned long long storm_from, storm_to;	// window the interrupt rate is checked over, 0 for none
+unsigned long storm_irqs[2][16];			// EMU_irqs as it opened and closed
+int storm_mark;
+
+// what the FSM did, looked at on every register access
+unsigned char last_state, last_owner;
+unsigned long started, aborted, captured;
+void (*emu_access_hook)(const volatile void *);
+
+const char *VECTOR_NAMES[16] = {
+	NULL, NULL, "PORT1", "PORT2", NULL, NULL, "USCIAB0TX", NULL,
+	"TIMER0_A1", "TIMER0_A0", "WDT", NULL, "TIMER1_A1", "TIMER1_A0", NULL, NULL
+};
+
+unsigned long seed = 12345;
+
+// 0 <= random() < n
+unsigned long rnd(unsigned long n){
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return (seed & 0xFFFFFFFF) % n;
+}
+
+void edge_at(unsigned long long ps, unsigned char mask, int level){
+	if(edges < MAX_EDGES){
+		TRAIN[edges].ps = ps;
+		TRAIN[edges].mask = mask;
+		TRAIN[edges++].level = level;
+	}
+}
+
+// mask held low from ms for len ms, with a dropout of drop us every every ms
+void hold(unsigned long long ms, unsigned long len, unsigned char mask, unsigned long every, unsigned long drop){
+	unsigned long long t = ms * PS_MS, end = (ms + len) * PS_MS;
+
+	edge_at(t, mask, 0);
+	for(t += every * PS_MS; t + drop * PS_US < end; t += every * PS_MS){
+		edge_at(t, mask, 1);
+		edge_at(t + drop * PS_US, mask, 0);
+	}
+	edge_at(end, mask, 1);
+}
+
+unsigned long long make_glitches(void){
+	unsigned long long t = NOISE_MS * PS_MS;
+	int i;
+
+	for(i = 0; i < 600; i++){
+		t += (10 + rnd(190)) * PS_MS;
+		edge_at(t, rnd(2) ? GRNTAKE : REDTAKE, 0);
+		edge_at(t + (20 + rnd(2980)) * PS_US, TRAIN[edges - 1].mask, 1);
+	}
+	return t / PS_MS;
+}
+
+unsigned long long make_dropouts(void){
+	hold(NOISE_MS, 6000, REDTAKE, 40, 3000);
+	return NOISE_MS + 6000;
+}
+
+unsigned long long make_release(void){
+	hold(NOISE_MS, 2000, GRNTAKE, 40, 3000);
+	return NOISE_MS + 2000;
+}
+
+unsigned long long make_storm(void){
+	unsigned long long t = NOISE_MS * PS_MS, end = (NOISE_MS + 10000) * PS_MS;
+	int level = 1;
+
+	while(t < end){
+		t += (50 + rnd(900)) * PS_US;
+		level ^= 1;
+		edge_at(t, GRNTAKE, level);
+	}
+	if(level == 0)
+		edge_at(t + PS_MS, GRNTAKE, 1);
+	storm_from = NOISE_MS * PS_MS;
+	storm_to = end;
+	return end / PS_MS;
+}
+
+const char *train_file;
+
+unsigned long long make_file(void){
+	FILE *f = fopen(train_file, "r");
+	unsigned long long us, last = 0;
+	char pin;
+	int level;
+
+	if(f == NULL){
+		perror(train_file);
+		exit(1);
+	}
+	while(fscanf(f, "%llu %c %d", &us, &pin, &level) == 3){
+		edge_at(NOISE_MS * PS_MS + us * PS_US, (pin == 'G') ? GRNTAKE : REDTAKE, level != 0);
+		last = us;
+	}
+	fclose(f);
+	storm_from = NOISE_MS * PS_MS;
+	if(last < 1000000)
+		last = 1000000;				// a rate over less than a second says little
+	storm_to = storm_from + last * PS_US;
+	return NOISE_MS + last / 1000;
+}
+
+struct train {
+	const char *name;
+	unsigned long long (*make)(void);		// fills TRAIN, returns the ms its last edge is at
+	long starts, aborts, captures;			// what the FSM should do, -1 not checked
+	int owner;								// who should own the flag at the end, -1 nobody
+} TRAINS[] = {
+	{"glitches", make_glitches, 0, 0, 0, -1},
+	{"dropouts", make_dropouts, 1, 0, 1, RED},
+	{"release", make_release, 1, 1, 0, -1},
+	{"storm", make_storm, -1, -1, -1, -2},
+	{"file", make_file, -1, -1, -1, -2}
+};
+#define N_TRAINS 4		// the file is run alone
+
+void watch_access(const volatile void *reg){
+	emu_access_hook(reg);
+	if(state == last_state)
+		return;
+	if((state == ST_TAKE) || (state == ST_STEAL))
+		started++;
+	else if(((last_state == ST_TAKE) && (state == ST_WAIT)) || ((last_state == ST_STEAL) && (state == ST_OWNED) && (owner == last_owner)))
+		aborted++;
+	else if(state == ST_OWNED)
+		captured++;
+	last_state = state;
+	last_owner = owner;
+}
+
+// emu_event: the edges that are due
+void train_event(void){
+	while((next_edge < edges) && (TRAIN[next_edge].ps <= EMU_ps)){
+		emu_pin(TRAIN[next_edge].mask ? 1 : BUTTON_PORT, TRAIN[next_edge].mask ? TRAIN[next_edge].mask : ENTER,
+			TRAIN[next_edge].level);
+		next_edge++;
+	}
+	if((storm_mark < 2) && storm_from && (EMU_ps >= (storm_mark ? storm_to : storm_from)))
+		memcpy(storm_irqs[storm_mark++], EMU_irqs, sizeof EMU_irqs);
+	EMU_event_at = (next_edge < edges) ? TRAIN[next_edge].ps : EMU_NEVER;
+	if((storm_mark < 2) && storm_from && ((storm_mark ? storm_to : storm_from) < EMU_event_at))
+		EMU_event_at = storm_mark ? storm_to : storm_from;
+}
+
+void firmware(void){
+	emu_access_hook = HOST_access;		// emu_run has just powered up
+	HOST_access = watch_access;
+	firmware_main();
+}
+
+int check(const char *what, long got, long want){
+	if((want < 0) || (got == want))
+		return 0;
+	printf("  FAILED: %lu %s, should be %ld\n", got, what, want);
+	return 1;
+}
+
+int play(struct train *tr){
+	unsigned long long end;
+	double s;
+	unsigned long rate = 0;
+	int v, bad = 0;
+
+	edges = 0;
+	edge_at(START_MS * PS_MS, 0, 0);			// ENTER starts a 2 minute game
+	edge_at((START_MS + 100) * PS_MS, 0, 1);
+	end = tr->make() + TAIL_MS;
+	memset(host_info, 0xFF, sizeof host_info);
+	emu_flash(host_info, sizeof host_info, 64);
+	emu_event = train_event;
+	EMU_event_at = 0;
+	if(emu_run(firmware, end / 1000.0) != EMU_END){
+		printf("%s: the firmware stopped at %.6f s: %s\n", tr->name, EMU_ps / (double)EMU_PS,
+			EMU_why ? EMU_why : "halted");
+		return 1;
+	}
+
+	printf("%s: %d edges over %.1f s, %lu captures started, %lu aborted, %lu taken, state %d",
+		tr->name, edges - 2, (end - TAIL_MS - NOISE_MS) / 1000.0, started, aborted, captured, state);
+	if(state == ST_OWNED)
+		printf(", %c owns the flag", "RGBY"[owner]);
+	printf("\n ");
+	for(v = 0; v < 16; v++)
+		if(EMU_irqs[v])
+			printf(" %s %lu", VECTOR_NAMES[v], EMU_irqs[v]);
+	printf("\n");
+	if(storm_mark == 2){
+		s = (storm_to - storm_from) / (double)EMU_PS;
+		rate = (storm_irqs[1][2] - storm_irqs[0][2] + storm_irqs[1][8] - storm_irqs[0][8]) / s;
+		printf("  over the train: PORT1 %.0f/s, TIMER0_A1 %.0f/s, %lu/s together\n",
+			(storm_irqs[1][2] - storm_irqs[0][2]) / s, (storm_irqs[1][8] - storm_irqs[0][8]) / s, rate);
+	}
+#ifdef DEB_RATE
+	bad |= check("captures started", started, tr->starts);
+	bad |= check("captures aborted", aborted, tr->aborts);
+	bad |= check("captures completed", captured, tr->captures);
+	if(tr->owner != -2)
+		bad |= check("owner", (state == ST_OWNED) ? owner : -1, tr->owner);
+	if(storm_mark == 2)
+		bad |= check("edge and sample interrupts a second, at most", (rate > 2 * DEB_RATE) ? rate : 2 * DEB_RATE, 2 * DEB_RATE);
+#endif
+	return bad;
+}
+
+int main(int argc, char **argv){
+	int opt, t, status, failed = 0;
+
+	while((opt = getopt(argc, argv, "v:f:")) != -1){
+		if(opt == 'v')
+			EMU_vlo_hz = atol(optarg);
+		else if(opt == 'f')
+			train_file = optarg;
+		else{
+			fprintf(stderr, "usage: ssdebounce [-v vlo_hz] [-f train.txt]\n");
+			return 1;
+		}
+	}
+	if(train_file)
+		return play(&TRAINS[N_TRAINS]);
+	for(t = 0; t < N_TRAINS; t++){
+		fflush(stdout);
+		if(fork() == 0)
+			return play(&TRAINS[t]);
+		wait(&status);
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+	}
+#ifdef DEB_RATE
+	printf(failed ? "FAILED\n" : "all trains passed\n");
+#else
+	printf("no DEB_RATE in this firmware, the trains are reported only\n");
+#endif
+	return failed;
+}
@@ -0,0 +1,209 @@
+/***********************************************************************
+	Seize&Secure energy model, runs on the PC (not the MSP430)
+
+	Plays games on the flag station firmware, built for the emulated
+	MSP430G2553 (host/hostemu.h) with the HD44780 of host/hd44780.h on its
+	LCD pins, and reports for each where the time went: active, LPM0
+	(SMCLK on, for Timer A1 pacing the LCD and the UART) and LPM3 (ACLK
+	only), the wakeups of each handler and the current and charge that
+	makes. Each game runs in a process of its own, so each starts from a
+	power up.
+
+	Currents are the MSP430G2553 datasheet typicals at 3V: active
+	330uA/MHz of MCLK, LPM0 75uA, LPM3 0.6uA with the VLO, LPM4 0.1uA.
+	The datasheet gives LPM0 at 1MHz only, it is taken as is for the 8MHz
+	DCO, so LPM0 time is costed low. The emulator only counts cycles for
+	register accesses, interrupt entry and reti, so active time is a floor
+	too; the wakeup counts are exact. The LCD, the flag LEDs and the IR
+	receivers are left out, the MCU is all it models.
+
+	The firmware before user-007's ACLK timekeeping (a WDT interrupt every
+	32K/8MHz = 4.1ms, sleeping in LPM0 throughout) can be built instead to
+	compare against:
+		git show 2a38e7c^:"laserTag/Seize&Secure.c" > /tmp/old.c
+		cc -O2 -Ihost -DFIRMWARE='"/tmp/old.c"' -o ssenergy_old ssenergy.c
+	Its UP and ENTER are on P1.3 and P1.2, it has no UART or flash log.
+
+	Build:	cc -O2 -Ihost -o ssenergy ssenergy.c
+	Usage:	ssenergy [-v vlo_hz]
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "hostemu.h"
+#include "hd44780.h"
+
+#ifndef FIRMWARE
+#define FIRMWARE "../laserTag/Seize&Secure.c"
+#endif
+
+unsigned char host_info[3 * 64];
+
+#define INFO_FLASH host_info
+#define main firmware_main
+#define int short
+#define long __attribute__((mode(SI))) int
+#include FIRMWARE
+#undef long
+#undef int
+#undef main
+
+#define I_ACTIVE_MHZ 330.0	// uA per MHz of MCLK
+#define I_LPM0 75.0			// uA
+#define I_LPM3 0.6
+#define I_LPM4 0.1
+#define BATTERY_MAH 2000.0	// two AA cells
+#define BUTTON_PORT ((ENTER == 0x80) ? 2 : 1)	// UP/ENTER moved from P1 to P2.6/P2.7 with the UART
+
+#define PRESS(ms, pin)	{ms, 0, pin, 0}, {ms + 100, 0, pin, 1}
+#define HOLD(ms, len, pin)	{ms, 1, pin, 0}, {ms + len, 1, pin, 1}
+#define UPS(ms)		PRESS(ms, UP), PRESS(ms + 300, UP), PRESS(ms + 600, UP), PRESS(ms + 900, UP), \
+					PRESS(ms + 1200, UP), PRESS(ms + 1500, UP), PRESS(ms + 1800, UP), PRESS(ms + 2100, UP), \
+					PRESS(ms + 2400, UP), PRESS(ms + 2700, UP), PRESS(ms + 3000, UP), PRESS(ms + 3300, UP), \
+					PRESS(ms + 3600, UP)
+
+// a game: times (ms) the pins change, port 0 for the buttons' port
+struct input {
+	long ms;
+	int port;
+	unsigned char mask;
+	int level;
+};
+
+struct input SETUP[] = {{0, 1, 0, 1}};
+struct input GAME2[] = {
+	PRESS(1000, ENTER),						// a 2 minute game
+	HOLD(9000, 6000, REDTAKE),				// RED takes the flag
+	HOLD(30000, 2000, GRNTAKE),				// GRN lets go too soon
+	HOLD(40000, 7000, GRNTAKE),				// and steals it
+	HOLD(100000, 3000, REDTAKE)
+};
+struct input GAME15[] = {
+	UPS(1000), PRESS(5000, ENTER),			// 2 + 13 = 15 minutes
+	HOLD(60000, 6000, REDTAKE),				// the flag changes hands within
+	HOLD(170000, 7000, GRNTAKE),			// OWNWIN_SECS, or the game ends
+	HOLD(280000, 7000, REDTAKE),
+	HOLD(390000, 2000, GRNTAKE),			// a try that fails
+	HOLD(395000, 7000, GRNTAKE),
+	HOLD(500000, 7000, REDTAKE),
+	HOLD(610000, 7000, GRNTAKE),
+	HOLD(720000, 7000, REDTAKE),
+	HOLD(830000, 7000, GRNTAKE)
+};
+
+struct game {
+	const char *name;
+	double seconds;
+	struct input *inputs;
+	int n;
+} GAMES[] = {
+	{"setup, 60 s idle", 60.0, SETUP, 1},
+	{"2 minute game", 126.0, GAME2, sizeof GAME2 / sizeof GAME2[0]},	// the LCD starts over once it ends at ~127 s
+	{"15 minute game", 905.0, GAME15, sizeof GAME15 / sizeof GAME15[0]}
+};
+#define N_GAMES (int)(sizeof GAMES / sizeof GAMES[0])
+
+const char *VECTOR_NAMES[16] = {
+	NULL, NULL, "PORT1", "PORT2", NULL, NULL, "USCIAB0TX", NULL,
+	"TIMER0_A1", "TIMER0_A0", "WDT", NULL, "TIMER1_A1", "TIMER1_A0", NULL, NULL
+};
+
+struct hd44780 lcd;
+struct game *game;
+int next_input;
+
+// emu_ports: the LCD pins into the model and its answer onto D7-D4
+void lcd_pins(void){
+	int nibble = hd44780_bus(&lcd, EMU_ps, (HOST_P1OUT & LCDRS) != 0, (HOST_P1OUT & LCDRW) != 0,
+		(HOST_P1OUT & LCDE) != 0, HOST_P2OUT & LCDDATA, (HOST_P2DIR & LCDDATA) != 0);
+
+	EMU_in[1] = (EMU_in[1] & ~LCDDATA) | ((nibble < 0) ? LCDDATA : nibble);
+}
+
+// emu_event: the inputs that are due
+void game_event(void){
+	struct input *in;
+
+	while((next_input < game->n) && (game->inputs[next_input].ms * 1000000000ULL <= EMU_ps)){
+		in = &game->inputs[next_input++];
+		if(in->mask)
+			emu_pin(in->port ? in->port : BUTTON_PORT, in->mask, in->level);
+	}
+	EMU_event_at = (next_input < game->n) ? game->inputs[next_input].ms * 1000000000ULL : EMU_NEVER;
+}
+
+void firmware(void){
+	firmware_main();
+}
+
+// play game g and print where its time and charge went
+int play(int g){
+	double s, mhz, ua, active, lpm0, lpm3, lpm4;
+	unsigned long wakes = 0;
+	char row[17];
+	int v, opt;
+
+	game = &GAMES[g];
+	memset(host_info, 0xFF, sizeof host_info);
+	emu_flash(host_info, sizeof host_info, 64);
+	hd44780_init(&lcd);
+	emu_ports = lcd_pins;
+	emu_event = game_event;
+	EMU_event_at = 0;
+	if(emu_run(firmware, game->seconds) != EMU_END){
+		printf("%s: the firmware stopped at %.6f s: %s\n", game->name, EMU_ps / (double)EMU_PS,
+			EMU_why ? EMU_why : "halted");
+		return 1;
+	}
+	s = EMU_ps / (double)EMU_PS;
+	mhz = emu_dco_hz() / 1e6;
+	active = EMU_mode_ps[EMU_ACTIVE] / (double)EMU_PS;
+	lpm0 = EMU_mode_ps[EMU_LPM0] / (double)EMU_PS;
+	lpm3 = EMU_mode_ps[EMU_LPM3] / (double)EMU_PS;
+	lpm4 = EMU_mode_ps[EMU_LPM4] / (double)EMU_PS;
+	ua = (active * I_ACTIVE_MHZ * mhz + lpm0 * I_LPM0 + lpm3 * I_LPM3 + lpm4 * I_LPM4) / s;
+	for(v = 0; v < 16; v++)
+		wakes += EMU_irqs[v];
+
+	printf("%s, %.0f s at a %lu Hz VLO\n", game->name, s, EMU_vlo_hz);
+	printf("  active %9.4f s %6.3f%%   LPM0 %8.3f s %6.2f%%   LPM3 %8.3f s %6.2f%%\n",
+		active, 100 * active / s, lpm0, 100 * lpm0 / s, lpm3, 100 * lpm3 / s);
+	printf("  %lu wakeups, %.1f a second:", wakes, wakes / s);
+	for(v = 0; v < 16; v++)
+		if(EMU_irqs[v])
+			printf(" %s %lu", VECTOR_NAMES[v], EMU_irqs[v]);
+	printf("\n  %.2f uA on average, %.3f uAh a game, %.1f years on %.0f mAh (the MCU alone)\n",
+		ua, ua * s / 3600, BATTERY_MAH * 1000 / ua / 24 / 365, BATTERY_MAH);
+	for(v = 0; v < 2; v++){
+		hd44780_row(&lcd, v, row);
+		for(opt = 0; opt < 16; opt++)
+			if((unsigned char)row[opt] < 0x10)
+				row[opt] = '0' + (row[opt] & 7);	// bar glyphs as their level
+		printf("  LCD |%s|\n", row);
+	}
+	printf("\n");
+	return 0;
+}
+
+int main(int argc, char **argv){
+	int opt, g, status, failed = 0;
+
+	while((opt = getopt(argc, argv, "v:")) != -1){
+		if(opt != 'v'){
+			fprintf(stderr, "usage: ssenergy [-v vlo_hz]\n");
+			return 1;
+		}
+		EMU_vlo_hz = atol(optarg);
+	}
+	for(g = 0; g < N_GAMES; g++){
+		fflush(stdout);
+		if(fork() == 0)
+			return play(g);
+		wait(&status);
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+	}
+	return failed;
+}
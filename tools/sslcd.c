@@ -0,0 +1,194 @@
+/***********************************************************************
+	Seize&Secure LCD protocol check, runs on the PC (not the MSP430)
+
+	Runs the flag station firmware on the emulated MSP430G2553
+	(host/hostemu.h) with a model of the HD44780 on its LCD pins
+	(host/hd44780.h): RS P1.4, RW P1.5, E P1.6, D7-D4 on P2.3-P2.0. The
+	model answers LCD_status with its busy flag and address counter, and
+	counts every write made while it is busy, every RS/RW change without
+	setup and every bus clash. A game is played through it: the start,
+	RED taking the flag, GRN trying and then stealing it, the end.
+
+	Every 50ms that the LCD has no work queued (TA1CCTL0.CCIE clear) it
+	checks that the display holds LCD_shadow and that CGRAM holds the
+	progress bar glyphs. At the end it prints how long the LCD updates
+	took, against the old pacing of a nibble per 4.1ms WDT tick.
+
+	Build:	cc -O2 -Ihost -o sslcd sslcd.c
+	Usage:	sslcd [-v vlo_hz]
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hostemu.h"
+#include "hd44780.h"
+
+unsigned char host_info[3 * 64];
+
+#define INFO_FLASH host_info
+#define main firmware_main
+#define int short
+#define long __attribute__((mode(SI))) int
+#include "../laserTag/Seize&Secure.c"
+#undef long
+#undef int
+#undef main
+
+#define CHECK_MS 50			// looks at the LCD this often
+#define BURST_GAP (1000 * HD_PS_US)	// LCD activity this far apart starts a new update
+#define OLD_NIBBLE_US 4096.0	// the WDT tick (32K / 8MHz) the old code sent each nibble on
+#define GAME_S 126.0		// the game is over at 127s, and the LCD starts over a jiffy later
+
+// the game: times (ms) the pins change
+struct input {
+	long ms;
+	int port;
+	unsigned char mask;
+	int level;
+} GAME[] = {
+	{1000, 2, ENTER, 0}, {1100, 2, ENTER, 1},	// start a 2 minute game
+	{9000, 1, REDTAKE, 0}, {15000, 1, REDTAKE, 1},	// RED takes the flag
+	{30000, 1, GRNTAKE, 0}, {32000, 1, GRNTAKE, 1},	// GRN lets go too soon
+	{40000, 1, GRNTAKE, 0}, {47000, 1, GRNTAKE, 1},	// and steals it
+	{100000, 1, REDTAKE, 0}, {103000, 1, REDTAKE, 1}
+};
+#define INPUTS (int)(sizeof GAME / sizeof GAME[0])
+
+struct hd44780 lcd;
+int next_input;
+unsigned long long next_check;
+unsigned long checks, mismatches;
+unsigned long long burst_start, burst_last;	// first and last LCD pin change of the update going on
+unsigned long burst_bytes;
+unsigned long bursts, burst_total_bytes, longest_bytes;
+unsigned long long burst_total, longest;
+
+// emu_ports: the LCD pins into the model and its answer onto D7-D4
+void lcd_pins(void){
+	static unsigned char last1, last2;
+	unsigned char p1 = HOST_P1OUT & (LCDRS | LCDRW | LCDE), p2 = HOST_P2OUT & LCDDATA;
+	unsigned long bytes = lcd.bytes;
+	int nibble;
+
+	nibble = hd44780_bus(&lcd, EMU_ps, (p1 & LCDRS) != 0, (p1 & LCDRW) != 0, (p1 & LCDE) != 0,
+		p2, (HOST_P2DIR & LCDDATA) != 0);
+	EMU_in[1] = (EMU_in[1] & ~LCDDATA) | ((nibble < 0) ? LCDDATA : nibble);	// pulled up inside the LCD
+	if((p1 == last1) && (p2 == last2))
+		return;
+	last1 = p1;
+	last2 = p2;
+	if(EMU_ps - burst_last > BURST_GAP){
+		if(burst_bytes){
+			bursts++;
+			burst_total += burst_last - burst_start;
+			burst_total_bytes += burst_bytes;
+			if(burst_last - burst_start > longest){
+				longest = burst_last - burst_start;
+				longest_bytes = burst_bytes;
+			}
+		}
+		burst_start = EMU_ps;
+		burst_bytes = 0;
+	}
+	burst_last = EMU_ps;
+	burst_bytes += lcd.bytes - bytes;
+}
+
+// the LCD is idle: it should show LCD_shadow, with the bar glyphs in CGRAM
+void lcd_check(void){
+	char row[17];
+	int r, level, line, bad = 0;
+
+	for(r = 0; r < 2; r++){
+		hd44780_row(&lcd, r, row);
+		if(memcmp(row, LCD_shadow[r], 16))
+			bad = 1;
+	}
+	for(level = 0; level < BAR_LEVELS; level++)
+		for(line = 0; line < 8; line++)
+			if(lcd.cgram[level * 8 + line] != ((line >= 7 - level) ? 0x1F : 0x00))
+				bad = 1;
+	checks++;
+	if(bad && (mismatches++ < 5)){
+		printf("%9.3f s  the LCD doesn't show LCD_shadow\n", EMU_ps / (double)EMU_PS);
+		for(r = 0; r < 2; r++){
+			hd44780_row(&lcd, r, row);
+			printf("           LCD |%.16s|  LCD_shadow |%.16s|\n", row, LCD_shadow[r]);
+		}
+	}
+}
+
+// emu_event: the next input or check, whichever is due
+void game_event(void){
+	if(EMU_ps >= next_check){
+		if(!(HOST_TA1CCTL0 & CCIE) && (state != ST_LCD))
+			lcd_check();
+		next_check += CHECK_MS * 1000 * HD_PS_US;
+	}
+	while((next_input < INPUTS) && (GAME[next_input].ms * 1000 * HD_PS_US <= EMU_ps)){
+		emu_pin(GAME[next_input].port, GAME[next_input].mask, GAME[next_input].level);
+		next_input++;
+	}
+	EMU_event_at = next_check;
+	if((next_input < INPUTS) && (GAME[next_input].ms * 1000 * HD_PS_US < EMU_event_at))
+		EMU_event_at = GAME[next_input].ms * 1000 * HD_PS_US;
+}
+
+void firmware(void){
+	firmware_main();
+}
+
+int main(int argc, char **argv){
+	char row[17];
+	unsigned long errors = 0;
+	int opt, e, why;
+
+	while((opt = getopt(argc, argv, "v:")) != -1){
+		if(opt != 'v'){
+			fprintf(stderr, "usage: sslcd [-v vlo_hz]\n");
+			return 1;
+		}
+		EMU_vlo_hz = atol(optarg);
+	}
+	memset(host_info, 0xFF, sizeof host_info);
+	emu_flash(host_info, sizeof host_info, LOG_SEG_SIZE);
+	hd44780_init(&lcd);
+	emu_ports = lcd_pins;
+	emu_event = game_event;
+	next_check = CHECK_MS * 1000 * HD_PS_US;
+	EMU_event_at = next_check;
+	why = emu_run(firmware, GAME_S);
+	if(why != EMU_END){
+		printf("the firmware stopped at %.6f s: %s\n", EMU_ps / (double)EMU_PS, EMU_why ? EMU_why : "halted");
+		return 1;
+	}
+
+	printf("%.0f s game at a %lu Hz VLO, state %d, the LCD at the end:\n", GAME_S, EMU_vlo_hz, state);
+	for(e = 0; e < 2; e++){
+		hd44780_row(&lcd, e, row);
+		for(opt = 0; opt < 16; opt++)
+			if((unsigned char)row[opt] < 0x10)
+				row[opt] = '0' + (row[opt] & 7);	// bar glyphs as their level
+		printf("  |%s|\n", row);
+	}
+	printf("%lu bytes (%lu commands) written, %lu busy flag reads of which %lu saw it busy\n",
+		lcd.bytes, lcd.commands, lcd.reads / 2, lcd.busy_reads);
+	for(e = 0; e < HD_ERRORS; e++){
+		printf("  %-48s %lu\n", HD_ERROR_NAMES[e], lcd.errors[e]);
+		errors += lcd.errors[e];
+	}
+	printf("%lu checks of the idle LCD against LCD_shadow and the bar glyphs, %lu wrong\n", checks, mismatches);
+	if(burst_bytes){
+		bursts++;
+		burst_total += burst_last - burst_start;
+		burst_total_bytes += burst_bytes;
+	}
+	printf("%lu updates, %.1f bytes and %.0f us each (%.1f us a byte), the longest %lu bytes in %.0f us\n",
+		bursts, (double)burst_total_bytes / bursts, burst_total / 1e6 / bursts,
+		burst_total / 1e6 / burst_total_bytes, longest_bytes, longest / 1e6);
+	printf("a nibble per WDT tick took %.0f us a byte, %.0f us for the longest\n",
+		2 * OLD_NIBBLE_US, 2 * OLD_NIBBLE_US * longest_bytes);
+	return (errors != 0) || (mismatches != 0) || (checks == 0);
+}
@@ -0,0 +1,163 @@
+/***********************************************************************
+	Seize&Secure event log decoder, runs on the PC (not the MSP430)
+
+	Reads a dump of the info flash segments D, C and B (0x1000-0x10BF)
+	of a Seize&Secure flag station, e.g. made with
+		mspdebug rf2500 "save_raw 0x1000 192 info.bin"
+	and prints the games in it as a timeline. The record format is
+	described with log_event in laserTag/Seize&Secure.c.
+
+	Build:	cc -o sslog sslog.c
+	Usage:	sslog info.bin
+
+ ***********************************************************************/
+
+#include <stdio.h>
+
+#define LOG_SEGS 3
+#define LOG_SEG_SIZE 64
+#define LOG_TYPE	0xE0
+#define LOG_TEAM	0x18
+#define LOG_DELTA	0x07
+#define LOG_START	0x00
+#define LOG_TAKE	0x20
+#define LOG_ABORT	0x40
+#define LOG_OWNED	0x60
+#define LOG_SCORE	0x80
+#define LOG_OVER	0xA0
+#define LOG_TIE		0xC0
+
+const char *TEAMS[4] = {"RED", "GRN", "BLU", "YEL"};
+
+unsigned long now;			// seconds since the first record of the dump
+unsigned long game_start;	// now at the last LOG_START
+int games;
+int score[4];
+int teams;					// teams seen scoring in the current game, at least 2
+
+void print_time(){
+	unsigned long t = now - game_start;
+
+	if(games == 0)
+		printf("  +%4lus  ", t);
+	else
+		printf("  %3lu:%02lu  ", t / 60, t % 60);
+}
+
+// print the record at rec, returns its length or 0 if the segment ends there
+int decode(const unsigned char *rec, int left){
+	int len = 1, i;
+	unsigned long delta;
+	unsigned char team;
+
+	if(rec[0] == 0xFF)
+		return 0;
+	delta = rec[0] & LOG_DELTA;
+	if(delta == 7){
+		do{
+			if(len >= left)
+				return 0;
+			delta += rec[len];
+		} while(rec[len++] == 254);
+	}
+	now += delta;
+	team = (rec[0] & LOG_TEAM) >> 3;
+
+	switch(rec[0] & LOG_TYPE){
+		case LOG_START:
+			if(len >= left)
+				return 0;
+			games++;
+			game_start = now;
+			score[0] = score[1] = score[2] = score[3] = 0;
+			teams = 2;
+			printf("\ngame %d, %u minutes\n", games, rec[len]);
+			len++;
+			print_time();
+			printf("start\n");
+			break;
+		case LOG_TAKE:
+			print_time();
+			printf("%s is taking the flag\n", TEAMS[team]);
+			break;
+		case LOG_ABORT:
+			print_time();
+			printf("%s let go\n", TEAMS[team]);
+			break;
+		case LOG_OWNED:
+			print_time();
+			printf("%s owns the flag\n", TEAMS[team]);
+			break;
+		case LOG_SCORE:
+			print_time();
+			score[team]++;
+			if(team >= teams)
+				teams = team + 1;
+			printf("%s scores (", TEAMS[team]);
+			for(i = 0; i < teams; i++)
+				printf("%s%s %d", i ? ", " : "", TEAMS[i], score[i]);
+			printf(")\n");
+			break;
+		case LOG_OVER:
+			print_time();
+			printf("game over, %s wins\n", TEAMS[team]);
+			break;
+		case LOG_TIE:
+			print_time();
+			printf("game over, tie\n");
+			break;
+		default:
+			print_time();
+			printf("unknown record 0x%02X\n", rec[0]);
+			break;
+	}
+	return len;
+}
+
+int main(int argc, char *argv[]){
+	unsigned char flash[LOG_SEGS][LOG_SEG_SIZE];
+	int order[LOG_SEGS];
+	int i, j, n, pos, len;
+	FILE *f;
+
+	if(argc != 2){
+		fprintf(stderr, "usage: %s info.bin\n", argv[0]);
+		return 2;
+	}
+	f = fopen(argv[1], "rb");
+	if(f == NULL){
+		perror(argv[1]);
+		return 1;
+	}
+	if(fread(flash, 1, sizeof flash, f) != sizeof flash){
+		fprintf(stderr, "%s: need %d bytes from 0x1000\n", argv[1], (int)sizeof flash);
+		return 1;
+	}
+	fclose(f);
+
+	// oldest segment first, sequence bytes count up (wrapping 0xFE -> 0)
+	n = 0;
+	for(i = 0; i < LOG_SEGS; i++){
+		if(flash[i][0] == 0xFF)
+			continue;
+		for(j = n; (j > 0) && ((unsigned char)(flash[order[j - 1]][0] - flash[i][0]) < 0x80); j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+		n++;
+	}
+	if(n == 0){
+		printf("log is empty\n");
+		return 0;
+	}
+	if(flash[order[0]][1] != 0xFF && (flash[order[0]][1] & LOG_TYPE) != LOG_START)
+		printf("(the log starts in the middle of a game)\n");
+
+	for(i = 0; i < n; i++){
+		for(pos = 1; pos < LOG_SEG_SIZE; pos += len){
+			len = decode(&flash[order[i]][pos], LOG_SEG_SIZE - pos);
+			if(len == 0)
+				break;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+/***********************************************************************
+	Seize&Secure ISR probe reader, runs on the PC (not the MSP430)
+
+	A flag station built with -DPROBE sends one probe frame a second next
+	to its telemetry frames (see probe_dump in laserTag/Seize&Secure.c),
+	each carrying the duration histogram of one probe since reset. This
+	keeps the newest frame of every probe and prints a table of them each
+	time the station has gone round all the probes, and again at the end
+	of the input. Percentiles are the upper end of the histogram bucket
+	they fall in, so "<=7" means 4-7us; durations are TA1 counts (1us).
+	Telemetry frames are passed over, sstlm prints them.
+
+	Build:	cc -o ssprobe ssprobe.c
+	Usage:	stty -F /dev/ttyACM0 115200 raw
+			ssprobe /dev/ttyACM0
+		or	ssprobe capture.bin
+
+ ***********************************************************************/
+
+#include <stdio.h>
+
+#define TLM_SYNC 0xA5
+#define TLM_LEN 13
+#define PROBE_SYNC 0xA6
+#define PROBE_BUCKETS 8
+#define PROBE_LEN (2 + 2 * PROBE_BUCKETS + 2 + 1)
+#define N_PROBES 6
+
+const char *PROBES[N_PROBES] = {"port", "timer", "debounce", "tx", "lcd", "lcd late"};
+
+unsigned long counts[N_PROBES][PROBE_BUCKETS];
+unsigned int longest[N_PROBES];
+int seen[N_PROBES];
+
+// print the upper end of the bucket holding the given fraction of a probe's samples
+void print_percentile(int p, unsigned long total, int percent){
+	unsigned long sum = 0;
+	int b;
+
+	for(b = 0; b < PROBE_BUCKETS - 1; b++){
+		sum += counts[p][b];
+		if(sum * 100 >= total * percent)
+			break;
+	}
+	if(b == PROBE_BUCKETS - 1)
+		printf(" %7s", ">=256");
+	else{
+		char s[8];
+		sprintf(s, "<=%d", (4 << b) - 1);
+		printf(" %7s", s);
+	}
+}
+
+void print_table(){
+	unsigned long total;
+	int p, b;
+
+	printf("%-9s %8s %7s %7s %7s\n", "probe", "count", "p50", "p99", "max");
+	for(p = 0; p < N_PROBES; p++){
+		if(!seen[p])
+			continue;
+		total = 0;
+		for(b = 0; b < PROBE_BUCKETS; b++)
+			total += counts[p][b];
+		printf("%-9s %8lu", PROBES[p], total);
+		if(total == 0)
+			printf(" %7s %7s", "-", "-");
+		else{
+			print_percentile(p, total, 50);
+			print_percentile(p, total, 99);
+		}
+		printf(" %7u\n", longest[p]);
+	}
+	printf("\n");
+}
+
+// keep a good probe frame, 1 when it was the last probe of a round
+int take_frame(const unsigned char *f){
+	int p = f[1], b;
+
+	if(p >= N_PROBES)
+		return 0;
+	for(b = 0; b < PROBE_BUCKETS; b++)
+		counts[p][b] = f[2 + 2 * b] | (f[3 + 2 * b] << 8);
+	longest[p] = f[PROBE_LEN - 3] | (f[PROBE_LEN - 2] << 8);
+	seen[p] = 1;
+	return p == N_PROBES - 1;
+}
+
+int main(int argc, char *argv[]){
+	unsigned char f[PROBE_LEN], sum;
+	int n = 0, len, i, j, c, frames = 0;
+	FILE *in = stdin;
+
+	if(argc > 2){
+		fprintf(stderr, "usage: %s [device or file]\n", argv[0]);
+		return 2;
+	}
+	if(argc == 2){
+		in = fopen(argv[1], "rb");
+		if(in == NULL){
+			perror(argv[1]);
+			return 1;
+		}
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	while((c = getc(in)) != EOF){
+		if((n == 0) && (c != TLM_SYNC) && (c != PROBE_SYNC))
+			continue;
+		f[n++] = c;
+		while((n != 0) && (n >= (len = (f[0] == PROBE_SYNC) ? PROBE_LEN : TLM_LEN))){
+			sum = 0;
+			for(i = 1; i < len; i++)
+				sum += f[i];
+			if(sum != 0)
+				// not a frame, look for the next sync byte after this one
+				for(i = 1; (i < n) && (f[i] != TLM_SYNC) && (f[i] != PROBE_SYNC); i++);
+			else{
+				if((f[0] == PROBE_SYNC) && take_frame(f))
+					print_table();
+				frames += (f[0] == PROBE_SYNC);
+				i = len;
+			}
+			for(j = 0; i < n; )
+				f[j++] = f[i++];
+			n = j;
+		}
+	}
+	if(frames == 0){
+		fprintf(stderr, "no probe frames, was the station built with -DPROBE?\n");
+		return 1;
+	}
+	print_table();
+	return 0;
+}
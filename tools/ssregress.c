@@ -0,0 +1,835 @@
+/***********************************************************************
+	Seize&Secure regression games, runs on the PC (not the MSP430)
+
+	Plays scripted games on the flag station firmware, built with -DRECORD
+	as ssreplay builds it: a script (button presses and target holds, in
+	seconds) is written as a recording stream, fed to the firmware's own
+	replay code through UCA0RXBUF as fast as REC_buf takes it, and time
+	only jumps from one Timer A0 deadline to the next, the UART's work
+	being done at once. The LCD pins drive the host/hd44780.h controller,
+	Timer A1 running on from the game's time for LCD_handler, and the LCD
+	checked is that model's DDRAM. Each game starts from a power up: every
+	variable of the program is put back as it was before the first game,
+	as the chip's start up code would set them.
+
+	The named scenarios have golden results for the default game rules:
+	the LCD when the game ends (state ST_OVER, before over_poll clears it
+	a jiffy later), the scores and the winner's flag:
+	- timeout: nobody plays, a 0-0 tie.
+	- capture: RED takes the flag and scores until the time is up.
+	- abort: GRN lets go before CAPTURE_SECS, nobody scores.
+	- steal: GRN takes the flag from RED, both score.
+	- steal_abort: GRN lets go before stealing, RED keeps scoring.
+	- tie: the flag changes hands so both end on the same score.
+	- ownwin: RED holds the flag OWNWIN_SECS in a 5 minute game.
+	- late: RED is still taking the flag when the time is up.
+	- contest: RED and GRN shoot at once, the first hit is the attacker.
+
+	Then it plays random games: 2-15 minutes, each team holding its
+	target at random for a short (aborted) or long (capturing) while,
+	often over another's. Random games are checked against a referee,
+	the harness's own count of the game from the script alone: it
+	debounces the edges as the firmware's sampler would (every DEB_TICKS,
+	in step with the samples already running for another target, hit at
+	DEB_HOLD and let go at DEB_RELEASE) and plays the rules on the jiffy
+	grid (a capture takes CAPTURE_SECS, the owner scores every SCORE_SECS
+	and wins after OWNWIN_SECS, the timers of a jiffy go before its
+	targets). The game must start and end on the referee's jiffies, the
+	LCD must show the referee's points (which it counts as plain numbers,
+	a score past 99 shows) and 00:00 if the time ran out, the flags its
+	winner (all the leaders' for a tie), and the LCD model must have seen
+	no protocol errors. Game n is played the same on every run, whichever
+	shard gets it, so a failure can be played again alone with -g.
+
+	The random games are split over shards, -j of them (default: one per
+	core), each a process forked once that plays all of its games.
+
+	Build:	cc -O2 -Ihost -o ssregress ssregress.c
+			(add -DNUM_TEAMS=n, -DCAPTURE_SECS=n etc. to sweep other game
+			rules: the named scenarios are only checked with the defaults)
+	Usage:	ssregress [-n games] [-j shards] [-s seed] [-v]
+			ssregress -g game [-s seed]
+		-n	random games to play (default 10000)
+		-v	print every scenario's LCD
+		-g	play random game n alone and print its script and LCD
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "hd44780.h"
+
+#define MAX_STREAM 4096
+#define MAX_INPUTS 256
+#define VLO_HZ 12000			// ONE_SEC of the recording, the VLO's nominal rate
+
+unsigned char replay_stream[MAX_STREAM];
+unsigned int replay_len;
+unsigned char host_info[256];		// info flash, blank
+
+static inline void feed_access(const volatile void *reg);
+#define HOST_ACCESS feed_access		// bound at compile time, so it inlines into each access
+
+// the firmware, with 16 bit ints like on the MSP430
+#define RECORD
+#define INFO_FLASH host_info
+#define main firmware_main
+#define int short
+#include "../laserTag/Seize&Secure.c"
+#undef int
+#undef main
+
+#define DEFAULT_RULES ((NUM_TEAMS == 2) && (STARTUP_SECS == 6) && (CAPTURE_SECS == 5) \
+	&& (SCORE_SECS == 10) && (OWNWIN_SECS == 120))
+#define ENTER_AT 2.0			// seconds after power up ENTER is pressed, UPs go before it
+#define GAME_AT (ENTER_AT + STARTUP_SECS)	// the game starts, script times count from here
+
+//-----Scripts-----
+
+// an input: at seconds from the game's start (negative: before ENTER_AT), a
+// button press (team NO_TEAM, the P2IFG bits in level) or a team's target
+// going to level (0 shot at)
+struct input {
+	double at;
+	unsigned char team;
+	unsigned char level;
+};
+
+struct script {
+	int minutes;
+	int n;
+	struct input in[MAX_INPUTS];
+};
+
+void script_init(struct script *s, int minutes){
+	int i;
+
+	s->minutes = minutes;
+	s->n = 0;
+	for(i = 2; i < minutes; i++)
+		s->in[s->n++] = (struct input){-STARTUP_SECS - 1.5 + 0.05 * i, NO_TEAM, UP};
+	s->in[s->n++] = (struct input){-STARTUP_SECS, NO_TEAM, ENTER};
+}
+
+// team t holds its target from from to to (seconds from the game's start)
+void hold(struct script *s, unsigned char t, double from, double to){
+	if(s->n + 2 > MAX_INPUTS)
+		return;
+	s->in[s->n++] = (struct input){from, t, 0};
+	s->in[s->n++] = (struct input){to, t, 1};
+}
+
+int by_time(const void *a, const void *b){
+	double d = ((const struct input *)a)->at - ((const struct input *)b)->at;
+
+	return (d > 0) - (d < 0);
+}
+
+void stream_put(unsigned long ticks, unsigned char kind, unsigned char data){
+	unsigned long code = (ticks << 2) | kind;
+
+	while(code >= 0x80){
+		replay_stream[replay_len++] = code | 0x80;
+		code >>= 7;
+	}
+	replay_stream[replay_len++] = code;
+	replay_stream[replay_len++] = data;
+}
+
+// tick of at seconds from the game's start, as the stream has it
+unsigned long script_tick(double at){
+	return (at + GAME_AT) * VLO_HZ;
+}
+
+// the script as the recording stream a -DRECORD station would have sent
+void script_stream(struct script *s){
+	unsigned long tick, last = 0;
+	unsigned char takes = TAKES;
+	int i;
+
+	qsort(s->in, s->n, sizeof s->in[0], by_time);
+	replay_len = 0;
+	replay_stream[replay_len++] = VLO_HZ & 0xFF;
+	replay_stream[replay_len++] = VLO_HZ >> 8;
+	replay_stream[replay_len++] = NUM_TEAMS;
+	replay_stream[replay_len++] = takes;
+	for(i = 0; (i < s->n) && (replay_len + REC_MAX <= MAX_STREAM); i++){
+		tick = script_tick(s->in[i].at);
+		if(s->in[i].team == NO_TEAM)
+			stream_put(tick - last, REC_BUTTONS, s->in[i].level);
+		else{
+			takes = s->in[i].level ? (takes | TEAM[s->in[i].team].take) : (takes & ~TEAM[s->in[i].team].take);
+			stream_put(tick - last, REC_EDGE, takes);
+		}
+		last = tick;
+	}
+}
+
+//-----Play-----
+
+#define JIFFY_TICKS (VLO_HZ / JIFFY_DIV)	// ticks of a jiffy
+#define ACCESS_PS 375000ULL		// a register access, 3 MCLK cycles at 8MHz
+
+extern char __data_start[], _end[];	// the program's .data and .bss, as GNU ld names them
+char *power_up;					// what they held before the first game
+
+// put every variable back as it was before the first game
+void reset(){
+	memcpy(__data_start, power_up, _end - __data_start);
+}
+
+struct hd44780 lcd;
+unsigned long long lcd_ps;		// the LCD's time, ahead of the game's while LCD_handler works
+unsigned char lcd_p1, lcd_p2, lcd_dir;	// the LCD pins as the model last saw them
+unsigned char lcd_moved;		// the last access was to one of their registers
+
+// the LCD pins into the model and its answer onto D7-D4
+void lcd_pins(){
+	int nibble;
+
+	lcd_p1 = HOST_P1OUT & (LCDRS | LCDRW | LCDE);
+	lcd_p2 = HOST_P2OUT & LCDDATA;
+	lcd_dir = HOST_P2DIR & LCDDATA;
+	nibble = hd44780_bus(&lcd, lcd_ps, (lcd_p1 & LCDRS) != 0, (lcd_p1 & LCDRW) != 0, (lcd_p1 & LCDE) != 0,
+		lcd_p2, lcd_dir != 0);
+	HOST_P2IN = (HOST_P2IN & ~LCDDATA) | ((nibble < 0) ? LCDDATA : nibble);	// pulled up inside the LCD
+}
+
+// the LCD's time catches up with the game's
+void lcd_sync(){
+	unsigned long long ps = HOST_ticks * 1000000ULL / VLO_HZ * HD_PS_US;
+
+	if(lcd_ps < ps)
+		lcd_ps = ps;
+}
+
+int fed;						// stream bytes in UCA0RXBUF so far, REC_SYNC first
+
+// the next stream byte into UCA0RXBUF once the last one was read and REC_buf has room
+void feed(){
+	if((HOST_IFG2 & UCA0RXIFG) || (fed > (int)replay_len) || !((REC_head - REC_tail - 1) & (REC_SIZE - 1)))
+		return;
+	HOST_UCA0RXBUF = fed ? replay_stream[fed - 1] : REC_SYNC;
+	fed++;
+	HOST_IFG2 |= UCA0RXIFG;
+}
+
+// every register access: the clocks, the LCD pins the last access moved,
+// and the stream for replay_init's polling
+static inline void feed_access(const volatile void *reg){
+	lcd_ps += ACCESS_PS;
+	if(lcd_moved){
+		lcd_moved = 0;
+		if(((HOST_P1OUT & (LCDRS | LCDRW | LCDE)) != lcd_p1) || ((HOST_P2OUT & LCDDATA) != lcd_p2)
+		|| ((HOST_P2DIR & LCDDATA) != lcd_dir))
+			lcd_pins();
+	}
+	if((reg == &HOST_P1OUT) || (reg == &HOST_P2OUT) || (reg == &HOST_P2DIR))
+		lcd_moved = 1;			// the access may move them, the next one sees where to
+	if(reg == &HOST_TA0R)
+		HOST_TA0R = (unsigned short)HOST_ticks;
+	else if(reg == &HOST_TA1R)
+		HOST_TA1R = (unsigned short)(lcd_ps / HD_PS_US);
+	else if(reg == &HOST_UCA0RXBUF)
+		HOST_IFG2 &= ~UCA0RXIFG;
+	else if(reg == &HOST_IFG2)
+		feed();
+}
+
+// Timer A0 compare: the tick TA0R next reaches ccr, after this one
+unsigned long compare_at(unsigned short ccr){
+	unsigned short d = ccr - TA0R;
+
+	return HOST_ticks + (d ? d : 0x10000);
+}
+
+// run LCD_handler at each of its Timer A1 compares, all at once: the game
+// only looks at the LCD from its jiffy timers
+void lcd_drain(){
+	unsigned short wait;
+
+	while(TA1CCTL0 & CCIE){
+		wait = TA1CCR0 - (unsigned short)(lcd_ps / HD_PS_US);
+		lcd_ps += wait * HD_PS_US;
+		LCD_handler();
+	}
+}
+
+// the UART's bytes are dropped, telemetry isn't checked here
+void uart_drain(){
+	while(UC0IE & UCA0TXIE)
+		tx_handler();
+}
+
+unsigned long started_at;		// tick the game started (ST_WAIT)
+
+// run whatever is pending at this tick, by interrupt priority
+void interrupts(){
+	for(;;){
+		feed();
+		lcd_sync();
+		if((TA0CCTL0 & CCIE) && (TA0CCTL0 & CCIFG)){
+			TA0CCTL0 &= ~CCIFG;
+			timer_handler();
+		}
+		else if((TA0CCTL2 & CCIE) && (TA0CCTL2 & CCIFG)){
+			TA0CCTL2 &= ~CCIFG;
+			TA0IV = TA0IV_TACCR2;
+			debounce_handler();
+		}
+		else if((UC0IE & UCA0RXIE) && (UC0IFG & UCA0RXIFG))
+			rx_handler();
+		else if(P2IFG & P2IE)
+			button_handler();
+		else if(P1IFG & P1IE)
+			target_handler();
+		else if((TA0CCTL1 & CCIE) && (TA0CCTL1 & CCIFG)){
+			TA0CCTL1 &= ~CCIFG;
+			TA0IV = TA0IV_TACCR1;
+			debounce_handler();
+		}
+		else
+			break;
+		lcd_drain();
+		uart_drain();
+		if((state == ST_WAIT) && !started_at)
+			started_at = HOST_ticks;
+	}
+}
+
+// play the script from a power up until the game is over (returns 1) or
+// 5 s past its time (returns 0)
+int play(struct script *s){
+	unsigned long until, next, at;
+
+	reset();
+	script_stream(s);
+	until = script_tick(60 * s->minutes + 5);
+	memset(host_info, 0xFF, sizeof host_info);
+	hd44780_init(&lcd);
+	HOST_P2IN = 0;				// ENTER held at power up: replay
+	init_game();
+	lcd_drain();
+	uart_drain();
+	interrupts();
+	while((HOST_ticks < until) && (state != ST_OVER)){
+		next = until;
+		if(TA0CCTL0 & CCIE)
+			next = compare_at(TA0CCR0);
+		if((TA0CCTL1 & CCIE) && ((at = compare_at(TA0CCR1)) < next))
+			next = at;
+		if((TA0CCTL2 & CCIE) && ((at = compare_at(TA0CCR2)) < next))
+			next = at;
+		if(next > until)
+			next = until;
+		HOST_ticks = next;
+		if(TA0R == TA0CCR0)
+			TA0CCTL0 |= CCIFG;
+		if(TA0R == TA0CCR1)
+			TA0CCTL1 |= CCIFG;
+		if(TA0R == TA0CCR2)
+			TA0CCTL2 |= CCIFG;
+		interrupts();
+	}
+	return state == ST_OVER;
+}
+
+// the LCD as text, from the model's DDRAM, progress bar glyphs as their level
+void lcd_row(int row, char text[17]){
+	int col;
+
+	hd44780_row(&lcd, row, text);
+	for(col = 0; col < 16; col++)
+		if((text[col] & 0xF8) == BAR(0))
+			text[col] = '0' + text[col] - BAR(0);
+}
+
+// print the protocol errors the LCD model counted, returns 1 if there were any
+int lcd_errors(){
+	int e, bad = 0;
+
+	for(e = 0; e < HD_ERRORS; e++)
+		if(lcd.errors[e]){
+			printf("the LCD model counted %lu %s\n", lcd.errors[e], HD_ERROR_NAMES[e]);
+			bad = 1;
+		}
+	return bad;
+}
+
+// the flag LEDs lit, FLAGS bits
+unsigned int flags_lit(){
+	return (P2OUT & FLAGS & 0xFF) | ((unsigned int)P3OUT << 8 & FLAGS);
+}
+
+// the winner the flags show: a team's letter, '=' for a tie (the flags of the
+// teams sharing the highest score lit), '?' otherwise
+char flags_winner(){
+	unsigned int lit = flags_lit(), tied = 0;
+	unsigned char t, best = 0;
+
+	for(t = 0; t < NUM_TEAMS; t++)
+		if(lit == TEAM[t].flag)
+			return "RGBY"[t];
+	for(t = 0; t < NUM_TEAMS; t++)
+		if(SCORE[t] > best)
+			best = SCORE[t];
+	for(t = 0; t < NUM_TEAMS; t++)
+		if(SCORE[t] == best)
+			tied |= TEAM[t].flag;
+	if(lit == tied)
+		return '=';
+	return '?';
+}
+
+//-----Scenarios-----
+
+struct scenario {
+	const char *name;
+	int minutes;
+	void (*script)(struct script *);
+	const char *row[2];			// the LCD at game over
+	char winner;
+};
+
+void no_play(struct script *s){
+}
+
+void capture(struct script *s){
+	hold(s, RED, 2, 8);
+}
+
+void abort_capture(struct script *s){
+	hold(s, GRN, 2, 4);
+}
+
+void steal(struct script *s){
+	hold(s, RED, 2, 8);
+	hold(s, GRN, 33, 40);
+}
+
+void steal_abort(struct script *s){
+	hold(s, RED, 2, 8);
+	hold(s, GRN, 33, 36);
+}
+
+void tie(struct script *s){
+	hold(s, RED, 2, 8);
+	hold(s, GRN, 56, 62);
+}
+
+void ownwin(struct script *s){
+	hold(s, RED, 2, 8);
+}
+
+void late(struct script *s){
+	hold(s, GRN, 2, 8);
+	hold(s, RED, 117, 125);
+}
+
+void contest(struct script *s){
+	hold(s, GRN, 2, 9);
+	hold(s, RED, 2.5, 9);
+}
+
+struct scenario SCENARIOS[] = {
+	{"timeout", 2, no_play, {"G 00 T00:00 R 00", "  0   F0:00   0 "}, '='},
+	{"capture", 2, capture, {"G 00 T00:00 R 11", "  0   F1:53   0 "}, 'R'},
+	{"abort", 2, abort_capture, {"G 00 T00:00 R 00", "  0   F0:00   0 "}, '='},
+	{"steal", 2, steal, {"G 08 T00:00 R 03", "  0   F1:22   0 "}, 'G'},
+	{"steal_abort", 2, steal_abort, {"G 00 T00:00 R 11", "  0   F1:53   0 "}, 'R'},
+	{"tie", 2, tie, {"G 05 T00:00 R 05", "  0   F0:59   0 "}, '='},
+	{"ownwin", 5, ownwin, {"G 00 T02:53 R 12", "  0   F1:59   0 "}, 'R'},
+	{"late", 2, late, {"G 11 T00:00 R 00", "  0   F1:53   4 "}, 'G'},
+	{"contest", 2, contest, {"G 11 T00:00 R 00", "  0   F1:53   0 "}, 'G'}
+};
+#define N_SCENARIOS (int)(sizeof SCENARIOS / sizeof SCENARIOS[0])
+
+int verbose;
+
+int scenario(struct scenario *sc){
+	struct script s;
+	char row[2][17];
+	char winner;
+	int r, bad;
+
+	script_init(&s, sc->minutes);
+	sc->script(&s);
+	if(!play(&s)){
+		printf("%s: FAILED, the game isn't over after %d minutes\n", sc->name, sc->minutes);
+		return 1;
+	}
+	bad = lcd_errors();
+	for(r = 0; r < 2; r++){
+		lcd_row(r, row[r]);
+		bad |= strcmp(row[r], sc->row[r]) != 0;
+	}
+	winner = flags_winner();
+	bad |= winner != sc->winner;
+	if(bad || verbose){
+		printf("%s: %s, %.3f s into the game, flags show %c\n", sc->name, bad ? "FAILED" : "ok",
+			(double)(HOST_ticks - started_at) / VLO_HZ, winner);
+		for(r = 0; r < 2; r++)
+			printf("  [%s]%s%s%s\n", row[r], bad ? "  golden [" : "", bad ? sc->row[r] : "", bad ? "]" : "");
+		if(bad && (winner != sc->winner))
+			printf("  golden winner %c\n", sc->winner);
+	}
+	return bad;
+}
+
+//-----Referee-----
+
+#define DEB_TICKS (VLO_HZ / DEB_RATE)	// ticks between debounce samples
+
+// a debounced target: team's target hit (level 0) or let go (level 1) at tick
+struct call {
+	unsigned long tick;
+	unsigned char team;
+	unsigned char level;
+};
+
+// the game by the rules: it starts and ends on jiffies start and end,
+// winner is the team that held the flag OWNWIN_SECS or NO_TEAM when the
+// time ran out
+struct referee {
+	unsigned long start, end;
+	unsigned int points[NUM_TEAMS];
+	unsigned char winner;
+};
+
+// the hits and let gos the script's edges make once debounced: a pin is
+// sampled every DEB_TICKS from its first edge on, in step with the samples
+// already running for other pins, until its count settles where it is held
+int referee_calls(struct script *s, struct call *c){
+	unsigned char level[NUM_TEAMS], count[NUM_TEAMS], held[NUM_TEAMS], sampling[NUM_TEAMS], pin, t, busy;
+	unsigned long sample = 0, edge;		// sample 0: no pin is being sampled
+	int i = 0, n = 0;
+
+	for(t = 0; t < NUM_TEAMS; t++){
+		level[t] = 1;
+		count[t] = held[t] = sampling[t] = 0;
+	}
+	for(;;){
+		while((i < s->n) && (s->in[i].team == NO_TEAM))
+			i++;
+		edge = (i < s->n) ? script_tick(s->in[i].at) : 0;
+		if((i < s->n) && (!sample || (edge <= sample))){	// an edge goes before a sample at its tick
+			t = s->in[i++].team;
+			level[t] = s->in[i - 1].level;
+			if(!sampling[t]){
+				sampling[t] = 1;
+				if(!sample)
+					sample = edge + DEB_TICKS;
+			}
+			continue;
+		}
+		if(!sample)
+			return n;
+		busy = 0;
+		for(pin = 0; pin < 8; pin++){
+			t = PIN_TEAM[pin];
+			if((t >= NUM_TEAMS) || !sampling[t])
+				continue;
+			if(!level[t]){
+				if(count[t] < DEB_MAX)
+					count[t]++;
+			}
+			else if(count[t] > 0)
+				count[t]--;
+			if(!held[t] && (count[t] >= DEB_HOLD)){
+				held[t] = 1;
+				c[n++] = (struct call){sample, t, 0};
+			}
+			else if(held[t] && (count[t] <= DEB_RELEASE)){
+				held[t] = 0;
+				c[n++] = (struct call){sample, t, 1};
+			}
+			if(count[t] == (held[t] ? DEB_MAX : 0))
+				sampling[t] = level[t] == held[t];	// settled, unless it moved again
+			busy |= sampling[t];
+		}
+		sample = busy ? sample + DEB_TICKS : 0;
+	}
+}
+
+// referee the script's game jiffy by jiffy: the timers due in a jiffy go
+// first, in the firmware's timer order (a capture rearms the owner's
+// timers, so the old owner's point due in the same jiffy is lost), then
+// the targets debounced in it
+void referee(struct script *s, struct referee *r){
+	struct call c[MAX_INPUTS], *in;
+	unsigned long capture = 0, score = 0, ownwin = 0, j, at;	// jiffies the timers run, 0 while stopped
+	unsigned char st = ST_WAIT, attacker = NO_TEAM, owner = NO_TEAM, t;
+	int i, k = 0, n = referee_calls(s, c);
+
+	for(i = 0; s->in[i].level != ENTER; i++)
+		;
+	r->start = script_tick(s->in[i].at) / JIFFY_TICKS + SEC(STARTUP_SECS);
+	r->end = r->start + SEC(60) * s->minutes;
+	r->winner = NO_TEAM;
+	for(t = 0; t < NUM_TEAMS; t++)
+		r->points[t] = 0;
+	for(;;){
+		j = r->end;
+		if(capture && (capture < j))
+			j = capture;
+		if(score && (score < j))
+			j = score;
+		if(ownwin && (ownwin < j))
+			j = ownwin;
+		if((k < n) && (c[k].tick / JIFFY_TICKS < j)){
+			in = &c[k++];
+			at = in->tick / JIFFY_TICKS;
+			if(at < r->start)
+				continue;				// still ST_START
+			if(!in->level && ((st == ST_WAIT) || ((st == ST_OWNED) && (in->team != owner)))){
+				attacker = in->team;
+				capture = at + SEC(CAPTURE_SECS);
+				st = (st == ST_WAIT) ? ST_TAKE : ST_STEAL;
+			}
+			else if(in->level && (in->team == attacker)){
+				attacker = NO_TEAM;
+				capture = 0;
+				st = (st == ST_TAKE) ? ST_WAIT : ST_OWNED;
+			}
+			continue;
+		}
+		if(j == capture){
+			owner = attacker;
+			attacker = NO_TEAM;
+			capture = 0;
+			score = j + SEC(SCORE_SECS);
+			ownwin = j + SEC(OWNWIN_SECS);
+			st = ST_OWNED;
+		}
+		if(j == score){
+			r->points[owner]++;
+			score += SEC(SCORE_SECS);
+		}
+		if(j == ownwin){
+			r->end = j;
+			r->winner = owner;
+			return;
+		}
+		if(j == r->end)
+			return;
+	}
+}
+
+//-----Random games-----
+
+unsigned long long seed0 = 1;
+
+// xorshift, seeded per game so game n plays the same in any shard
+unsigned long long rnd_state;
+
+unsigned long rnd(unsigned long n){
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return (unsigned long)((rnd_state >> 11) % n);
+}
+
+double rnd_secs(double from, double to){
+	return from + (to - from) * rnd(100000) / 100000.0;
+}
+
+void random_script(struct script *s, unsigned long game){
+	double at[NUM_TEAMS], len;
+	unsigned char t;
+	int holds;
+
+	rnd_state = (seed0 * 0x9E3779B97F4A7C15ULL) ^ (game + 1) * 0xBF58476D1CE4E5B9ULL;
+	if(!rnd_state)
+		rnd_state = 1;
+	script_init(s, 2 + rnd(14));
+	for(t = 0; t < NUM_TEAMS; t++)
+		at[t] = rnd_secs(0, 30);
+	for(holds = rnd(60); holds > 0; holds--){
+		t = rnd(NUM_TEAMS);
+		len = rnd(3) ? rnd_secs(0.1, CAPTURE_SECS - 0.5) : rnd_secs(CAPTURE_SECS + 0.5, CAPTURE_SECS + 20);
+		if(at[t] + len < 60 * s->minutes + 2)
+			hold(s, t, at[t], at[t] + len);
+		at[t] += len + rnd_secs(0.5, 60);
+	}
+}
+
+void print_script(struct script *s){
+	int i;
+
+	printf("%d minute game:\n", s->minutes);
+	for(i = 0; i < s->n; i++){
+		if(s->in[i].team == NO_TEAM)
+			printf("  %9.3f s  %s\n", s->in[i].at, (s->in[i].level == ENTER) ? "ENTER" : "UP");
+		else
+			printf("  %9.3f s  %c %s\n", s->in[i].at, "RGBY"[s->in[i].team], s->in[i].level ? "lets go" : "shoots");
+	}
+}
+
+// FLAGS bits as the teams' letters
+void flags_names(unsigned int flags, char names[NUM_TEAMS + 1]){
+	unsigned char t;
+	int n = 0;
+
+	for(t = 0; t < NUM_TEAMS; t++)
+		if(flags & TEAM[t].flag)
+			names[n++] = "RGBY"[t];
+	names[n] = 0;
+}
+
+// the game against the referee's, prints how it differs and returns 1 if it does
+int check_referee(struct script *s){
+	struct referee r;
+	unsigned int best = 0, want = 0;
+	unsigned char t;
+	char row[17], points[8], lit[NUM_TEAMS + 1], won[NUM_TEAMS + 1];
+	int col;
+
+	referee(s, &r);
+	if(started_at / JIFFY_TICKS != r.start){
+		printf("the game started %.3f s after power up, the referee's at %.3f s\n",
+			(double)started_at / VLO_HZ, (double)r.start / JIFFY_DIV);
+		return 1;
+	}
+	if(HOST_ticks / JIFFY_TICKS != r.end){
+		printf("the game ended %.3f s into it, the referee's %.3f s in (%s)\n", (double)(HOST_ticks - started_at) / VLO_HZ,
+			(double)(r.end - r.start) / JIFFY_DIV, (r.winner == NO_TEAM) ? "time up" : "held the flag");
+		return 1;
+	}
+	if(lcd_errors())
+		return 1;
+	lcd_row(0, row);
+	for(t = 0; t < NUM_TEAMS; t++){
+		col = TEAM[t].score_col - 1;
+		snprintf(points, sizeof points, "%02u", r.points[t]);
+		if((r.points[t] > 99) || memcmp(row + col, points, 2)){
+			printf("the LCD shows %c's score as %.2s, the referee counts %u points\n", "RGBY"[t], row + col, r.points[t]);
+			return 1;
+		}
+		if(r.points[t] > best)
+			best = r.points[t];
+	}
+	if(r.winner == NO_TEAM){
+		lcd_row(LCD_TIME_ROW - 1, row);
+		if(memcmp(row + LCD_TIME_COL - 1, "00:00", 5)){
+			printf("the time ran out but the LCD shows %.5s\n", row + LCD_TIME_COL - 1);
+			return 1;
+		}
+		for(t = 0; t < NUM_TEAMS; t++)
+			if(r.points[t] == best)
+				want |= TEAM[t].flag;			// the leaders' flags, all of them for a tie
+	}
+	else
+		want = TEAM[r.winner].flag;
+	if(flags_lit() != want){
+		flags_names(flags_lit(), lit);
+		flags_names(want, won);
+		printf("the flags lit are %s, the referee's winners %s\n", *lit ? lit : "none", won);
+		return 1;
+	}
+	return 0;
+}
+
+int random_game(unsigned long game, int show){
+	struct script s;
+	char row[17];
+	int r, bad;
+
+	random_script(&s, game);
+	if(!play(&s)){
+		printf("game %lu: FAILED, not over after %d minutes\n", game, s.minutes);
+		bad = 1;
+	}
+	else
+		bad = check_referee(&s);
+	if(bad || show){
+		if(bad)
+			printf("game %lu: FAILED (ssregress -g %lu -s %llu plays it again)\n", game, game, seed0);
+		print_script(&s);
+		printf("over %.3f s into the game, flags show %c\n", (double)(HOST_ticks - started_at) / VLO_HZ, flags_winner());
+		for(r = 0; r < 2; r++){
+			lcd_row(r, row);
+			printf("  [%s]\n", row);
+		}
+	}
+	return bad;
+}
+
+// shard k of shards: games k, k + shards, ... below games, returns the failures
+unsigned long shard(int k, int shards, unsigned long games){
+	unsigned long game, failed = 0;
+
+	for(game = k; game < games; game += shards)
+		failed += random_game(game, 0);
+	return failed;
+}
+
+int main(int argc, char **argv){
+	unsigned long games = 10000, failed = 0, bad_scenarios = 0, one = -1;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt, i, shards = (cores > 0) ? cores : 1, status, pipes[2];
+	struct timespec t0, t1;
+	double s;
+
+	while((opt = getopt(argc, argv, "n:j:s:g:v")) != -1){
+		switch(opt){
+			case 'n': games = strtoul(optarg, NULL, 0); break;
+			case 'j': shards = atoi(optarg); break;
+			case 's': seed0 = strtoull(optarg, NULL, 0); break;
+			case 'g': one = strtoul(optarg, NULL, 0); break;
+			case 'v': verbose = 1; break;
+			default:
+				fprintf(stderr, "usage: ssregress [-n games] [-j shards] [-s seed] [-v] | -g game [-s seed]\n");
+				return 2;
+		}
+	}
+	power_up = malloc(_end - __data_start);		// set before the copy, so reset keeps it
+	if(!power_up)
+		return 1;
+	memcpy(power_up, __data_start, _end - __data_start);
+	if(one != (unsigned long)-1)
+		return random_game(one, 1);
+	if(shards < 1)
+		shards = 1;
+
+#if DEFAULT_RULES
+	for(i = 0; i < N_SCENARIOS; i++)
+		bad_scenarios += scenario(&SCENARIOS[i]);
+	printf("%d scenarios, %lu failed\n", N_SCENARIOS, bad_scenarios);
+#else
+	printf("game rules other than the defaults, the scenarios' goldens don't apply\n");
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if(pipe(pipes) < 0)
+		return 1;
+	for(i = 0; i < shards; i++){
+		fflush(stdout);
+		if(fork() == 0){
+			unsigned long f = shard(i, shards, games);
+
+			close(pipes[0]);
+			if(write(pipes[1], &f, sizeof f) != sizeof f)
+				exit(1);
+			exit(0);
+		}
+	}
+	close(pipes[1]);
+	for(i = 0; i < shards; i++){
+		unsigned long f;
+
+		wait(&status);
+		if(!WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+		if(read(pipes[0], &f, sizeof f) == sizeof f)
+			failed += f;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%lu random games in %.2f s on %d shards, %.0f games/s (%.0f a shard), %lu failed\n",
+		games, s, shards, games / s, games / s / shards, failed);
+	return (failed != 0) || (bad_scenarios != 0);
+}
@@ -0,0 +1,702 @@
+/***********************************************************************
+	Seize&Secure input replay, runs on the PC (not the MSP430)
+
+	A flag station built with -DRECORD sends the inputs of its game as
+	recording frames next to its telemetry (see rec_event in
+	laserTag/Seize&Secure.c). This takes a capture of that UART, picks a
+	recording (the stream from one reset to the next) and plays it back
+	into the same firmware, powered up with ENTER held so it replays (see
+	replay_init). It sends the stream as a station wants it: REC_SYNC and
+	the header until the first ack, then the records, never more than
+	REC_SIZE - 1 bytes past what the acks say the station took.
+
+	By default the firmware is built for the PC against
+	host/msp430g2553.h and the stream goes straight into UCA0RXBUF. Time
+	only jumps from one Timer A0 deadline to the next, so a 15 minute game
+	plays in milliseconds. With -e it runs on host/hostemu.h instead, the
+	stream coming in byte by byte at the UART's rate and the LCD pins
+	driving host/hd44780.h. With -s it sends the stream to a real station
+	on a serial port: set it to 115200 8N1 raw first (stty -F port raw
+	115200), then power the station up with ENTER held and GRN's target
+	unplugged, P1.1 being UCA0RXD.
+
+	It prints the telemetry of the replay whenever the state, the teams
+	or the scores change and the LCD at the end, then checks every
+	telemetry frame captured during the recording against the replayed
+	frame with the same sequence number.
+
+	Build:	cc -O2 -Ihost -o ssreplay ssreplay.c
+			(add -DNUM_TEAMS=n etc. to match the station's game rules)
+	Usage:	ssreplay [-v] [-e | -s port] [-n recording] [-t seconds] capture.bin
+		-v	print every replayed telemetry frame
+		-e	play it on the emulator
+		-s	play it on the station at port
+		-n	recording to play, counting from 1 (default: the last one)
+		-t	seconds to play on after the last input (default 5, and
+			anyway until it has sent all the telemetry captured)
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include "hostemu.h"
+#include "hd44780.h"
+
+#define MAX_STREAM 65536
+#define MAX_FRAMES 65536
+#define PLAY_MAX 3600			// seconds after the last input a replay may go on for
+
+unsigned char replay_stream[MAX_STREAM];
+unsigned int replay_len;
+unsigned char host_info[256];		// info flash, blank
+
+// the firmware, with 16 bit ints like on the MSP430
+#define RECORD
+#define INFO_FLASH host_info
+#define main firmware_main
+#define int short
+#include "../laserTag/Seize&Secure.c"
+#undef int
+#undef main
+
+#define FRAME_MAX REC_LEN		// the longest frame
+
+const char *STATES[8] = {"lcd", "setup", "start", "wait", "take", "owned", "over", "steal"};
+const char *TEAMS[4] = {"RED", "GRN", "BLU", "YEL"};
+
+// telemetry frames by sequence number since the reset, wrapping sequence numbers unwrapped
+struct frames {
+	unsigned char (*f)[TLM_LEN];
+	unsigned char *have;
+	long count;				// one more than the last sequence number held
+	long seq;				// unwrapped sequence number of the last frame added
+};
+struct frames recorded, replayed;
+
+int verbose;
+double now_s;				// time of the replay, for print_frame
+
+void frames_init(struct frames *fr){
+	fr->f = calloc(MAX_FRAMES, TLM_LEN);
+	fr->have = calloc(MAX_FRAMES, 1);
+	if(fr->f == NULL || fr->have == NULL){
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	fr->count = 0;
+	fr->seq = -1;
+}
+
+void frames_add(struct frames *fr, const unsigned char *f){
+	if(fr->seq < 0)
+		fr->seq = f[1];
+	else
+		fr->seq += (unsigned char)(f[1] - fr->seq);
+	if(fr->seq >= MAX_FRAMES)
+		return;
+	memcpy(fr->f[fr->seq], f, TLM_LEN);
+	fr->have[fr->seq] = 1;
+	fr->count = fr->seq + 1;
+}
+
+const char *team(unsigned char t){
+	if(t == TLM_NOTEAM)
+		return "---";
+	return TEAMS[t & 3];
+}
+
+void print_frame(const unsigned char *f){
+	printf("%9.3fs #%-4ld %-5s owner %s attacker %s  RED %2X GRN %2X BLU %2X YEL %2X  time %02X:%02X  flag %3us  capture %us\n",
+		now_s, replayed.seq, STATES[f[2] & 7], team(f[3] >> 4), team(f[3] & 0x0F),
+		f[4], f[5], f[6], f[7], f[8], f[9], f[10], f[11]);
+}
+
+//-----Frames-----
+
+// a frame of a capture or of the station's UART: f[0] is the sync byte, len its length
+typedef void frame_fn(const unsigned char *f, int len);
+
+struct parser {
+	unsigned char f[FRAME_MAX];
+	int n;					// bytes in f
+};
+
+int is_sync(unsigned char c){
+	return (c == TLM_SYNC) || (c == PROBE_SYNC) || (c == REC_SYNC);
+}
+
+// take the next byte, call fn for every frame it completes
+void parse(struct parser *p, unsigned char c, frame_fn *fn){
+	unsigned char sum;
+	int len, i, j;
+
+	if((p->n == 0) && !is_sync(c))
+		return;
+	p->f[p->n++] = c;
+	for(;;){
+		len = (p->f[0] == PROBE_SYNC) ? PROBE_LEN : (p->f[0] == REC_SYNC) ? REC_LEN : TLM_LEN;
+		if(p->n < len)
+			break;
+		sum = 0;
+		for(i = 1; i < len; i++)
+			sum += p->f[i];
+		if(sum != 0)
+			// not a frame, look for the next sync byte after this one
+			for(i = 1; (i < p->n) && !is_sync(p->f[i]); i++);
+		else{
+			fn(p->f, len);
+			i = len;
+		}
+		for(j = 0; i < p->n; )
+			p->f[j++] = p->f[i++];
+		p->n = j;
+		if(p->n == 0)
+			break;
+	}
+}
+
+void scan(const unsigned char *in, long size, frame_fn *fn){
+	struct parser p;
+	long pos;
+
+	p.n = 0;
+	for(pos = 0; pos < size; pos++)
+		parse(&p, in[pos], fn);
+}
+
+//-----Capture-----
+
+int recordings;				// REC_START frames seen so far
+int wanted;					// the recording to collect
+int collecting;				// 1 while in it, 0 once it broke or ended
+unsigned char rec_expect;	// sequence number of its next frame
+long broken_at = -1;		// stream bytes collected before a frame went missing
+
+void count_recording(const unsigned char *f, int len){
+	(void)len;
+	if((f[0] == REC_SYNC) && !(f[2] & REC_ACK) && (f[2] & REC_START))
+		recordings++;
+}
+
+void collect(const unsigned char *f, int len){
+	int n;
+
+	(void)len;
+	if((f[0] == REC_SYNC) && !(f[2] & REC_ACK)){
+		if(f[2] & REC_START){
+			recordings++;
+			collecting = (recordings == wanted);
+		}
+		else if(collecting && ((f[1] != rec_expect) || (f[2] & REC_LOST))){
+			broken_at = replay_len;
+			collecting = 0;
+		}
+		if(!collecting)
+			return;
+		rec_expect = f[1] + 1;
+		n = f[2] & 0x1F;
+		if(n > REC_DATA || replay_len + n > MAX_STREAM){
+			broken_at = replay_len;
+			collecting = 0;
+			return;
+		}
+		memcpy(replay_stream + replay_len, f + 3, n);
+		replay_len += n;
+	}
+	else if((f[0] == TLM_SYNC) && collecting)
+		frames_add(&recorded, f);
+}
+
+// cut the stream after its last whole record, returns the number of records
+// and leaves the time of the last one in last
+long check_stream(unsigned long *last){
+	unsigned long code, ticks = 0;
+	unsigned int pos = 4, end = 4, shift;
+	long records = 0;
+
+	if(replay_len < 4)
+		return -1;
+	while(pos < replay_len){
+		code = 0;
+		shift = 0;
+		while((pos < replay_len) && (replay_stream[pos] & 0x80) && (shift < 35)){
+			code |= (unsigned long)(replay_stream[pos++] & 0x7F) << shift;
+			shift += 7;
+		}
+		if(pos + 1 >= replay_len)
+			break;
+		code |= (unsigned long)replay_stream[pos++] << shift;
+		pos++;					// the data byte
+		ticks += code >> 2;
+		records++;
+		end = pos;
+	}
+	replay_len = end;
+	*last = ticks;
+	return records;
+}
+
+//-----Sending-----
+
+long sent = 4;				// stream bytes sent once the header was taken
+long taken;					// stream bytes the acks say the station took
+int header_at;				// next byte of REC_SYNC and the header to send, 5 once all sent
+int started;				// an ack came, the station took the header
+int lost;					// an ack said REC_LOST: the replay went wrong from there
+int restarts;				// the station acked the header again, it reset
+
+// the next byte to send, -1 while the acks hold it back
+int send_next(){
+	int c;
+
+	if(!started){
+		if(header_at > 4)
+			return -1;
+		c = header_at ? replay_stream[header_at - 1] : REC_SYNC;
+		header_at++;
+		return c;
+	}
+	if((sent >= (long)replay_len) || (sent - taken >= REC_SIZE - 1))
+		return -1;
+	return replay_stream[sent++];
+}
+
+// no ack came for the header yet: send it again
+void send_again(){
+	if(!started)
+		header_at = 0;
+}
+
+// a frame from the station: telemetry, or a replay's ack (see replay_ack)
+void received(const unsigned char *f, int len){
+	(void)len;
+	if(f[0] == TLM_SYNC){
+		frames_add(&replayed, f);
+		if(verbose || (replayed.seq == 0) || memcmp(f + 2, replayed.f[replayed.seq - 1] + 2, 6))
+			print_frame(f);
+	}
+	else if((f[0] == REC_SYNC) && (f[2] & REC_ACK)){
+		if(f[2] & REC_START){
+			if(started)
+				restarts++;
+			started = 1;
+			sent = taken = 4;
+		}
+		taken += (unsigned char)(f[3] - (unsigned char)taken);
+		if(f[2] & REC_LOST)
+			lost = 1;
+	}
+}
+
+//-----Host-----
+
+struct parser tx;			// the station's UART
+
+// the next stream byte into UCA0RXBUF once the last one was read
+void feed(){
+	int c;
+
+	if(HOST_IFG2 & UCA0RXIFG)
+		return;
+	if((c = send_next()) < 0)
+		return;
+	HOST_UCA0RXBUF = c;
+	HOST_IFG2 |= UCA0RXIFG;
+}
+
+// HOST_access: the clock as the host drives it, and the stream for replay_init's polling
+void feed_access(const volatile void *reg){
+	HOST_TA0R = HOST_TA1R = (unsigned short)HOST_ticks;
+	if(reg == &HOST_UCA0RXBUF)
+		HOST_IFG2 &= ~UCA0RXIFG;
+	else if(reg == &HOST_IFG2)
+		feed();
+}
+
+// Timer A0 compare: the tick TA0R next reaches ccr, after this one
+unsigned long compare_at(unsigned short ccr){
+	unsigned short d = ccr - TA0R;
+
+	return HOST_ticks + (d ? d : 0x10000);
+}
+
+// send all the LCD work at once: it takes the station a few ms, and the game
+// only looks at the LCD from its jiffy timers
+void lcd_drain(){
+	while(TA1CCTL0 & CCIE)
+		LCD_handler();
+}
+
+// take the bytes tx_handler sends as the UART would
+void uart_drain(){
+	unsigned char head;
+
+	while(UC0IE & UCA0TXIE){
+		head = TX_head;
+		tx_handler();
+		if(TX_head == head)
+			continue;
+		now_s = (double)HOST_ticks / ONE_SEC;
+		parse(&tx, UCA0TXBUF, received);
+	}
+}
+
+// run whatever is pending at this tick, by interrupt priority but for the
+// debounce sample going last: CCR2 is only set for an input recorded before
+// the next sample's, so one due in the same tick as a sample came before it
+void interrupts(){
+	for(;;){
+		feed();
+		if((TA0CCTL0 & CCIE) && (TA0CCTL0 & CCIFG)){
+			TA0CCTL0 &= ~CCIFG;
+			timer_handler();
+		}
+		else if((TA0CCTL2 & CCIE) && (TA0CCTL2 & CCIFG)){
+			TA0CCTL2 &= ~CCIFG;
+			TA0IV = TA0IV_TACCR2;
+			debounce_handler();
+		}
+		else if((UC0IE & UCA0RXIE) && (UC0IFG & UCA0RXIFG))
+			rx_handler();
+		else if(P2IFG & P2IE)
+			button_handler();
+		else if(P1IFG & P1IE)
+			target_handler();
+		else if((TA0CCTL1 & CCIE) && (TA0CCTL1 & CCIFG)){
+			TA0CCTL1 &= ~CCIFG;
+			TA0IV = TA0IV_TACCR1;
+			debounce_handler();
+		}
+		else
+			break;
+		lcd_drain();
+		uart_drain();
+	}
+}
+
+// play until the tick until, and on until the replay has sent as many
+// telemetry frames as were captured, for at most limit ticks
+void play(unsigned long until, unsigned long limit){
+	unsigned long next, at;
+
+	memset(host_info, 0xFF, sizeof host_info);
+	HOST_ticks = 0;
+	HOST_P2IN = 0;				// ENTER held at power up: replay
+	HOST_access = feed_access;
+	init_game();
+	lcd_drain();
+	uart_drain();
+	interrupts();
+	while((HOST_ticks < until) || ((replayed.count < recorded.count) && (HOST_ticks < limit))){
+		if(HOST_ticks >= until)
+			until = limit;
+		next = until;
+		if(TA0CCTL0 & CCIE)
+			next = compare_at(TA0CCR0);
+		if((TA0CCTL1 & CCIE) && ((at = compare_at(TA0CCR1)) < next))
+			next = at;
+		if((TA0CCTL2 & CCIE) && ((at = compare_at(TA0CCR2)) < next))
+			next = at;
+		if(next > until)
+			next = until;
+		HOST_ticks = next;
+		if(TA0R == TA0CCR0)
+			TA0CCTL0 |= CCIFG;
+		if(TA0R == TA0CCR1)
+			TA0CCTL1 |= CCIFG;
+		if(TA0R == TA0CCR2)
+			TA0CCTL2 |= CCIFG;
+		interrupts();
+	}
+}
+
+//-----Emulator-----
+
+struct hd44780 lcd;
+int on_line = -1;				// byte on its way to UCA0RXD, in at EMU_event_at
+unsigned long long line_free;	// the sender's line is idle from here
+unsigned long long header_next;	// time to send the header again if no ack came
+unsigned long long started_ps;	// time the header's ack came
+double play_s;					// seconds to play from then before stopping at a frame
+
+// emu_ports: the LCD pins into the model and its answer onto D7-D4
+void lcd_pins(void){
+	int nibble;
+
+	nibble = hd44780_bus(&lcd, EMU_ps, (HOST_P1OUT & LCDRS) != 0, (HOST_P1OUT & LCDRW) != 0, (HOST_P1OUT & LCDE) != 0,
+		HOST_P2OUT & LCDDATA, (HOST_P2DIR & LCDDATA) != 0);
+	EMU_in[1] = (EMU_in[1] & ~LCDDATA) | ((nibble < 0) ? LCDDATA : nibble);	// pulled up inside the LCD
+}
+
+// start the next byte down the line if there is one, at 115200 8N1
+void emu_send(void){
+	unsigned long long from = (line_free > EMU_ps) ? line_free : EMU_ps;
+	int c;
+
+	if(on_line >= 0)
+		return;
+	if((c = send_next()) < 0){
+		if(!started)
+			EMU_event_at = header_next;
+		return;
+	}
+	on_line = c;
+	EMU_event_at = from + 10 * EMU_PS / 115200;
+}
+
+// emu_event: a byte's stop bit, or a second without the header's ack
+void sender_event(void){
+	if(on_line >= 0){
+		emu_uart_rx(on_line);
+		on_line = -1;
+		line_free = EMU_ps;
+	}
+	else if(!started && (EMU_ps >= header_next)){
+		send_again();
+		header_next = EMU_ps + EMU_PS;
+	}
+	emu_send();
+}
+
+// emu_uart: a byte from the station, the run ends with the first frame after
+// play_s once there are as many as were captured
+void station_tx(unsigned char c){
+	now_s = (double)EMU_uart_ps / EMU_PS;
+	parse(&tx, c, received);
+	if(started && !started_ps)
+		started_ps = EMU_ps;
+	if(started_ps && (EMU_ps >= started_ps + play_s * EMU_PS) && (replayed.count >= recorded.count))
+		EMU_end = EMU_ps;
+	emu_send();
+}
+
+void firmware(void){
+	firmware_main();
+}
+
+// play for play seconds from the header's ack, and on for at most limit
+int emulate(double play, double limit){
+	int why;
+
+	memset(host_info, 0xFF, sizeof host_info);
+	emu_flash(host_info, sizeof host_info, LOG_SEG_SIZE);
+	hd44780_init(&lcd);
+	EMU_vlo_hz = replay_stream[0] | replay_stream[1] << 8;	// ONE_SEC is the VLO's rate
+	EMU_in[1] &= ~ENTER;					// held at power up: replay
+	emu_ports = lcd_pins;
+	emu_uart = station_tx;
+	emu_event = sender_event;
+	EMU_event_at = 0;
+	play_s = play;
+	why = emu_run(firmware, play + limit);
+	if(why != EMU_END){
+		printf("the station %s at %.3fs\n", (why == EMU_RESET) ? EMU_why : "halted", (double)EMU_ps / EMU_PS);
+		return 1;
+	}
+	if(EMU_rx_overruns)
+		printf("%lu stream bytes overran UCA0RXBUF\n", EMU_rx_overruns);
+	return 0;
+}
+
+//-----Serial port-----
+
+double wall(){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// send to the station at port and take its frames until everything was taken,
+// after seconds more and the telemetry captured
+int serial(const char *port, double after){
+	unsigned char buf[256], b;
+	double start = wall(), now, header = 0, done = -1;
+	struct pollfd p;
+	int fd, c, n, i;
+
+	fd = open(port, O_RDWR | O_NOCTTY);
+	if(fd < 0){
+		perror(port);
+		return 1;
+	}
+	printf("sending to %s: power the station up with ENTER held\n", port);
+	for(;;){
+		now = wall();
+		if(!started && (now >= header)){
+			send_again();
+			header = now + 1;
+		}
+		while((c = send_next()) >= 0){
+			b = c;
+			if(write(fd, &b, 1) != 1){
+				perror(port);
+				return 1;
+			}
+		}
+		p.fd = fd;
+		p.events = POLLIN;
+		if(poll(&p, 1, 100) > 0){
+			n = read(fd, buf, sizeof buf);
+			if(n <= 0){
+				perror(port);
+				return 1;
+			}
+			now_s = wall() - start;
+			for(i = 0; i < n; i++)
+				parse(&tx, buf[i], received);
+		}
+		if((done < 0) && started && (taken >= (long)replay_len))
+			done = now + after;
+		if((done >= 0) && (now >= done) && ((replayed.count >= recorded.count) || (now >= done + PLAY_MAX)))
+			break;
+	}
+	close(fd);
+	return 0;
+}
+
+//-----Results-----
+
+// a row of the LCD, 16 characters
+void print_row(const char *text){
+	int col;
+	char c;
+
+	printf("  [");
+	for(col = 0; col < 16; col++){
+		c = text[col];
+		if((c & 0xF8) == BAR(0))
+			c = '0' + c - BAR(0);		// progress bar glyph, its level
+		putchar(c);
+	}
+	printf("]\n");
+}
+
+// compare the captured telemetry with the replay's, returns the number of mismatches
+long compare(){
+	long seq, checked = 0, bad = 0;
+
+	for(seq = 0; seq < recorded.count; seq++){
+		if(!recorded.have[seq])
+			continue;
+		checked++;
+		if((seq < replayed.count) && replayed.have[seq]
+		&& !memcmp(recorded.f[seq] + 2, replayed.f[seq] + 2, TLM_LEN - 3))
+			continue;
+		if(bad++ == 0){
+			printf("first difference at frame #%ld\n  recorded:", seq);
+			for(int i = 2; i < TLM_LEN - 1; i++)
+				printf(" %02X", recorded.f[seq][i]);
+			printf("\n  replayed:");
+			for(int i = 2; i < TLM_LEN - 1; i++)
+				printf((seq < replayed.count) && replayed.have[seq] ? " %02X" : " --", replayed.f[seq][i]);
+			printf("\n");
+		}
+	}
+	printf("%ld of %ld recorded telemetry frames replayed the same\n", checked - bad, checked);
+	return bad;
+}
+
+int main(int argc, char *argv[]){
+	unsigned char *in;
+	unsigned long last, one_sec;
+	long size, records;
+	double after = 5;
+	char row[17];
+	const char *port = NULL;
+	int c, emu = 0, r;
+	FILE *f;
+
+	while((c = getopt(argc, argv, "ves:n:t:")) != -1){
+		switch(c){
+			case 'v': verbose = 1; break;
+			case 'e': emu = 1; break;
+			case 's': port = optarg; break;
+			case 'n': wanted = atoi(optarg); break;
+			case 't': after = atof(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-v] [-e | -s port] [-n recording] [-t seconds] capture.bin\n", argv[0]);
+				return 2;
+		}
+	}
+	if((optind != argc - 1) || (emu && port)){
+		fprintf(stderr, "usage: %s [-v] [-e | -s port] [-n recording] [-t seconds] capture.bin\n", argv[0]);
+		return 2;
+	}
+	f = fopen(argv[optind], "rb");
+	if(f == NULL){
+		perror(argv[optind]);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	in = malloc(size + 1);
+	if((in == NULL) || (fread(in, 1, size, f) != (size_t)size)){
+		fprintf(stderr, "%s: can't read it\n", argv[optind]);
+		return 1;
+	}
+	fclose(f);
+
+	scan(in, size, count_recording);
+	if(recordings == 0){
+		fprintf(stderr, "no recording, was the station built with -DRECORD?\n");
+		return 1;
+	}
+	if(wanted == 0)
+		wanted = recordings;
+	if(wanted < 1 || wanted > recordings){
+		fprintf(stderr, "there are %d recordings\n", recordings);
+		return 1;
+	}
+	frames_init(&recorded);
+	frames_init(&replayed);
+	recordings = 0;
+	scan(in, size, collect);
+	records = check_stream(&last);
+	if(records < 0){
+		fprintf(stderr, "recording %d has no header\n", wanted);
+		return 1;
+	}
+	if(broken_at >= 0)
+		fprintf(stderr, "recording %d lost frames after %ld bytes, only the inputs before are played\n", wanted, broken_at);
+	if(replay_stream[2] != NUM_TEAMS){
+		fprintf(stderr, "recorded with NUM_TEAMS=%u, build ssreplay with -DNUM_TEAMS=%u\n", replay_stream[2], replay_stream[2]);
+		return 1;
+	}
+
+	one_sec = replay_stream[0] | replay_stream[1] << 8;
+	printf("recording %d of %d: %ld inputs over %.3fs, ONE_SEC %lu\n", wanted, recordings, records,
+		(double)last / one_sec, one_sec);
+	if(port){
+		if(serial(port, after))
+			return 1;
+	}
+	else if(emu){
+		if(emulate((double)last / one_sec + after, PLAY_MAX))
+			return 1;
+		for(r = 0; r < 2; r++){
+			hd44780_row(&lcd, r, row);
+			print_row(row);
+		}
+	}
+	else{
+		play(last + (unsigned long)(after * one_sec), last + PLAY_MAX * one_sec);
+		for(r = 0; r < 2; r++)
+			print_row(LCD_shadow[r]);
+	}
+	if(restarts)
+		printf("the station reset %d times during the replay\n", restarts);
+	if(lost)
+		printf("the station lost stream bytes or got them late, the replay went wrong from there\n");
+	if(started && (taken < (long)replay_len))
+		printf("the station took %ld of %u stream bytes\n", taken, replay_len);
+	if(broken_at >= 0)
+		return 0;
+	return (compare() || lost) ? 3 : 0;
+}
@@ -0,0 +1,113 @@
+/***********************************************************************
+	Seize&Secure telemetry reader, runs on the PC (not the MSP430)
+
+	Reads the frames a Seize&Secure flag station sends out of P1.2 at
+	115200 baud 8N1 (through a USB-serial adapter, or the LaunchPad's
+	application UART with the TXD jumper set for hardware UART), and prints
+	one line per frame. The frame format is described with tlm_frame in
+	laserTag/Seize&Secure.c. Probe frames from a -DPROBE build and
+	recording frames from a -DRECORD build are passed over, ssprobe and
+	ssreplay read them. At the end of the input it prints how many
+	frames were received, how many were lost (gaps in the sequence numbers)
+	and how many bytes had to be skipped to find the next good frame.
+
+	Build:	cc -o sstlm sstlm.c
+	Usage:	stty -F /dev/ttyACM0 115200 raw
+			sstlm /dev/ttyACM0
+		or	sstlm capture.bin
+
+ ***********************************************************************/
+
+#include <stdio.h>
+
+#define TLM_SYNC 0xA5
+#define TLM_LEN 13
+#define TLM_NOTEAM 0x0F
+#define PROBE_SYNC 0xA6
+#define PROBE_LEN 21
+#define REC_SYNC 0xA7
+#define REC_LEN 16
+
+const char *STATES[8] = {"lcd", "setup", "start", "wait", "take", "owned", "over", "steal"};
+const char *TEAMS[4] = {"RED", "GRN", "BLU", "YEL"};
+
+unsigned long frames, lost, skipped;
+
+const char *team(unsigned char t){
+	if(t == TLM_NOTEAM)
+		return "---";
+	return TEAMS[t & 3];
+}
+
+// length of the frame a byte starts, 0 if it is no sync byte
+int frame_len(unsigned char c){
+	switch(c){
+		case TLM_SYNC:
+			return TLM_LEN;
+		case PROBE_SYNC:
+			return PROBE_LEN;
+		case REC_SYNC:
+			return REC_LEN;
+	}
+	return 0;
+}
+
+void print_frame(const unsigned char *f){
+	// scores and the game time are packed BCD
+	printf("#%3u %-5s owner %s attacker %s  RED %2X GRN %2X BLU %2X YEL %2X  time %02X:%02X  flag %3us  capture %us\n",
+		f[1], STATES[f[2] & 7], team(f[3] >> 4), team(f[3] & 0x0F),
+		f[4], f[5], f[6], f[7], f[8], f[9], f[10], f[11]);
+}
+
+int main(int argc, char *argv[]){
+	unsigned char f[REC_LEN], sum, expect = 0;
+	int n = 0, len, i, j, c, synced = 0;
+	FILE *in = stdin;
+
+	if(argc > 2){
+		fprintf(stderr, "usage: %s [device or file]\n", argv[0]);
+		return 2;
+	}
+	if(argc == 2){
+		in = fopen(argv[1], "rb");
+		if(in == NULL){
+			perror(argv[1]);
+			return 1;
+		}
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	while((c = getc(in)) != EOF){
+		if((n == 0) && !frame_len(c)){
+			skipped++;
+			continue;
+		}
+		f[n++] = c;
+		while((n != 0) && (n >= (len = frame_len(f[0])))){
+			sum = 0;
+			for(i = 1; i < len; i++)
+				sum += f[i];
+			if(sum != 0){
+				// not a frame, look for the next sync byte after this one
+				for(i = 1; (i < n) && !frame_len(f[i]); i++);
+				skipped += i;
+			}
+			else{
+				if(f[0] == TLM_SYNC){
+					if(synced)
+						lost += (unsigned char)(f[1] - expect);
+					synced = 1;
+					expect = f[1] + 1;
+					frames++;
+					print_frame(f);
+				}
+				i = len;
+			}
+			for(j = 0; i < n; )
+				f[j++] = f[i++];
+			n = j;
+		}
+	}
+	printf("%lu frames, %lu lost, %lu bytes skipped\n", frames, lost, skipped);
+	return 0;
+}
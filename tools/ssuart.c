@@ -0,0 +1,283 @@
+/***********************************************************************
+	Seize&Secure telemetry link test, runs on the PC (not the MSP430)
+
+	Puts an emulated receiver on the UART of the flag station firmware,
+	built for the emulated MSP430G2553 (host/hostemu.h): every byte that
+	leaves UCA0TXD at 115200 baud 8N1 is timestamped at its stop bit and
+	parsed the way sstlm parses a serial port, and each load runs in a
+	process of its own, from a power up:
+
+	- game: a 2 minute game, RED taking the flag, GRN stealing it.
+	- paced: 2000 UP presses 1.5ms apart in setup, each changing the
+	  game time and so sending a 13 byte frame (1.13ms on the line).
+	  The link keeps up, nothing may be lost.
+	- flood: 5000 UP presses 0.3ms apart, four times what the line can
+	  carry. Frames that don't fit TX_ring are dropped whole, so the
+	  receiver has to see every one of them as a sequence gap, and the
+	  line has to stay busy.
+
+	Every load is checked for: no checksum failures (bytes skipped), no
+	byte overwritten in UCA0TXBUF (EMU_tx_overruns), no byte stalled by
+	SMCLK stopping under it (EMU_tx_stalls), frames received + frames
+	lost = frames tlm_update sent or dropped (it counts TLM_seq up for
+	both). It prints the frames, the bytes a second over the load, how
+	busy that kept the line and the baud rate seen between the bytes of
+	a frame.
+
+	Build:	cc -O2 -Ihost -o ssuart ssuart.c
+	Usage:	ssuart [-v vlo_hz]
+
+ ***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "hostemu.h"
+
+unsigned char host_info[3 * 64];
+
+#define INFO_FLASH host_info
+#define main firmware_main
+#define int short
+#define long __attribute__((mode(SI))) int
+#include "../laserTag/Seize&Secure.c"
+#undef long
+#undef int
+#undef main
+
+#define PS_US		1000000ULL		// picoseconds in a microsecond
+#define PS_MS		(1000 * PS_US)
+#define BAUD		115200
+#define TAIL_MS		3000			// quiet after the load, for TX_ring to drain
+#define MAX_INPUTS	20000
+
+// a load: times (us) the pins change
+struct input {
+	unsigned long long us;
+	int port;
+	unsigned char mask;
+	int level;
+};
+
+struct input INPUTS[MAX_INPUTS];
+int inputs, next_input;
+
+struct load {
+	const char *name;
+	unsigned long long (*make)(void);	// fills INPUTS, returns the us its last input is at
+	int loses;							// frames may be lost
+};
+
+// the receiver, as sstlm has it
+unsigned char rx[16];
+int rx_n;
+unsigned char rx_expect;				// sequence number of the next frame, from 0 at power up
+unsigned long rx_frames, rx_lost, rx_skipped, rx_bytes;
+unsigned long long rx_first, rx_last;	// times of the first and last byte of the load
+unsigned long long rx_prev, rx_gap = EMU_NEVER;	// last byte, shortest gap seen between two (EMU_uart_ps)
+unsigned long long load_from, load_to;	// window the load is measured over
+unsigned long load_bytes;
+unsigned char last_seq;
+unsigned long tlm_sent;					// TLM_seq steps, frames sent or dropped
+
+void press(unsigned long long us, unsigned char mask){
+	if(inputs + 2 <= MAX_INPUTS){
+		INPUTS[inputs++] = (struct input){us, 2, mask, 0};
+		INPUTS[inputs++] = (struct input){us + 100, 2, mask, 1};
+	}
+}
+
+void hold(unsigned long long us, unsigned long long len, unsigned char mask){
+	INPUTS[inputs++] = (struct input){us, 1, mask, 0};
+	INPUTS[inputs++] = (struct input){us + len, 1, mask, 1};
+}
+
+unsigned long long make_game(void){
+	press(1000000, ENTER);							// a 2 minute game
+	hold(9000000, 6000000, REDTAKE);				// RED takes the flag
+	hold(30000000, 2000000, GRNTAKE);				// GRN lets go too soon
+	hold(40000000, 7000000, GRNTAKE);				// and steals it
+	hold(100000000, 3000000, REDTAKE);
+	load_from = 0;
+	return 126000000;								// the LCD starts over once it ends at ~127s
+}
+
+unsigned long long presses(unsigned long n, unsigned long every){
+	unsigned long i;
+
+	load_from = 1000000 * PS_US;
+	for(i = 0; i < n; i++)
+		press(1000000 + i * every, UP);
+	press(1000000 + n * every + 500000, UP);	// once TX_ring is empty, so frames dropped at the end show as a gap
+	return 1000000 + n * every;
+}
+
+unsigned long long make_paced(void){
+	return presses(2000, 1500);
+}
+
+unsigned long long make_flood(void){
+	return presses(5000, 300);
+}
+
+struct load LOADS[] = {
+	{"game", make_game, 0},
+	{"paced", make_paced, 0},
+	{"flood", make_flood, 1}
+};
+#define N_LOADS (int)(sizeof LOADS / sizeof LOADS[0])
+
+// length of the frame a byte starts, 0 if it is no sync byte
+int frame_len(unsigned char c){
+	switch(c){
+		case TLM_SYNC:
+			return TLM_LEN;
+#ifdef PROBE
+		case PROBE_SYNC:
+			return PROBE_LEN;
+#endif
+#ifdef RECORD
+		case REC_SYNC:
+			return REC_LEN;
+#endif
+	}
+	return 0;
+}
+
+// emu_uart: a byte's stop bit ended
+void uart_rx(unsigned char c){
+	unsigned char sum;
+	int i, j, len;
+
+	rx_bytes++;
+	if((EMU_uart_ps >= load_from) && (EMU_uart_ps < load_to)){
+		if(!load_bytes)
+			rx_first = EMU_uart_ps;
+		rx_last = EMU_uart_ps;
+		load_bytes++;
+	}
+	if(rx_n && (EMU_uart_ps - rx_prev < rx_gap))
+		rx_gap = EMU_uart_ps - rx_prev;		// bytes of one frame go back to back
+	rx_prev = EMU_uart_ps;
+	if((rx_n == 0) && !frame_len(c)){
+		rx_skipped++;
+		return;
+	}
+	rx[rx_n++] = c;
+	while((rx_n != 0) && (rx_n >= (len = frame_len(rx[0])))){
+		sum = 0;
+		for(i = 1; i < len; i++)
+			sum += rx[i];
+		if(sum != 0){
+			for(i = 1; (i < rx_n) && !frame_len(rx[i]); i++);
+			rx_skipped += i;
+		}
+		else{
+			if(rx[0] == TLM_SYNC){
+				rx_lost += (unsigned char)(rx[1] - rx_expect);
+				rx_expect = rx[1] + 1;
+				rx_frames++;
+			}
+			i = len;
+		}
+		for(j = 0; i < rx_n; )
+			rx[j++] = rx[i++];
+		rx_n = j;
+	}
+}
+
+// HOST_access: count TLM_seq's steps, on every register access the firmware makes
+void (*emu_access_hook)(const volatile void *);
+
+void watch_access(const volatile void *reg){
+	emu_access_hook(reg);
+	tlm_sent += (unsigned char)(TLM_seq - last_seq);
+	last_seq = TLM_seq;
+}
+
+// emu_event: the inputs that are due
+void load_event(void){
+	while((next_input < inputs) && (INPUTS[next_input].us * PS_US <= EMU_ps)){
+		emu_pin(INPUTS[next_input].port, INPUTS[next_input].mask, INPUTS[next_input].level);
+		next_input++;
+	}
+	EMU_event_at = (next_input < inputs) ? INPUTS[next_input].us * PS_US : EMU_NEVER;
+}
+
+void firmware(void){
+	emu_access_hook = HOST_access;		// emu_run has just powered up
+	HOST_access = watch_access;
+	firmware_main();
+}
+
+int check(const char *what, unsigned long got, unsigned long want){
+	if(got == want)
+		return 0;
+	printf("  FAILED: %lu %s, should be %lu\n", got, what, want);
+	return 1;
+}
+
+int play(struct load *ld){
+	unsigned long long end;
+	double s, rate;
+	int bad = 0;
+
+	end = ld->make();
+	load_to = end * PS_US;
+	memset(host_info, 0xFF, sizeof host_info);
+	emu_flash(host_info, sizeof host_info, LOG_SEG_SIZE);
+	emu_uart = uart_rx;
+	emu_event = load_event;
+	EMU_event_at = 0;
+	if(emu_run(firmware, end / 1e6 + TAIL_MS / 1e3) != EMU_END){
+		printf("%s: the firmware stopped at %.6f s: %s\n", ld->name, EMU_ps / (double)EMU_PS,
+			EMU_why ? EMU_why : "halted");
+		return 1;
+	}
+
+	s = (rx_last - rx_first) / (double)EMU_PS;
+	rate = (load_bytes > 1) ? (load_bytes - 1) / s : 0;
+	printf("%s: %lu frames sent or dropped, %lu received, %lu lost, %lu bytes skipped\n",
+		ld->name, tlm_sent, rx_frames, rx_lost, rx_skipped);
+	printf("  %lu bytes in %.3f s, %.0f bytes/s, the line %.1f%% busy; %.0f baud between bytes\n",
+		load_bytes, s, rate, 100 * rate * 10 / BAUD, EMU_PS * 10.0 / rx_gap);
+	printf("  %lu TXBUF overruns, %.0f us of bytes stalled by SMCLK stopping\n",
+		EMU_tx_overruns, EMU_tx_stalls / 1e6);
+	bad |= check("frames received + lost", rx_frames + rx_lost, tlm_sent);
+	bad |= check("bytes skipped", rx_skipped, 0);
+	bad |= check("TXBUF overruns", EMU_tx_overruns, 0);
+	bad |= check("ps of stalled bytes", EMU_tx_stalls, 0);
+	if(!ld->loses)
+		bad |= check("frames lost", rx_lost, 0);
+	else if(rx_lost == 0){
+		printf("  FAILED: the load should overflow TX_ring\n");
+		bad = 1;
+	}
+	else if(rate * 10 < 0.9 * BAUD){
+		printf("  FAILED: the line should be kept over 90%% busy\n");
+		bad = 1;
+	}
+	return bad;
+}
+
+int main(int argc, char **argv){
+	int opt, l, status, failed = 0;
+
+	while((opt = getopt(argc, argv, "v:")) != -1){
+		if(opt != 'v'){
+			fprintf(stderr, "usage: ssuart [-v vlo_hz]\n");
+			return 1;
+		}
+		EMU_vlo_hz = atol(optarg);
+	}
+	for(l = 0; l < N_LOADS; l++){
+		fflush(stdout);
+		if(fork() == 0)
+			return play(&LOADS[l]);
+		wait(&status);
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+	}
+	printf(failed ? "FAILED\n" : "all loads passed\n");
+	return failed;
+}